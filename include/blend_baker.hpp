@@ -0,0 +1,223 @@
+#ifndef BLEND_BAKER_HPP
+#define BLEND_BAKER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <iostream>
+#include <cstdint>
+
+#include "shader.hpp"
+#include "mip_generator.hpp"
+#include "texture_format.hpp"
+#include "texture_residency.hpp"
+
+const int BLEND_BAKE_SIZE = 512;
+const int BLEND_STABLE_FRAMES = 30;
+
+// Everything the two-texture blend of frag_shader.frag depends on.
+struct BlendInputs
+{
+    unsigned int texture1 = 0;
+    unsigned int texture2 = 0;
+    glm::vec2 layers = glm::vec2(0.0f);
+    glm::vec4 uv_rect1 = glm::vec4(0.0f);
+    glm::vec4 uv_rect2 = glm::vec4(0.0f);
+    glm::vec2 min_lods = glm::vec2(0.0f);
+    float multiplier = 0.0f;
+
+    bool operator==(const BlendInputs &other) const
+    {
+        return texture1 == other.texture1 && texture2 == other.texture2 && layers == other.layers && uv_rect1 == other.uv_rect1 &&
+               uv_rect2 == other.uv_rect2 && min_lods == other.min_lods && multiplier == other.multiplier;
+    }
+
+    bool operator!=(const BlendInputs &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// Bakes the blend of two array textures into one mipmapped composite with a framebuffer pass, once its
+// inputs have not changed for stable_frames. Drawing then samples the composite once per fragment instead
+// of both sources. Any change to the inputs, e.g. the multiplier while its key is held, drops the composite
+// and drawing blends live again until the inputs settle. Inputs must only be passed once their images are
+// uploaded, the baker cannot see texture contents change.
+class BlendBaker
+{
+public:
+    int stable_frames;
+
+    // With srgb the sources are sRGB formats, the composite is one too and the bake encodes what it writes.
+    BlendBaker(const std::string &vertex_path, const std::string &fragment_path, int size_value = BLEND_BAKE_SIZE, bool srgb_value = false, int stable_frames_value = BLEND_STABLE_FRAMES) :
+        stable_frames(stable_frames_value), bake_shader(vertex_path, fragment_path), size(size_value), srgb(srgb_value)
+    {
+        levels = mip_level_count(size, size);
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glGenTextures(1, &composite);
+        glBindTexture(GL_TEXTURE_2D, composite);
+        for (int level = 0; level < levels; level++)
+        {
+            int level_size = std::max(1, size >> level);
+            glTexImage2D(GL_TEXTURE_2D, level, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, level_size, level_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+
+        GLint previous_framebuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, composite, 0);
+        complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(previous_framebuffer));
+        if (!complete)
+            std::cout << "ERROR::BLEND_BAKER::FRAMEBUFFER_NOT_COMPLETE\n";
+
+        // Core profiles draw nothing without a vertex array, even an empty one.
+        glGenVertexArrays(1, &empty_VAO);
+        bake_shader.use();
+        bake_shader.set_int("texture1", 0);
+        bake_shader.set_int("texture2", 1);
+    }
+
+    BlendBaker(const BlendBaker &) = delete;
+    BlendBaker &operator=(const BlendBaker &) = delete;
+
+    // Call once per frame before drawing. Returns true when the composite holds these inputs and can be
+    // drawn in place of the live blend. Bakes at most once per call.
+    bool update(const BlendInputs &inputs)
+    {
+        if (!complete)
+            return false;
+        if (inputs != current)
+        {
+            current = inputs;
+            unchanged_frames = 0;
+            baked_valid = false;
+            return false;
+        }
+        if (baked_valid)
+            return true;
+        if (++unchanged_frames < stable_frames)
+            return false;
+        bake(inputs);
+        baked_valid = true;
+        return true;
+    }
+
+    unsigned int texture() const
+    {
+        return composite;
+    }
+
+    // Counts the composite against the budget of residency. residency has to outlive the baker.
+    void track_memory(TextureResidency &residency_value)
+    {
+        residency = &residency_value;
+        residency->reserve(this, texture_texels(size, size, levels) * 4);
+    }
+
+    void report() const
+    {
+        std::cout << "BLEND_BAKER: " << size << "x" << size << " composite, " << bakes << " bakes, "
+                  << (baked_valid ? "baked" : "live") << " at exit\n";
+    }
+
+    ~BlendBaker()
+    {
+        glDeleteVertexArrays(1, &empty_VAO);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &composite);
+        if (residency)
+            residency->reserve(this, 0);
+    }
+
+private:
+    Shader bake_shader;
+    int size;
+    bool srgb;
+    int levels;
+    unsigned int composite = 0;
+    unsigned int framebuffer = 0;
+    unsigned int empty_VAO = 0;
+    bool complete = false;
+    BlendInputs current;
+    int unchanged_frames = 0;
+    bool baked_valid = false;
+    size_t bakes = 0;
+    TextureResidency *residency = nullptr;
+
+    // Draws the blend over the whole composite and builds its mips, leaving the caller's state as it was.
+    void bake(const BlendInputs &inputs)
+    {
+        GLint previous_framebuffer, previous_program, previous_VAO, previous_active_texture, previous_texture_2d;
+        GLint previous_arrays[2];
+        GLint viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_VAO);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &previous_active_texture);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        GLboolean framebuffer_srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+        for (int unit = 0; unit < 2; unit++)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous_arrays[unit]);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, unit == 0 ? inputs.texture1 : inputs.texture2);
+        }
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, size, size);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        if (srgb)
+            glEnable(GL_FRAMEBUFFER_SRGB);
+        else
+            glDisable(GL_FRAMEBUFFER_SRGB);
+        bake_shader.use();
+        bake_shader.set_vec2("layers", inputs.layers);
+        bake_shader.set_vec4("uv_rect1", inputs.uv_rect1);
+        bake_shader.set_vec4("uv_rect2", inputs.uv_rect2);
+        bake_shader.set_vec2("min_lods", inputs.min_lods);
+        bake_shader.set_float("multiplier", inputs.multiplier);
+        glBindVertexArray(empty_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glActiveTexture(GL_TEXTURE0);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture_2d);
+        glBindTexture(GL_TEXTURE_2D, composite);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture_2d));
+        bakes++;
+
+        for (int unit = 0; unit < 2; unit++)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, static_cast<GLuint>(previous_arrays[unit]));
+        }
+        glActiveTexture(static_cast<GLenum>(previous_active_texture));
+        glBindVertexArray(static_cast<GLuint>(previous_VAO));
+        glUseProgram(static_cast<GLuint>(previous_program));
+        if (framebuffer_srgb)
+            glEnable(GL_FRAMEBUFFER_SRGB);
+        else
+            glDisable(GL_FRAMEBUFFER_SRGB);
+        if (blend)
+            glEnable(GL_BLEND);
+        if (depth_test)
+            glEnable(GL_DEPTH_TEST);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(previous_framebuffer));
+    }
+};
+
+#endif
@@ -0,0 +1,367 @@
+#ifndef BLOCK_COMPRESSION_HPP
+#define BLOCK_COMPRESSION_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "thread_pool.hpp"
+
+enum Block_Format {
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC7
+};
+
+inline size_t block_format_size(Block_Format format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+inline size_t compressed_image_size(Block_Format format, int width, int height)
+{
+    return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * block_format_size(format);
+}
+
+// Principal axis of the block colors by power iteration, used to place endpoints.
+inline void block_principal_axis(const float pixels[16][4], int channels, const float mean[4], float axis[4])
+{
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+        }
+    }
+    for (int c = 0; c < 4; c++)
+        axis[c] = c < channels ? 1.0f : 0.0f;
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+        }
+        float length = 0.0f;
+        for (int c = 0; c < channels; c++)
+            length = std::max(length, std::fabs(next[c]));
+        if (length <= 1e-6f)
+            break;
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+}
+
+// Endpoints at the extremes of the block projected on its principal axis, pulled in by 1/16 of the range.
+inline void block_endpoints(const float pixels[16][4], int channels, float low[4], float high[4])
+{
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < channels; c++)
+            mean[c] += pixels[i][c] / 16.0f;
+    }
+    float axis[4];
+    block_principal_axis(pixels, channels, mean, axis);
+
+    float min_t = INFINITY, max_t = -INFINITY;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (pixels[i][c] - mean[c]) * axis[c];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    float inset = (max_t - min_t) / 16.0f;
+    min_t += inset;
+    max_t -= inset;
+    for (int c = 0; c < channels; c++)
+    {
+        low[c] = std::min(std::max(mean[c] + axis[c] * min_t, 0.0f), 255.0f);
+        high[c] = std::min(std::max(mean[c] + axis[c] * max_t, 0.0f), 255.0f);
+    }
+}
+
+inline uint16_t pack_rgb565(const float color[3])
+{
+    int r = static_cast<int>(std::lround(color[0] * 31.0f / 255.0f));
+    int g = static_cast<int>(std::lround(color[1] * 63.0f / 255.0f));
+    int b = static_cast<int>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>((std::min(std::max(r, 0), 31) << 11) | (std::min(std::max(g, 0), 63) << 5) | std::min(std::max(b, 0), 31));
+}
+
+inline void unpack_rgb565(uint16_t packed, float color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = static_cast<float>((r << 3) | (r >> 2));
+    color[1] = static_cast<float>((g << 2) | (g >> 4));
+    color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+// Opaque four-color BC1 block. One least-squares pass refits the endpoints to the chosen indices.
+inline void encode_bc1_block(const unsigned char rgba[16 * 4], unsigned char output[8])
+{
+    float pixels[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+            pixels[i][c] = rgba[i * 4 + c];
+    }
+
+    float low[4], high[4];
+    block_endpoints(pixels, 3, low, high);
+
+    uint16_t color0 = 0, color1 = 0;
+    uint32_t indices = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        color0 = pack_rgb565(high);
+        color1 = pack_rgb565(low);
+        if (color0 < color1)
+            std::swap(color0, color1);
+        if (color0 == color1)
+        {
+            indices = 0;
+            break;
+        }
+
+        float palette[4][3];
+        unpack_rgb565(color0, palette[0]);
+        unpack_rgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        // Weight of color0 for each palette index.
+        const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0, bb = 0, ab = 0, ax[3] = {}, bx[3] = {};
+        indices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            float best_distance = INFINITY;
+            for (int p = 0; p < 4; p++)
+            {
+                float distance = 0.0f;
+                for (int c = 0; c < 3; c++)
+                    distance += (pixels[i][c] - palette[p][c]) * (pixels[i][c] - palette[p][c]);
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+
+            float a = weights[best], b = 1.0f - a;
+            aa += a * a; bb += b * b; ab += a * b;
+            for (int c = 0; c < 3; c++)
+            {
+                ax[c] += a * pixels[i][c];
+                bx[c] += b * pixels[i][c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (pass == 1 || std::fabs(determinant) < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+        {
+            high[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+            low[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+        }
+    }
+
+    output[0] = static_cast<unsigned char>(color0 & 0xff);
+    output[1] = static_cast<unsigned char>(color0 >> 8);
+    output[2] = static_cast<unsigned char>(color1 & 0xff);
+    output[3] = static_cast<unsigned char>(color1 >> 8);
+    for (int i = 0; i < 4; i++)
+        output[4 + i] = static_cast<unsigned char>((indices >> (8 * i)) & 0xff);
+}
+
+// BC3 alpha block: two 8-bit endpoints with six interpolated steps between them.
+inline void encode_bc3_alpha_block(const unsigned char rgba[16 * 4], unsigned char output[8])
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        alpha0 = std::max(alpha0, static_cast<int>(rgba[i * 4 + 3]));
+        alpha1 = std::min(alpha1, static_cast<int>(rgba[i * 4 + 3]));
+    }
+    output[0] = static_cast<unsigned char>(alpha0);
+    output[1] = static_cast<unsigned char>(alpha1);
+
+    int palette[8] = { alpha0, alpha1 };
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int alpha = rgba[i * 4 + 3];
+            int best = 0;
+            for (int p = 1; p < 8; p++)
+            {
+                if (std::abs(alpha - palette[p]) < std::abs(alpha - palette[best]))
+                    best = p;
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        output[2 + i] = static_cast<unsigned char>((indices >> (8 * i)) & 0xff);
+}
+
+inline void encode_bc3_block(const unsigned char rgba[16 * 4], unsigned char output[16])
+{
+    encode_bc3_alpha_block(rgba, output);
+    encode_bc1_block(rgba, output + 8);
+}
+
+// BC7 mode 6: one subset, 7.7.7.7 endpoints with a shared bit each, 4-bit indices.
+inline void encode_bc7_block(const unsigned char rgba[16 * 4], unsigned char output[16])
+{
+    float pixels[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+            pixels[i][c] = rgba[i * 4 + c];
+    }
+
+    float low[4], high[4];
+    block_endpoints(pixels, 4, low, high);
+
+    // Pick the shared bit that keeps each endpoint closest to its unquantized value.
+    int endpoints[2][4];
+    int p_bits[2];
+    const float *targets[2] = { low, high };
+    for (int e = 0; e < 2; e++)
+    {
+        float best_error = INFINITY;
+        for (int p = 0; p < 2; p++)
+        {
+            int quantized[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                int q = static_cast<int>(std::lround((targets[e][c] - p) / 2.0f));
+                quantized[c] = std::min(std::max(q, 0), 127);
+                float value = static_cast<float>((quantized[c] << 1) | p);
+                error += (value - targets[e][c]) * (value - targets[e][c]);
+            }
+            if (error < best_error)
+            {
+                best_error = error;
+                p_bits[e] = p;
+                std::memcpy(endpoints[e], quantized, sizeof(quantized));
+            }
+        }
+    }
+
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    float palette[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            int e0 = (endpoints[0][c] << 1) | p_bits[0];
+            int e1 = (endpoints[1][c] << 1) | p_bits[1];
+            palette[i][c] = static_cast<float>(((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6);
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        float best_distance = INFINITY;
+        for (int p = 0; p < 16; p++)
+        {
+            float distance = 0.0f;
+            for (int c = 0; c < 4; c++)
+                distance += (pixels[i][c] - palette[p][c]) * (pixels[i][c] - palette[p][c]);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = p;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // The anchor index is stored with 3 bits, its top bit must be zero.
+    if (indices[0] >= 8)
+    {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(p_bits[0], p_bits[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    uint64_t bits[2] = { 0, 0 };
+    int position = 0;
+    auto write = [&](uint32_t value, int count) {
+        for (int i = 0; i < count; i++, position++)
+            bits[position >> 6] |= static_cast<uint64_t>((value >> i) & 1u) << (position & 63);
+    };
+    write(1u << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        write(static_cast<uint32_t>(endpoints[0][c]), 7);
+        write(static_cast<uint32_t>(endpoints[1][c]), 7);
+    }
+    write(static_cast<uint32_t>(p_bits[0]), 1);
+    write(static_cast<uint32_t>(p_bits[1]), 1);
+    write(static_cast<uint32_t>(indices[0]), 3);
+    for (int i = 1; i < 16; i++)
+        write(static_cast<uint32_t>(indices[i]), 4);
+
+    for (int i = 0; i < 16; i++)
+        output[i] = static_cast<unsigned char>((bits[i >> 3] >> (8 * (i & 7))) & 0xff);
+}
+
+// Compresses a tightly packed RGBA8 image, one row of blocks per job. Edge blocks repeat the last row and column.
+inline std::vector<unsigned char> compress_image(const unsigned char *rgba, int width, int height, Block_Format format, ThreadPool &pool)
+{
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    size_t block_size = block_format_size(format);
+    std::vector<unsigned char> output(compressed_image_size(format, width, height));
+
+    pool.parallel_for(0, static_cast<size_t>(blocks_y), [&](size_t block_y) {
+        unsigned char block[16 * 4];
+        for (int block_x = 0; block_x < blocks_x; block_x++)
+        {
+            for (int y = 0; y < 4; y++)
+            {
+                int source_y = std::min(static_cast<int>(block_y) * 4 + y, height - 1);
+                for (int x = 0; x < 4; x++)
+                {
+                    int source_x = std::min(block_x * 4 + x, width - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, rgba + (static_cast<size_t>(source_y) * width + source_x) * 4, 4);
+                }
+            }
+
+            unsigned char *target = output.data() + (block_y * blocks_x + block_x) * block_size;
+            if (format == BLOCK_BC1)
+                encode_bc1_block(block, target);
+            else if (format == BLOCK_BC3)
+                encode_bc3_block(block, target);
+            else
+                encode_bc7_block(block, target);
+        }
+    });
+    return output;
+}
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef DECODE_ARENA_HPP
+#define DECODE_ARENA_HPP
+
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <climits>
+
+#include "stb_image.h"
+
+// Scratch allocations above this size go to malloc, which serves them with their own mappings anyway.
+const size_t DECODE_ARENA_MAX_ALLOCATION = 8 * 1024 * 1024;
+const size_t DECODE_ARENA_CHUNK_SIZE = 4 * 1024 * 1024;
+// Capacity a thread keeps between images.
+const size_t DECODE_ARENA_RETAINED = 32 * 1024 * 1024;
+const size_t DECODE_ARENA_ALIGNMENT = 16;
+
+// Per-thread bump allocator for stb_image's scratch buffers. src/stb_image.cpp routes STBI_MALLOC,
+// STBI_REALLOC_SIZED and STBI_FREE through it while a decode on this thread is inside a DecodeArenaScope,
+// so concurrent decoders stop contending on the heap. Freeing is a no-op apart from the last allocation,
+// everything is reclaimed at once when the outermost scope ends. The decoded image itself should outlive the
+// scope, so allocations of the output size a scope announces are served by the heap.
+class DecodeArena
+{
+public:
+    static DecodeArena &current()
+    {
+        thread_local DecodeArena arena;
+        return arena;
+    }
+
+    DecodeArena(const DecodeArena &) = delete;
+    DecodeArena &operator=(const DecodeArena &) = delete;
+
+    bool active() const
+    {
+        return depth > 0;
+    }
+
+    void *allocate(size_t size)
+    {
+        // JPEG output carries a byte of slack past the last row.
+        if (size > DECODE_ARENA_MAX_ALLOCATION || (output_size != 0 && (size == output_size || size == output_size + 1)))
+            return std::malloc(size);
+        size = align(size);
+        if ((chunks.empty() || chunks.back().used + size > chunks.back().size) && !add_chunk(size))
+            return nullptr;
+        Chunk &chunk = chunks.back();
+        last = chunk.data + chunk.used;
+        chunk.used += size;
+        return last;
+    }
+
+    void *reallocate(void *pointer, size_t old_size, size_t new_size)
+    {
+        if (pointer == nullptr)
+            return allocate(new_size);
+        if (!owns(pointer))
+            return std::realloc(pointer, new_size);
+        // The most recent allocation grows in place, zlib output buffers do this a lot.
+        Chunk &chunk = chunks.back();
+        if (pointer == last && new_size <= DECODE_ARENA_MAX_ALLOCATION && static_cast<unsigned char*>(pointer) + align(new_size) <= chunk.data + chunk.size)
+        {
+            chunk.used = static_cast<size_t>(static_cast<unsigned char*>(pointer) - chunk.data) + align(new_size);
+            return pointer;
+        }
+        void *moved = allocate(new_size);
+        if (moved)
+            std::memcpy(moved, pointer, old_size < new_size ? old_size : new_size);
+        return moved;
+    }
+
+    void release(void *pointer)
+    {
+        if (pointer == nullptr)
+            return;
+        if (!owns(pointer))
+        {
+            std::free(pointer);
+            return;
+        }
+        if (pointer == last)
+        {
+            chunks.back().used = static_cast<size_t>(static_cast<unsigned char*>(pointer) - chunks.back().data);
+            last = nullptr;
+        }
+    }
+
+    bool owns(const void *pointer) const
+    {
+        const unsigned char *bytes = static_cast<const unsigned char*>(pointer);
+        for (const Chunk &chunk : chunks)
+            if (bytes >= chunk.data && bytes < chunk.data + chunk.size)
+                return true;
+        return false;
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (const Chunk &chunk : chunks)
+            total += chunk.size;
+        return total;
+    }
+
+    ~DecodeArena()
+    {
+        for (Chunk &chunk : chunks)
+            std::free(chunk.data);
+    }
+
+private:
+    friend class DecodeArenaScope;
+
+    struct Chunk
+    {
+        unsigned char *data;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<Chunk> chunks;
+    void *last = nullptr;
+    int depth = 0;
+    size_t output_size = 0;
+
+    DecodeArena()
+    {
+    }
+
+    static size_t align(size_t size)
+    {
+        return (size + DECODE_ARENA_ALIGNMENT - 1) & ~(DECODE_ARENA_ALIGNMENT - 1);
+    }
+
+    bool add_chunk(size_t size)
+    {
+        size_t chunk_size = size > DECODE_ARENA_CHUNK_SIZE ? size : DECODE_ARENA_CHUNK_SIZE;
+        // malloc aligns to at least 16 bytes on every platform we build for
+        unsigned char *data = static_cast<unsigned char*>(std::malloc(chunk_size));
+        if (data == nullptr)
+            return false;
+        chunks.push_back({ data, chunk_size, 0 });
+        return true;
+    }
+
+    // Merges the chunks of the last image into one, so the next image of that size bumps through a single block.
+    void reset()
+    {
+        last = nullptr;
+        size_t total = capacity();
+        if (chunks.size() == 1 || total == 0)
+        {
+            if (!chunks.empty())
+                chunks[0].used = 0;
+            return;
+        }
+        for (Chunk &chunk : chunks)
+            std::free(chunk.data);
+        chunks.clear();
+        add_chunk(total < DECODE_ARENA_RETAINED ? total : DECODE_ARENA_RETAINED);
+    }
+};
+
+// Routes this thread's stb_image scratch through its arena for the lifetime of the scope.
+// Scopes nest, a pool worker may start another decode while helping out inside parallel_for.
+// output_size is the byte size of the image the decode returns, 0 when unknown.
+class DecodeArenaScope
+{
+public:
+    explicit DecodeArenaScope(size_t output_size = 0) : arena(DecodeArena::current()), previous_output_size(arena.output_size)
+    {
+        arena.depth++;
+        arena.output_size = output_size;
+    }
+
+    DecodeArenaScope(const DecodeArenaScope &) = delete;
+    DecodeArenaScope &operator=(const DecodeArenaScope &) = delete;
+
+    ~DecodeArenaScope()
+    {
+        arena.output_size = previous_output_size;
+        if (--arena.depth == 0)
+            arena.reset();
+    }
+
+private:
+    DecodeArena &arena;
+    size_t previous_output_size;
+};
+
+// Sets stb_image's vertical flip for loads on this thread and puts back what the thread had before, so a
+// pool worker does not carry one job's flip into the next job's decodes.
+class FlipOnLoadScope
+{
+public:
+    explicit FlipOnLoadScope(bool flip_vertically)
+    {
+        was_set = stbi_get_flip_vertically_on_load_thread(&previous) != 0;
+        stbi_set_flip_vertically_on_load_thread(flip_vertically);
+    }
+
+    FlipOnLoadScope(const FlipOnLoadScope &) = delete;
+    FlipOnLoadScope &operator=(const FlipOnLoadScope &) = delete;
+
+    ~FlipOnLoadScope()
+    {
+        if (was_set)
+            stbi_set_flip_vertically_on_load_thread(previous);
+        else
+            stbi_unset_flip_vertically_on_load_thread();
+    }
+
+private:
+    bool was_set = false;
+    int previous = 0;
+};
+
+inline void *decode_arena_malloc(size_t size)
+{
+    DecodeArena &arena = DecodeArena::current();
+    return arena.active() ? arena.allocate(size) : std::malloc(size);
+}
+
+inline void *decode_arena_realloc(void *pointer, size_t old_size, size_t new_size)
+{
+    DecodeArena &arena = DecodeArena::current();
+    return arena.active() || arena.owns(pointer) ? arena.reallocate(pointer, old_size, new_size) : std::realloc(pointer, new_size);
+}
+
+inline void decode_arena_free(void *pointer)
+{
+    DecodeArena::current().release(pointer);
+}
+
+// Byte size of what stbi_load_from_memory_max returns for the image, from its header. 0 when the header
+// cannot be read. Scaled images get the size stbi__fit_max_dimension picks.
+inline size_t decoded_image_size(const unsigned char *buffer, int size, int desired_channels, int max_dimension)
+{
+    int width, height, channels;
+    if (!stbi_info_from_memory(buffer, size, &width, &height, &channels))
+        return 0;
+    if (max_dimension > 0 && (width > max_dimension || height > max_dimension))
+    {
+        int fitted_width = width >= height ? max_dimension : static_cast<int>(static_cast<double>(width) * max_dimension / height + 0.5);
+        int fitted_height = width >= height ? static_cast<int>(static_cast<double>(height) * max_dimension / width + 0.5) : max_dimension;
+        width = fitted_width > 1 ? fitted_width : 1;
+        height = fitted_height > 1 ? fitted_height : 1;
+    }
+    return static_cast<size_t>(width) * height * (desired_channels ? desired_channels : channels);
+}
+
+// stbi_load_from_memory with the scratch on this thread's arena. The pixels come back from the heap and
+// are freed with stbi_image_free. The output allocation skips the arena; only when the header predicts
+// its size wrong, as a reduced-scale JPEG that already fits can, the pixels are copied out.
+// A max_dimension above 0 scales the image down to fit, see stbi_load_from_memory_max.
+inline unsigned char *decode_image_in_arena(const unsigned char *buffer, size_t size, int *width, int *height, int *channels, int desired_channels, int max_dimension = 0)
+{
+    if (size > static_cast<size_t>(INT_MAX))
+        return nullptr;
+    DecodeArenaScope scope(decoded_image_size(buffer, static_cast<int>(size), desired_channels, max_dimension));
+    unsigned char *pixels = stbi_load_from_memory_max(buffer, static_cast<int>(size), width, height, channels, desired_channels, max_dimension);
+    if (pixels == nullptr || !DecodeArena::current().owns(pixels))
+        return pixels;
+    size_t bytes = static_cast<size_t>(*width) * *height * (desired_channels ? desired_channels : *channels);
+    unsigned char *output = static_cast<unsigned char*>(std::malloc(bytes));
+    if (output)
+        std::memcpy(output, pixels, bytes);
+    return output;
+}
+
+// stbi_load_from_memory_into with the scratch on this thread's arena, so decoding into caller memory
+// touches the heap only for images too large for the arena.
+inline bool decode_image_into(const unsigned char *buffer, size_t size, unsigned char *destination, size_t destination_size, size_t pitch, int desired_channels, bool flip_vertically, int *width, int *height, int *channels)
+{
+    if (size > static_cast<size_t>(INT_MAX) || pitch > static_cast<size_t>(INT_MAX))
+        return false;
+    DecodeArenaScope scope;
+    return stbi_load_from_memory_into(buffer, static_cast<int>(size), destination, destination_size, static_cast<int>(pitch), desired_channels, flip_vertically, width, height, channels) != 0;
+}
+
+#endif
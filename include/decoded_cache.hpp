@@ -0,0 +1,293 @@
+#ifndef DECODED_CACHE_HPP
+#define DECODED_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <functional>
+#include <random>
+#include <cstdint>
+#include <cstring>
+
+#include "mapped_file.hpp"
+#include "mip_generator.hpp"
+#include "xxhash64.hpp"
+
+// Decoded, mip filtered and packed pixels as they are uploaded, stored under a key of the source file's
+// contents and everything that shaped the result. Files are a header, one entry per level, then the levels
+// each aligned to 16 bytes with their upload row pitch.
+const char DECODED_CACHE_IDENTIFIER[8] = { 'D', 'E', 'C', 'O', 'D', 'E', 'D', '1' };
+const uint64_t DECODED_CACHE_VERSION = 2;
+const size_t DECODED_CACHE_ALIGNMENT = 16;
+const uint64_t DECODED_CACHE_MAX_BYTES = 512ULL * 1024 * 1024;
+
+struct DecodedCacheHeader
+{
+    char identifier[8];
+    uint64_t key;
+    uint32_t level_count;
+    uint32_t reserved;
+};
+
+struct DecodedCacheLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t pitch;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// What a decode produced besides the source bytes. Every field that changes the stored pixels belongs here,
+// zero what does not apply.
+struct DecodedCacheLayout
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t channels = 0;
+    uint32_t internal_format = 0;
+    uint32_t type = 0;
+    uint32_t level_count = 0;
+    uint32_t srgb = 0;
+    uint32_t flip_vertically = 0;
+    // Border around the image inside level 0, e.g. atlas padding.
+    uint32_t padding = 0;
+    uint32_t padded_width = 0;
+    uint32_t padded_height = 0;
+    // Bytes of one texel in the stored levels, after packing.
+    uint32_t bytes_per_texel = 0;
+
+    uint32_t level_width(size_t level) const
+    {
+        return std::max(1u, (padding ? padded_width : width) >> level);
+    }
+
+    uint32_t level_height(size_t level) const
+    {
+        return std::max(1u, (padding ? padded_height : height) >> level);
+    }
+};
+
+// A cache file mapped for reading, its levels point into the mapping.
+class DecodedCacheEntry
+{
+public:
+    std::vector<DecodedCacheLevel> levels;
+
+    // Every level has to have the size layout gives it, a file that does not is not trusted.
+    bool open(const std::string &path, uint64_t key, const DecodedCacheLayout &layout)
+    {
+        if (!file.open(path) || file.size() < sizeof(DecodedCacheHeader))
+            return false;
+        DecodedCacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.identifier, DECODED_CACHE_IDENTIFIER, sizeof(DECODED_CACHE_IDENTIFIER)) != 0 || header.key != key)
+            return false;
+        if (header.level_count != layout.level_count || sizeof(header) + sizeof(DecodedCacheLevel) * static_cast<size_t>(header.level_count) > file.size())
+            return false;
+        levels.resize(header.level_count);
+        std::memcpy(levels.data(), file.data() + sizeof(header), sizeof(DecodedCacheLevel) * levels.size());
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            const DecodedCacheLevel &level = levels[i];
+            if (level.width != layout.level_width(i) || level.height != layout.level_height(i) ||
+                level.pitch < static_cast<uint64_t>(level.width) * layout.bytes_per_texel)
+                return false;
+            if (level.offset > file.size() || level.size > file.size() - level.offset || level.pitch * level.height > level.size)
+                return false;
+        }
+        return true;
+    }
+
+    const unsigned char *level_data(size_t level) const
+    {
+        return file.data() + levels[level].offset;
+    }
+
+    // Starts reading in the levels from first on, the ones an upload is about to touch.
+    void prefetch(size_t first) const
+    {
+        if (first < levels.size())
+            file.advise(ACCESS_WILL_NEED, static_cast<size_t>(levels[first].offset), static_cast<size_t>(levels.back().offset + levels.back().size - levels[first].offset));
+    }
+
+private:
+    MappedFile file;
+};
+
+// Directory of decoded images that later runs map instead of decoding. Files are written to a temporary
+// name and renamed into place, and loads refresh their file time, so trimming removes the least recently
+// used files once the directory outgrows max_bytes. Loads and stores may run on several threads at once.
+class DecodedTextureCache
+{
+public:
+    std::atomic<size_t> hits{ 0 };
+    std::atomic<size_t> misses{ 0 };
+
+    bool open(const std::string &directory_value, uint64_t max_bytes_value = DECODED_CACHE_MAX_BYTES)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory_value, error);
+        if (error)
+        {
+            std::cout << "ERROR::DECODED_CACHE::DIRECTORY_NOT_CREATED " << directory_value << "\n";
+            return false;
+        }
+        directory = directory_value;
+        max_bytes = max_bytes_value;
+        return true;
+    }
+
+    bool enabled() const
+    {
+        return !directory.empty();
+    }
+
+    // Hashing runs at memory speed, a fraction of the decode it saves.
+    static uint64_t make_key(const unsigned char *source, size_t size, const DecodedCacheLayout &layout)
+    {
+        uint64_t source_hash = xxhash64(source, size, DECODED_CACHE_VERSION);
+        return xxhash64(&layout, sizeof(layout), source_hash);
+    }
+
+    std::shared_ptr<DecodedCacheEntry> load(uint64_t key, const DecodedCacheLayout &layout)
+    {
+        if (!enabled())
+            return nullptr;
+        std::string path = entry_path(key);
+        auto entry = std::make_shared<DecodedCacheEntry>();
+        if (!entry->open(path, key, layout))
+        {
+            misses++;
+            return nullptr;
+        }
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        hits++;
+        return entry;
+    }
+
+    void store(uint64_t key, const std::vector<MipLevel> &levels)
+    {
+        if (!enabled() || levels.empty())
+            return;
+        DecodedCacheHeader header;
+        std::memcpy(header.identifier, DECODED_CACHE_IDENTIFIER, sizeof(DECODED_CACHE_IDENTIFIER));
+        header.key = key;
+        header.level_count = static_cast<uint32_t>(levels.size());
+        header.reserved = 0;
+
+        std::vector<DecodedCacheLevel> entries(levels.size());
+        uint64_t offset = sizeof(header) + sizeof(DecodedCacheLevel) * entries.size();
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            offset = (offset + DECODED_CACHE_ALIGNMENT - 1) & ~static_cast<uint64_t>(DECODED_CACHE_ALIGNMENT - 1);
+            entries[i].width = static_cast<uint32_t>(levels[i].width);
+            entries[i].height = static_cast<uint32_t>(levels[i].height);
+            entries[i].pitch = levels[i].pitch;
+            entries[i].offset = offset;
+            entries[i].size = levels[i].data.size();
+            offset += entries[i].size;
+        }
+
+        // Other processes may share the directory, the thread id alone repeats across them.
+        std::string path = entry_path(key);
+        std::random_device random;
+        std::ostringstream temporary;
+        temporary << path << "." << std::hex << random() << random() << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+        {
+            std::ofstream file(temporary.str(), std::ios::binary | std::ios::trunc);
+            if (!file)
+                return;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(sizeof(DecodedCacheLevel) * entries.size()));
+            uint64_t position = sizeof(header) + sizeof(DecodedCacheLevel) * entries.size();
+            const char padding[DECODED_CACHE_ALIGNMENT] = {};
+            for (size_t i = 0; i < levels.size(); i++)
+            {
+                file.write(padding, static_cast<std::streamsize>(entries[i].offset - position));
+                file.write(reinterpret_cast<const char*>(levels[i].data.data()), static_cast<std::streamsize>(levels[i].data.size()));
+                position = entries[i].offset + entries[i].size;
+            }
+            if (!file)
+            {
+                file.close();
+                std::error_code error;
+                std::filesystem::remove(temporary.str(), error);
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary.str(), path, error);
+        if (error)
+            std::filesystem::remove(temporary.str(), error);
+        trim();
+    }
+
+    // Removes the least recently used files until the directory fits max_bytes.
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock(trim_mutex);
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+        uint64_t total = 0;
+        std::error_code error;
+        for (const auto &item : std::filesystem::directory_iterator(directory, error))
+        {
+            if (item.path().extension() != ".decoded")
+                continue;
+            std::error_code item_error;
+            uint64_t size = item.file_size(item_error);
+            if (item_error)
+                continue;
+            total += size;
+            files.push_back({ item.last_write_time(item_error), item.path() });
+        }
+        if (total <= max_bytes)
+            return;
+        std::sort(files.begin(), files.end());
+        for (const auto &file : files)
+        {
+            if (total <= max_bytes)
+                break;
+            std::error_code item_error;
+            uint64_t size = std::filesystem::file_size(file.second, item_error);
+            // Mapped entries stay readable after the unlink on POSIX, Windows refuses and the file is skipped.
+            if (!item_error && std::filesystem::remove(file.second, item_error))
+            {
+                total -= size;
+                evictions++;
+            }
+        }
+    }
+
+    void report() const
+    {
+        if (!enabled())
+            return;
+        std::cout << "DECODED_CACHE: " << directory << ", " << hits << " hits, " << misses << " misses, " << evictions << " evictions\n";
+    }
+
+private:
+    std::string directory;
+    uint64_t max_bytes = DECODED_CACHE_MAX_BYTES;
+    std::mutex trim_mutex;
+    std::atomic<size_t> evictions{ 0 };
+
+    std::string entry_path(uint64_t key) const
+    {
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << key << ".decoded";
+        return (std::filesystem::path(directory) / name.str()).string();
+    }
+};
+
+#endif
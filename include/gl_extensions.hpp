@@ -0,0 +1,85 @@
+#ifndef GL_EXTENSIONS_HPP
+#define GL_EXTENSIONS_HPP
+
+#include <glad/glad.h>
+
+#include <string>
+#include <set>
+
+// Tokens from extensions the 3.3 core loader does not define.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+#ifndef GL_RGB565
+#define GL_RGB565 0x8D62
+#endif
+#ifndef GL_SR8_EXT
+#define GL_SR8_EXT 0x8FBD
+#endif
+#ifndef GL_SRG8_EXT
+#define GL_SRG8_EXT 0x8FBE
+#endif
+
+// Needs a current context, the extension list is read once.
+inline bool has_gl_extension(const std::string &name)
+{
+    static std::set<std::string> extensions;
+    static bool loaded = false;
+    if (!loaded)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLubyte *extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+            if (extension)
+                extensions.insert(reinterpret_cast<const char*>(extension));
+        }
+        loaded = true;
+    }
+    return extensions.count(name) != 0;
+}
+
+inline bool has_gl_version(int major, int minor)
+{
+    GLint context_major = 0, context_minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &context_major);
+    glGetIntegerv(GL_MINOR_VERSION, &context_minor);
+    return context_major > major || (context_major == major && context_minor >= minor);
+}
+
+inline bool is_compressed_format_supported(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return has_gl_extension("GL_EXT_texture_compression_s3tc");
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return has_gl_extension("GL_EXT_texture_compression_s3tc") &&
+               (has_gl_extension("GL_EXT_texture_sRGB") || has_gl_extension("GL_EXT_texture_compression_s3tc_srgb"));
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        return has_gl_version(4, 2) || has_gl_extension("GL_ARB_texture_compression_bptc");
+    default:
+        return false;
+    }
+}
+
+#endif
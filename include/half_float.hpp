@@ -0,0 +1,40 @@
+#ifndef HALF_FLOAT_HPP
+#define HALF_FLOAT_HPP
+
+#include <cstdint>
+#include <cstring>
+
+// Rounds to the nearest half, ties to even. Values beyond the half range clamp to its largest finite value,
+// NaN stays NaN.
+inline uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+    if (magnitude > 0x7F800000u)
+        return static_cast<uint16_t>(sign | 0x7E00u);
+    if (magnitude >= 0x477FF000u)
+        return static_cast<uint16_t>(sign | 0x7BFFu);
+    if (magnitude < 0x38800000u)
+    {
+        // Subnormal halfs, shifted out with round to nearest even.
+        if (magnitude < 0x33000000u)
+            return static_cast<uint16_t>(sign);
+        uint32_t mantissa = (magnitude & 0x007FFFFFu) | 0x00800000u;
+        int shift = 126 - static_cast<int>(magnitude >> 23);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u)))
+            half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = ((magnitude - 0x38000000u) >> 13);
+    uint32_t remainder = magnitude & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+        half++;
+    return static_cast<uint16_t>(sign | half);
+}
+
+#endif
@@ -0,0 +1,367 @@
+#ifndef IBL_BAKE_HPP
+#define IBL_BAKE_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "thread_pool.hpp"
+#include "ibl_environment.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IBL_BAKE_SSE2
+#include <emmintrin.h>
+#endif
+
+const int IBL_SPECULAR_MIPS = 6;
+const int IBL_SAMPLE_COUNT = 256;
+const float IBL_PI = 3.14159265358979f;
+
+// One level of a float cubemap, the six faces one after another in GL order, RGBA per texel.
+struct CubemapLevel
+{
+    int size = 0;
+    std::vector<float> data;
+
+    CubemapLevel() = default;
+
+    explicit CubemapLevel(int size_value) : size(size_value), data(static_cast<size_t>(size_value) * size_value * 6 * 4, 0.0f)
+    {
+    }
+
+    float *texel(int face, int x, int y)
+    {
+        return data.data() + ((static_cast<size_t>(face) * size + y) * size + x) * 4;
+    }
+
+    const float *texel(int face, int x, int y) const
+    {
+        return data.data() + ((static_cast<size_t>(face) * size + y) * size + x) * 4;
+    }
+};
+
+// Direction through a face at s, t in [-1, 1], with rows going down the face as GL lays out cubemap data.
+inline glm::vec3 cubemap_direction(int face, float s, float t)
+{
+    switch (face)
+    {
+    case 0: return glm::vec3(1.0f, -t, -s);
+    case 1: return glm::vec3(-1.0f, -t, s);
+    case 2: return glm::vec3(s, 1.0f, t);
+    case 3: return glm::vec3(s, -1.0f, -t);
+    case 4: return glm::vec3(s, -t, 1.0f);
+    default: return glm::vec3(-s, -t, -1.0f);
+    }
+}
+
+// Face a direction hits and where, u and v in [0, 1]. The inverse of cubemap_direction.
+inline void cubemap_face_coords(const glm::vec3 &direction, int &face, float &u, float &v)
+{
+    float ax = std::fabs(direction.x), ay = std::fabs(direction.y), az = std::fabs(direction.z);
+    float s, t, major;
+    if (ax >= ay && ax >= az)
+    {
+        face = direction.x > 0.0f ? 0 : 1;
+        major = ax;
+        s = direction.x > 0.0f ? -direction.z : direction.z;
+        t = -direction.y;
+    }
+    else if (ay >= az)
+    {
+        face = direction.y > 0.0f ? 2 : 3;
+        major = ay;
+        s = direction.x;
+        t = direction.y > 0.0f ? direction.z : -direction.z;
+    }
+    else
+    {
+        face = direction.z > 0.0f ? 4 : 5;
+        major = az;
+        s = direction.z > 0.0f ? direction.x : -direction.x;
+        t = -direction.y;
+    }
+    u = 0.5f * (s / major + 1.0f);
+    v = 0.5f * (t / major + 1.0f);
+}
+
+// Adds weight times the bilinear sample of a face at u, v to sum, clamped at the face edges.
+inline void cubemap_bilinear_add(const CubemapLevel &level, int face, float u, float v, float weight, float *sum)
+{
+    float x = std::min(std::max(u * level.size - 0.5f, 0.0f), static_cast<float>(level.size - 1));
+    float y = std::min(std::max(v * level.size - 0.5f, 0.0f), static_cast<float>(level.size - 1));
+    int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+    int x1 = std::min(x0 + 1, level.size - 1), y1 = std::min(y0 + 1, level.size - 1);
+    float fx = x - x0, fy = y - y0;
+    const float *t00 = level.texel(face, x0, y0);
+    const float *t10 = level.texel(face, x1, y0);
+    const float *t01 = level.texel(face, x0, y1);
+    const float *t11 = level.texel(face, x1, y1);
+#ifdef IBL_BAKE_SSE2
+    __m128 a = _mm_loadu_ps(t00), b = _mm_loadu_ps(t10), c = _mm_loadu_ps(t01), d = _mm_loadu_ps(t11);
+    __m128 step_x = _mm_set1_ps(fx);
+    __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), step_x));
+    __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), step_x));
+    __m128 value = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(fy)));
+    _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), _mm_mul_ps(value, _mm_set1_ps(weight))));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        float top = t00[i] + (t10[i] - t00[i]) * fx;
+        float bottom = t01[i] + (t11[i] - t01[i]) * fx;
+        sum[i] += (top + (bottom - top) * fy) * weight;
+    }
+#endif
+}
+
+// Adds weight times the trilinear sample of a mip chain in a direction to sum.
+inline void cubemap_sample_add(const std::vector<CubemapLevel> &chain, const glm::vec3 &direction, float lod, float weight, float *sum)
+{
+    int face;
+    float u, v;
+    cubemap_face_coords(direction, face, u, v);
+    lod = std::min(std::max(lod, 0.0f), static_cast<float>(chain.size() - 1));
+    int level = static_cast<int>(lod);
+    float blend = lod - level;
+    cubemap_bilinear_add(chain[level], face, u, v, weight * (1.0f - blend), sum);
+    if (blend > 0.0f)
+        cubemap_bilinear_add(chain[level + 1], face, u, v, weight * blend, sum);
+}
+
+// Resamples an equirectangular RGB float image, as stbi_loadf returns it unflipped, onto a cubemap.
+// The image's top row looks along +y and its centre column along -z. Each texel averages 2x2 samples.
+inline CubemapLevel equirect_to_cubemap(const float *pixels, int width, int height, int size, ThreadPool &pool)
+{
+    CubemapLevel cubemap(size);
+    auto fetch = [&](int x, int y, int channel) {
+        x = ((x % width) + width) % width;
+        y = std::min(std::max(y, 0), height - 1);
+        return pixels[(static_cast<size_t>(y) * width + x) * 3 + channel];
+    };
+    pool.parallel_for(0, static_cast<size_t>(6 * size), [&](size_t row) {
+        int face = static_cast<int>(row) / size;
+        int y = static_cast<int>(row) % size;
+        for (int x = 0; x < size; x++)
+        {
+            float color[3] = { 0.0f, 0.0f, 0.0f };
+            for (int sample = 0; sample < 4; sample++)
+            {
+                float s = 2.0f * (x + 0.25f + 0.5f * (sample & 1)) / size - 1.0f;
+                float t = 2.0f * (y + 0.25f + 0.5f * (sample >> 1)) / size - 1.0f;
+                glm::vec3 direction = glm::normalize(cubemap_direction(face, s, t));
+                float u = 0.5f + std::atan2(direction.x, -direction.z) / (2.0f * IBL_PI);
+                float v = std::acos(std::min(std::max(direction.y, -1.0f), 1.0f)) / IBL_PI;
+                float image_x = u * width - 0.5f, image_y = v * height - 0.5f;
+                int x0 = static_cast<int>(std::floor(image_x)), y0 = static_cast<int>(std::floor(image_y));
+                float fx = image_x - x0, fy = image_y - y0;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    float top = fetch(x0, y0, channel) + (fetch(x0 + 1, y0, channel) - fetch(x0, y0, channel)) * fx;
+                    float bottom = fetch(x0, y0 + 1, channel) + (fetch(x0 + 1, y0 + 1, channel) - fetch(x0, y0 + 1, channel)) * fx;
+                    color[channel] += 0.25f * (top + (bottom - top) * fy);
+                }
+            }
+            float *texel = cubemap.texel(face, x, y);
+            texel[0] = color[0];
+            texel[1] = color[1];
+            texel[2] = color[2];
+            texel[3] = 1.0f;
+        }
+    }, 4);
+    return cubemap;
+}
+
+// Box filtered chain down to 1x1 faces, the source the prefilter samples at coarser levels for wide lobes.
+inline std::vector<CubemapLevel> build_cubemap_chain(const CubemapLevel &base, ThreadPool &pool)
+{
+    std::vector<CubemapLevel> chain;
+    chain.push_back(base);
+    while (chain.back().size > 1)
+    {
+        const CubemapLevel &source = chain.back();
+        CubemapLevel level(source.size / 2);
+        pool.parallel_for(0, static_cast<size_t>(6 * level.size), [&](size_t row) {
+            int face = static_cast<int>(row) / level.size;
+            int y = static_cast<int>(row) % level.size;
+            for (int x = 0; x < level.size; x++)
+            {
+                float *texel = level.texel(face, x, y);
+                for (int i = 0; i < 4; i++)
+                {
+                    texel[i] = 0.25f * (source.texel(face, 2 * x, 2 * y)[i] + source.texel(face, 2 * x + 1, 2 * y)[i] +
+                                        source.texel(face, 2 * x, 2 * y + 1)[i] + source.texel(face, 2 * x + 1, 2 * y + 1)[i]);
+                }
+            }
+        }, 4);
+        chain.push_back(std::move(level));
+    }
+    return chain;
+}
+
+// Specular chain for the split sum approximation, normal = view = reflection direction. Level 0 is the
+// environment itself, level i is filtered with the GGX lobe of roughness i / (mip_count - 1) from
+// sample_count importance samples. Each sample reads the source chain at the level whose texels match
+// its solid angle, which keeps low sample counts free of fireflies. The faces must be a power of two.
+inline std::vector<CubemapLevel> prefilter_ggx(const std::vector<CubemapLevel> &chain, int mip_count, int sample_count, ThreadPool &pool)
+{
+    std::vector<CubemapLevel> levels;
+    levels.push_back(chain[0]);
+    const int size = chain[0].size;
+    const float texel_solid_angle = 4.0f * IBL_PI / (6.0f * size * size);
+
+    for (int mip = 1; mip < mip_count; mip++)
+    {
+        float roughness = static_cast<float>(mip) / (mip_count - 1);
+        float alpha = roughness * roughness;
+        float alpha2 = alpha * alpha;
+
+        // Tangent space light directions and source levels, the same for every texel. Kept as structure of
+        // arrays padded to 4 with zero weights, so the rotation into each texel's frame runs 4 samples at once.
+        std::vector<float> sample_x, sample_y, sample_z, sample_weight, sample_lod;
+        for (int i = 0; i < sample_count; i++)
+        {
+            uint32_t bits = static_cast<uint32_t>(i);
+            bits = (bits << 16u) | (bits >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            float xi1 = static_cast<float>(i) / sample_count;
+            float xi2 = static_cast<float>(bits) * 2.3283064365386963e-10f;
+
+            float phi = 2.0f * IBL_PI * xi1;
+            float cos_theta = std::sqrt((1.0f - xi2) / (1.0f + (alpha2 - 1.0f) * xi2));
+            float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+            glm::vec3 half(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+            glm::vec3 light = 2.0f * cos_theta * half - glm::vec3(0.0f, 0.0f, 1.0f);
+            if (light.z <= 0.0f)
+                continue;
+            float denominator = (alpha2 - 1.0f) * cos_theta * cos_theta + 1.0f;
+            float distribution = alpha2 / (IBL_PI * denominator * denominator);
+            float sample_solid_angle = 1.0f / (sample_count * distribution * 0.25f + 1e-6f);
+            sample_x.push_back(light.x);
+            sample_y.push_back(light.y);
+            sample_z.push_back(light.z);
+            sample_weight.push_back(light.z);
+            sample_lod.push_back(0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.0f);
+        }
+        while (sample_x.size() % 4 != 0)
+        {
+            sample_x.push_back(0.0f);
+            sample_y.push_back(0.0f);
+            sample_z.push_back(1.0f);
+            sample_weight.push_back(0.0f);
+            sample_lod.push_back(0.0f);
+        }
+        const size_t samples = sample_x.size();
+
+        CubemapLevel level(std::max(1, size >> mip));
+        pool.parallel_for(0, static_cast<size_t>(6 * level.size), [&](size_t row) {
+            int face = static_cast<int>(row) / level.size;
+            int y = static_cast<int>(row) % level.size;
+            float world_x[4], world_y[4], world_z[4];
+            for (int x = 0; x < level.size; x++)
+            {
+                glm::vec3 normal = glm::normalize(cubemap_direction(face, 2.0f * (x + 0.5f) / level.size - 1.0f, 2.0f * (y + 0.5f) / level.size - 1.0f));
+                glm::vec3 up = std::fabs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+                glm::vec3 bitangent = glm::cross(normal, tangent);
+
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                float total_weight = 0.0f;
+                for (size_t i = 0; i < samples; i += 4)
+                {
+#ifdef IBL_BAKE_SSE2
+                    __m128 lx = _mm_loadu_ps(&sample_x[i]), ly = _mm_loadu_ps(&sample_y[i]), lz = _mm_loadu_ps(&sample_z[i]);
+                    _mm_storeu_ps(world_x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.x), lx), _mm_mul_ps(_mm_set1_ps(bitangent.x), ly)), _mm_mul_ps(_mm_set1_ps(normal.x), lz)));
+                    _mm_storeu_ps(world_y, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.y), lx), _mm_mul_ps(_mm_set1_ps(bitangent.y), ly)), _mm_mul_ps(_mm_set1_ps(normal.y), lz)));
+                    _mm_storeu_ps(world_z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.z), lx), _mm_mul_ps(_mm_set1_ps(bitangent.z), ly)), _mm_mul_ps(_mm_set1_ps(normal.z), lz)));
+#else
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        world_x[lane] = tangent.x * sample_x[i + lane] + bitangent.x * sample_y[i + lane] + normal.x * sample_z[i + lane];
+                        world_y[lane] = tangent.y * sample_x[i + lane] + bitangent.y * sample_y[i + lane] + normal.y * sample_z[i + lane];
+                        world_z[lane] = tangent.z * sample_x[i + lane] + bitangent.z * sample_y[i + lane] + normal.z * sample_z[i + lane];
+                    }
+#endif
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        float weight = sample_weight[i + lane];
+                        if (weight <= 0.0f)
+                            continue;
+                        cubemap_sample_add(chain, glm::vec3(world_x[lane], world_y[lane], world_z[lane]), sample_lod[i + lane], weight, sum);
+                        total_weight += weight;
+                    }
+                }
+                float *texel = level.texel(face, x, y);
+                for (int i = 0; i < 3; i++)
+                    texel[i] = total_weight > 0.0f ? sum[i] / total_weight : 0.0f;
+                texel[3] = 1.0f;
+            }
+        });
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+// Projects the environment onto the nine real spherical harmonics of bands 0 to 2, weighting texels by
+// their solid angle, and convolves the result with the clamped cosine lobe. Evaluating the basis with the
+// returned coefficients gives the irradiance E(n). Rows are summed in doubles and reduced in order, so the
+// result does not depend on the thread count.
+inline void irradiance_sh9(const CubemapLevel &cubemap, ThreadPool &pool, glm::vec3 (&coefficients)[IBL_SH_COEFFICIENTS])
+{
+    const int size = cubemap.size;
+    const size_t rows = static_cast<size_t>(6 * size);
+    std::vector<double> row_sums(rows * (IBL_SH_COEFFICIENTS * 3 + 1), 0.0);
+    pool.parallel_for(0, rows, [&](size_t row) {
+        int face = static_cast<int>(row) / size;
+        int y = static_cast<int>(row) % size;
+        double *sums = &row_sums[row * (IBL_SH_COEFFICIENTS * 3 + 1)];
+        float t = 2.0f * (y + 0.5f) / size - 1.0f;
+        for (int x = 0; x < size; x++)
+        {
+            float s = 2.0f * (x + 0.5f) / size - 1.0f;
+            float distance2 = 1.0f + s * s + t * t;
+            float solid_angle = 4.0f / (size * size * distance2 * std::sqrt(distance2));
+            glm::vec3 n = glm::normalize(cubemap_direction(face, s, t));
+            float basis[IBL_SH_COEFFICIENTS] =
+            {
+                0.282095f,
+                0.488603f * n.y,
+                0.488603f * n.z,
+                0.488603f * n.x,
+                1.092548f * n.x * n.y,
+                1.092548f * n.y * n.z,
+                0.315392f * (3.0f * n.z * n.z - 1.0f),
+                1.092548f * n.x * n.z,
+                0.546274f * (n.x * n.x - n.y * n.y)
+            };
+            const float *texel = cubemap.texel(face, x, y);
+            for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+            {
+                for (int channel = 0; channel < 3; channel++)
+                    sums[i * 3 + channel] += static_cast<double>(texel[channel]) * basis[i] * solid_angle;
+            }
+            sums[IBL_SH_COEFFICIENTS * 3] += solid_angle;
+        }
+    }, 4);
+
+    double totals[IBL_SH_COEFFICIENTS * 3 + 1] = {};
+    for (size_t row = 0; row < rows; row++)
+    {
+        for (int i = 0; i < IBL_SH_COEFFICIENTS * 3 + 1; i++)
+            totals[i] += row_sums[row * (IBL_SH_COEFFICIENTS * 3 + 1) + i];
+    }
+    // The texel solid angles add up to slightly more or less than the sphere, normalize to 4 pi.
+    const double normalization = 4.0 * IBL_PI / totals[IBL_SH_COEFFICIENTS * 3];
+    const float band_scale[3] = { IBL_PI, 2.0f * IBL_PI / 3.0f, IBL_PI / 4.0f };
+    for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+    {
+        float scale = band_scale[i == 0 ? 0 : (i < 4 ? 1 : 2)] * static_cast<float>(normalization);
+        coefficients[i] = glm::vec3(static_cast<float>(totals[i * 3]), static_cast<float>(totals[i * 3 + 1]), static_cast<float>(totals[i * 3 + 2])) * scale;
+    }
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef IBL_ENVIRONMENT_HPP
+#define IBL_ENVIRONMENT_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "mapped_file.hpp"
+#include "shader.hpp"
+#include "half_float.hpp"
+
+// Baked image based lighting, see tools/ibl_bake.cpp: header, then the GGX prefiltered specular cubemap as
+// RGBA16F, level by level with the six faces in GL order, rows top to bottom as glTexImage2D takes them.
+// Level i was filtered for roughness i / (mip_count - 1). The header carries the irradiance as nine
+// spherical harmonic coefficients, already convolved with the cosine lobe.
+const char IBL_ENVIRONMENT_IDENTIFIER[8] = { 'I', 'B', 'L', 'E', 'N', 'V', '0', '1' };
+const int IBL_SH_COEFFICIENTS = 9;
+
+struct IblEnvironmentHeader
+{
+    char identifier[8];
+    // Key of the source image and bake settings, the baker skips sources whose output is up to date.
+    uint64_t source_key;
+    uint32_t face_size;
+    uint32_t mip_count;
+    uint32_t sample_count;
+    uint32_t reserved;
+    // RGB, the fourth float pads each coefficient to 16 bytes.
+    float irradiance_sh[IBL_SH_COEFFICIENTS][4];
+};
+
+inline size_t ibl_face_bytes(int face_size, int level)
+{
+    size_t size = static_cast<size_t>(std::max(1, face_size >> level));
+    return size * size * 4 * sizeof(uint16_t);
+}
+
+// Writes a baked environment. Levels hold the six faces of each level one after another as RGBA floats.
+inline bool write_ibl_environment(const std::string &path, uint64_t source_key, int face_size, int sample_count,
+                                  const std::vector<std::vector<float>> &levels, const glm::vec3 (&irradiance_sh)[IBL_SH_COEFFICIENTS])
+{
+    IblEnvironmentHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.identifier, IBL_ENVIRONMENT_IDENTIFIER, sizeof(IBL_ENVIRONMENT_IDENTIFIER));
+    header.source_key = source_key;
+    header.face_size = static_cast<uint32_t>(face_size);
+    header.mip_count = static_cast<uint32_t>(levels.size());
+    header.sample_count = static_cast<uint32_t>(sample_count);
+    for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+    {
+        header.irradiance_sh[i][0] = irradiance_sh[i].x;
+        header.irradiance_sh[i][1] = irradiance_sh[i].y;
+        header.irradiance_sh[i][2] = irradiance_sh[i].z;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::IBL_ENVIRONMENT::FILE_NOT_SUCCESFULLY_WRITTEN " << path << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::vector<uint16_t> halfs;
+    for (const std::vector<float> &level : levels)
+    {
+        halfs.resize(level.size());
+        for (size_t i = 0; i < level.size(); i++)
+            halfs[i] = float_to_half(level[i]);
+        file.write(reinterpret_cast<const char*>(halfs.data()), static_cast<std::streamsize>(halfs.size() * sizeof(uint16_t)));
+    }
+    return static_cast<bool>(file);
+}
+
+// Reads the header of a baked environment, false when the file is missing or not one.
+inline bool read_ibl_environment_header(const std::string &path, IblEnvironmentHeader &header)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    return std::memcmp(header.identifier, IBL_ENVIRONMENT_IDENTIFIER, sizeof(IBL_ENVIRONMENT_IDENTIFIER)) == 0;
+}
+
+// Runtime side of image based lighting. Loading only maps the baked file and uploads it, all filtering
+// happened offline. Shaders take the specular color from textureLod(ibl_specular, R, roughness * ibl_specular_lod)
+// and the diffuse irradiance E(n) from the nine coefficients with the real SH basis, albedo / pi * E(n).
+class IblEnvironment
+{
+public:
+    IblEnvironmentHeader header;
+
+    IblEnvironment()
+    {
+        std::memset(&header, 0, sizeof(header));
+    }
+
+    IblEnvironment(const IblEnvironment &) = delete;
+    IblEnvironment &operator=(const IblEnvironment &) = delete;
+
+    bool load(const std::string &path)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(header))
+        {
+            std::cout << "ERROR::IBL_ENVIRONMENT::INVALID_FILE " << path << "\n";
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        size_t expected = sizeof(header);
+        bool valid = std::memcmp(header.identifier, IBL_ENVIRONMENT_IDENTIFIER, sizeof(IBL_ENVIRONMENT_IDENTIFIER)) == 0 &&
+                     header.face_size > 0 && header.face_size <= 16384 && header.mip_count > 0 && header.mip_count <= 16;
+        for (uint32_t level = 0; valid && level < header.mip_count; level++)
+            expected += 6 * ibl_face_bytes(static_cast<int>(header.face_size), static_cast<int>(level));
+        if (!valid || file.size() < expected)
+        {
+            std::cout << "ERROR::IBL_ENVIRONMENT::INVALID_FILE " << path << "\n";
+            return false;
+        }
+        file.advise(ACCESS_SEQUENTIAL);
+
+        GLint previous_texture, previous_unpack_buffer;
+        glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &previous_texture);
+        glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &previous_unpack_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!texture)
+            glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        const unsigned char *data = file.data() + sizeof(header);
+        for (uint32_t level = 0; level < header.mip_count; level++)
+        {
+            int size = std::max(1, static_cast<int>(header.face_size) >> level);
+            for (int face = 0; face < 6; face++)
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, static_cast<GLint>(level), GL_RGBA16F, size, size, 0, GL_RGBA, GL_HALF_FLOAT, data);
+                data += ibl_face_bytes(static_cast<int>(header.face_size), static_cast<int>(level));
+            }
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(header.mip_count - 1));
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, static_cast<GLuint>(previous_texture));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, static_cast<GLuint>(previous_unpack_buffer));
+        // Filtering across face edges, the rougher levels would show seams without it.
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        return true;
+    }
+
+    bool loaded() const
+    {
+        return texture != 0;
+    }
+
+    // Binds the specular cubemap to the unit and sets ibl_specular, ibl_specular_lod and ibl_irradiance_sh.
+    void bind(Shader &shader, int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.set_int("ibl_specular", unit);
+        shader.set_float("ibl_specular_lod", static_cast<float>(header.mip_count - 1));
+        for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+            shader.set_vec3("ibl_irradiance_sh[" + std::to_string(i) + "]", header.irradiance_sh[i][0], header.irradiance_sh[i][1], header.irradiance_sh[i][2]);
+    }
+
+    void report() const
+    {
+        if (!texture)
+            return;
+        size_t bytes = 0;
+        for (uint32_t level = 0; level < header.mip_count; level++)
+            bytes += 6 * ibl_face_bytes(static_cast<int>(header.face_size), static_cast<int>(level));
+        std::cout << "IBL_ENVIRONMENT: " << header.face_size << "^2 x 6 faces, " << header.mip_count << " specular mips, "
+                  << bytes / (1024 * 1024.0) << " MB\n";
+    }
+
+    ~IblEnvironment()
+    {
+        if (texture)
+            glDeleteTextures(1, &texture);
+    }
+
+private:
+    unsigned int texture = 0;
+};
+
+#endif
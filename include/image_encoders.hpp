@@ -0,0 +1,646 @@
+#ifndef IMAGE_ENCODERS_HPP
+#define IMAGE_ENCODERS_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+// Small encoders for synthetic test images, used by the decode benchmarks. They favour coverage of the
+// decoder paths over compression ratio and are not meant for shipping assets.
+
+inline uint32_t png_crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    if (!table[1])
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline uint32_t zlib_adler32(const std::vector<unsigned char> &data)
+{
+    uint32_t a = 1, b = 0;
+    for (unsigned char value : data)
+    {
+        a = (a + value) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+// Least significant bit first, as deflate packs everything except Huffman codes.
+class DeflateBitWriter
+{
+public:
+    std::vector<unsigned char> bytes;
+
+    void write(uint32_t value, int count)
+    {
+        buffer |= static_cast<uint64_t>(value) << bits;
+        bits += count;
+        while (bits >= 8)
+        {
+            bytes.push_back(static_cast<unsigned char>(buffer));
+            buffer >>= 8;
+            bits -= 8;
+        }
+    }
+
+    // Huffman codes go most significant bit first.
+    void write_code(uint32_t code, int length)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++)
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        write(reversed, length);
+    }
+
+    void flush()
+    {
+        if (bits > 0)
+            write(0, 8 - bits);
+    }
+
+private:
+    uint64_t buffer = 0;
+    int bits = 0;
+};
+
+inline void deflate_fixed_symbol(DeflateBitWriter &writer, int symbol)
+{
+    if (symbol < 144)
+        writer.write_code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        writer.write_code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        writer.write_code(symbol - 256, 7);
+    else
+        writer.write_code(0xC0 + symbol - 280, 8);
+}
+
+// One fixed Huffman block with greedy LZ77 matches, enough to exercise literals, lengths and distances.
+inline std::vector<unsigned char> deflate_fixed(const std::vector<unsigned char> &data)
+{
+    static const int length_base[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+    static const int length_extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+    static const int distance_base[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+    static const int distance_extra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+    const int window = 32768;
+    const int hash_size = 1 << 15;
+
+    DeflateBitWriter writer;
+    writer.write(0x78, 8);
+    writer.write(0x01, 8);
+    writer.write(1, 1);
+    writer.write(1, 2);
+
+    std::vector<int> head(hash_size, -1);
+    size_t size = data.size();
+    size_t i = 0;
+    while (i < size)
+    {
+        int best_length = 0;
+        size_t best_distance = 0;
+        if (i + 3 <= size)
+        {
+            uint32_t hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (hash_size - 1);
+            int candidate = head[hash];
+            head[hash] = static_cast<int>(i);
+            if (candidate >= 0 && i - candidate <= static_cast<size_t>(window))
+            {
+                size_t limit = std::min<size_t>(258, size - i);
+                size_t length = 0;
+                while (length < limit && data[candidate + length] == data[i + length])
+                    length++;
+                if (length >= 3)
+                {
+                    best_length = static_cast<int>(length);
+                    best_distance = i - candidate;
+                }
+            }
+        }
+        if (best_length == 0)
+        {
+            deflate_fixed_symbol(writer, data[i]);
+            i++;
+            continue;
+        }
+
+        int code = 28;
+        while (length_base[code] > best_length)
+            code--;
+        deflate_fixed_symbol(writer, 257 + code);
+        writer.write(best_length - length_base[code], length_extra[code]);
+        int distance_code = 29;
+        while (distance_base[distance_code] > static_cast<int>(best_distance))
+            distance_code--;
+        writer.write_code(distance_code, 5);
+        writer.write(static_cast<uint32_t>(best_distance) - distance_base[distance_code], distance_extra[distance_code]);
+        i += best_length;
+    }
+    deflate_fixed_symbol(writer, 256);
+    writer.flush();
+
+    uint32_t checksum = zlib_adler32(data);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        writer.bytes.push_back(static_cast<unsigned char>(checksum >> shift));
+    return writer.bytes;
+}
+
+inline void png_append_chunk(std::vector<unsigned char> &png, const char *type, const std::vector<unsigned char> &data)
+{
+    uint32_t size = static_cast<uint32_t>(data.size());
+    for (int shift = 24; shift >= 0; shift -= 8)
+        png.push_back(static_cast<unsigned char>(size >> shift));
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    uint32_t crc = png_crc32(png.data() + start, png.size() - start);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        png.push_back(static_cast<unsigned char>(crc >> shift));
+}
+
+inline int png_paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+// 8-bit RGB or RGBA PNG, row filters cycle through none, sub, up, avg and paeth.
+inline std::vector<unsigned char> encode_png(const std::vector<unsigned char> &pixels, int width, int height, int channels)
+{
+    size_t stride = static_cast<size_t>(width) * channels;
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+    std::vector<unsigned char> zero_row(stride, 0);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = pixels.data() + stride * y;
+        const unsigned char *prior = y > 0 ? row - stride : zero_row.data();
+        int filter = y % 5;
+        filtered.push_back(static_cast<unsigned char>(filter));
+        for (size_t x = 0; x < stride; x++)
+        {
+            int a = x >= static_cast<size_t>(channels) ? row[x - channels] : 0;
+            int b = prior[x];
+            int c = x >= static_cast<size_t>(channels) ? prior[x - channels] : 0;
+            int predictor = 0;
+            if (filter == 1)
+                predictor = a;
+            else if (filter == 2)
+                predictor = b;
+            else if (filter == 3)
+                predictor = (a + b) >> 1;
+            else if (filter == 4)
+                predictor = png_paeth(a, b, c);
+            filtered.push_back(static_cast<unsigned char>(row[x] - predictor));
+        }
+    }
+
+    const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    std::vector<unsigned char> png(signature, signature + 8);
+    std::vector<unsigned char> header(13, 0);
+    for (int i = 0; i < 4; i++)
+    {
+        header[i] = static_cast<unsigned char>(width >> (24 - i * 8));
+        header[4 + i] = static_cast<unsigned char>(height >> (24 - i * 8));
+    }
+    header[8] = 8;
+    header[9] = channels == 4 ? 6 : 2;
+    png_append_chunk(png, "IHDR", header);
+    png_append_chunk(png, "IDAT", deflate_fixed(filtered));
+    png_append_chunk(png, "IEND", {});
+    return png;
+}
+
+// Gradients, flat panels and a little noise, roughly what UI textures look like.
+inline std::vector<unsigned char> synthetic_pixels(int width, int height, int channels)
+{
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            int noise = static_cast<int>(seed >> 29);
+            bool panel = ((x / 64) + (y / 48)) % 3 == 0;
+            unsigned char *pixel = &pixels[(static_cast<size_t>(y) * width + x) * channels];
+            pixel[0] = static_cast<unsigned char>(panel ? 40 : (x * 255 / width + noise));
+            pixel[1] = static_cast<unsigned char>(panel ? 44 : (y * 255 / height + noise));
+            pixel[2] = static_cast<unsigned char>(panel ? 52 : ((x ^ y) & 255));
+            if (channels == 4)
+                pixel[3] = static_cast<unsigned char>(panel ? 255 : 128 + ((x + y) & 127));
+        }
+    return pixels;
+}
+
+// Uncompressed true color TGA, bottom-up rows of BGR or BGRA as most tools write them.
+inline std::vector<unsigned char> encode_tga(const std::vector<unsigned char> &pixels, int width, int height, int channels)
+{
+    std::vector<unsigned char> tga(18, 0);
+    tga[2] = 2;
+    tga[12] = static_cast<unsigned char>(width);
+    tga[13] = static_cast<unsigned char>(width >> 8);
+    tga[14] = static_cast<unsigned char>(height);
+    tga[15] = static_cast<unsigned char>(height >> 8);
+    tga[16] = static_cast<unsigned char>(channels * 8);
+    tga[17] = channels == 4 ? 8 : 0;
+    tga.reserve(tga.size() + pixels.size());
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const unsigned char *row = pixels.data() + static_cast<size_t>(y) * width * channels;
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *pixel = row + x * channels;
+            tga.push_back(pixel[2]);
+            tga.push_back(pixel[1]);
+            tga.push_back(pixel[0]);
+            if (channels == 4)
+                tga.push_back(pixel[3]);
+        }
+    }
+    return tga;
+}
+
+// Radiance RGBE with run-length encoded scanlines, from linear float RGB.
+inline std::vector<unsigned char> encode_hdr(const std::vector<float> &pixels, int width, int height)
+{
+    std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+    std::vector<unsigned char> hdr(header.begin(), header.end());
+    std::vector<unsigned char> planes(static_cast<size_t>(width) * 4);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const float *pixel = &pixels[(static_cast<size_t>(y) * width + x) * 3];
+            float largest = std::max(pixel[0], std::max(pixel[1], pixel[2]));
+            unsigned char rgbe[4] = { 0, 0, 0, 0 };
+            if (largest > 1e-32f)
+            {
+                int exponent;
+                float scale = std::frexp(largest, &exponent) * 256.0f / largest;
+                for (int c = 0; c < 3; c++)
+                    rgbe[c] = static_cast<unsigned char>(std::max(pixel[c], 0.0f) * scale);
+                rgbe[3] = static_cast<unsigned char>(exponent + 128);
+            }
+            for (int c = 0; c < 4; c++)
+                planes[static_cast<size_t>(c) * width + x] = rgbe[c];
+        }
+        const unsigned char scanline[4] = { 2, 2, static_cast<unsigned char>(width >> 8), static_cast<unsigned char>(width) };
+        hdr.insert(hdr.end(), scanline, scanline + 4);
+        // Each component separately: runs of four or more equal bytes, literal spans of up to 128 otherwise.
+        for (int c = 0; c < 4; c++)
+        {
+            const unsigned char *plane = planes.data() + static_cast<size_t>(c) * width;
+            int x = 0;
+            while (x < width)
+            {
+                int run = 1;
+                while (x + run < width && run < 127 && plane[x + run] == plane[x])
+                    run++;
+                if (run >= 4)
+                {
+                    hdr.push_back(static_cast<unsigned char>(128 + run));
+                    hdr.push_back(plane[x]);
+                    x += run;
+                    continue;
+                }
+                int literal = 0;
+                while (x + literal < width && literal < 128)
+                {
+                    int next_run = 1;
+                    while (x + literal + next_run < width && next_run < 4 && plane[x + literal + next_run] == plane[x + literal])
+                        next_run++;
+                    if (next_run >= 4)
+                        break;
+                    literal++;
+                }
+                hdr.push_back(static_cast<unsigned char>(literal));
+                hdr.insert(hdr.end(), plane + x, plane + x + literal);
+                x += literal;
+            }
+        }
+    }
+    return hdr;
+}
+
+// Most significant bit first with 0xFF bytes stuffed, as JPEG entropy coded data is written.
+class JpegBitWriter
+{
+public:
+    std::vector<unsigned char> &bytes;
+
+    explicit JpegBitWriter(std::vector<unsigned char> &bytes_value) : bytes(bytes_value)
+    {
+    }
+
+    void write(uint32_t value, int count)
+    {
+        buffer = buffer << count | (value & ((1u << count) - 1));
+        bits += count;
+        while (bits >= 8)
+        {
+            unsigned char byte = static_cast<unsigned char>(buffer >> (bits - 8));
+            bytes.push_back(byte);
+            if (byte == 0xFF)
+                bytes.push_back(0);
+            bits -= 8;
+        }
+    }
+
+    void flush()
+    {
+        if (bits > 0)
+            write(0x7F, 8 - bits);
+    }
+
+private:
+    uint64_t buffer = 0;
+    int bits = 0;
+};
+
+struct JpegHuffmanTable
+{
+    unsigned char counts[16];
+    std::vector<unsigned char> values;
+    uint16_t codes[256] = {};
+    unsigned char lengths[256] = {};
+
+    JpegHuffmanTable(const unsigned char (&counts_value)[16], const std::vector<unsigned char> &values_value) : values(values_value)
+    {
+        std::memcpy(counts, counts_value, sizeof(counts));
+        int code = 0;
+        size_t k = 0;
+        for (int length = 1; length <= 16; length++)
+        {
+            for (int i = 0; i < counts[length - 1]; i++, k++)
+            {
+                codes[values[k]] = static_cast<uint16_t>(code++);
+                lengths[values[k]] = static_cast<unsigned char>(length);
+            }
+            code <<= 1;
+        }
+    }
+
+    void write(JpegBitWriter &writer, int symbol) const
+    {
+        writer.write(codes[symbol], lengths[symbol]);
+    }
+};
+
+// Baseline JPEG with the example tables of the standard: 4:2:0 YCbCr for RGB, a single component for grey.
+// Quality follows the IJG scale from 1 to 100. A restart_interval above 0 writes a DRI segment and an RST
+// marker after every restart_interval MCUs, as cameras and most encoders do.
+inline std::vector<unsigned char> encode_jpeg(const std::vector<unsigned char> &pixels, int width, int height, int channels, int quality = 90, int restart_interval = 0)
+{
+    static const int zigzag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,
+                                    35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+    static const int luma_quant[64] = { 16,11,10,16,24,40,51,61, 12,12,14,19,26,58,60,55, 14,13,16,24,40,57,69,56, 14,17,22,29,51,87,80,62,
+                                        18,22,37,56,68,109,103,77, 24,35,55,64,81,104,113,92, 49,64,78,87,103,121,120,101, 72,92,95,98,112,100,103,99 };
+    static const int chroma_quant[64] = { 17,18,24,47,99,99,99,99, 18,21,26,66,99,99,99,99, 24,26,56,99,99,99,99,99, 47,66,99,99,99,99,99,99,
+                                          99,99,99,99,99,99,99,99, 99,99,99,99,99,99,99,99, 99,99,99,99,99,99,99,99, 99,99,99,99,99,99,99,99 };
+    static const unsigned char dc_luma_counts[16] = { 0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+    static const unsigned char dc_chroma_counts[16] = { 0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+    static const unsigned char ac_luma_counts[16] = { 0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7D };
+    static const unsigned char ac_chroma_counts[16] = { 0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+    static const std::vector<unsigned char> dc_values = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+    static const std::vector<unsigned char> ac_luma_values = {
+        0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xA1,0x08,
+        0x23,0x42,0xB1,0xC1,0x15,0x52,0xD1,0xF0,0x24,0x33,0x62,0x72,0x82,0x09,0x0A,0x16,0x17,0x18,0x19,0x1A,0x25,0x26,0x27,0x28,
+        0x29,0x2A,0x34,0x35,0x36,0x37,0x38,0x39,0x3A,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+        0x5A,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+        0x8A,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xB2,0xB3,0xB4,0xB5,0xB6,
+        0xB7,0xB8,0xB9,0xBA,0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,0xE1,0xE2,
+        0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xF1,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,0xFA };
+    static const std::vector<unsigned char> ac_chroma_values = {
+        0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
+        0xA1,0xB1,0xC1,0x09,0x23,0x33,0x52,0xF0,0x15,0x62,0x72,0xD1,0x0A,0x16,0x24,0x34,0xE1,0x25,0xF1,0x17,0x18,0x19,0x1A,0x26,
+        0x27,0x28,0x29,0x2A,0x35,0x36,0x37,0x38,0x39,0x3A,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,0x53,0x54,0x55,0x56,0x57,0x58,
+        0x59,0x5A,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x82,0x83,0x84,0x85,0x86,0x87,
+        0x88,0x89,0x8A,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xB2,0xB3,0xB4,
+        0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,
+        0xE2,0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,0xFA };
+    static const JpegHuffmanTable dc_tables[2] = { JpegHuffmanTable(dc_luma_counts, dc_values), JpegHuffmanTable(dc_chroma_counts, dc_values) };
+    static const JpegHuffmanTable ac_tables[2] = { JpegHuffmanTable(ac_luma_counts, ac_luma_values), JpegHuffmanTable(ac_chroma_counts, ac_chroma_values) };
+
+    static const std::vector<float> cosines = []() {
+        std::vector<float> values(64);
+        for (int u = 0; u < 8; u++)
+            for (int x = 0; x < 8; x++)
+                values[u * 8 + x] = static_cast<float>((u == 0 ? std::sqrt(0.125) : 0.5) * std::cos((2 * x + 1) * u * 3.14159265358979 / 16.0));
+        return values;
+    }();
+
+    quality = std::min(std::max(quality, 1), 100);
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    int quant[2][64];
+    for (int i = 0; i < 64; i++)
+    {
+        quant[0][i] = std::min(std::max((luma_quant[i] * scale + 50) / 100, 1), 255);
+        quant[1][i] = std::min(std::max((chroma_quant[i] * scale + 50) / 100, 1), 255);
+    }
+
+    const bool color = channels >= 3;
+    const int components = color ? 3 : 1;
+    std::vector<unsigned char> jpeg = { 0xFF, 0xD8 };
+    auto segment = [&jpeg](unsigned char marker, const std::vector<unsigned char> &data) {
+        jpeg.push_back(0xFF);
+        jpeg.push_back(marker);
+        jpeg.push_back(static_cast<unsigned char>((data.size() + 2) >> 8));
+        jpeg.push_back(static_cast<unsigned char>(data.size() + 2));
+        jpeg.insert(jpeg.end(), data.begin(), data.end());
+    };
+
+    std::vector<unsigned char> tables;
+    for (int t = 0; t < components && t < 2; t++)
+    {
+        tables.push_back(static_cast<unsigned char>(t));
+        for (int i = 0; i < 64; i++)
+            tables.push_back(static_cast<unsigned char>(quant[t][zigzag[i]]));
+    }
+    segment(0xDB, tables);
+
+    std::vector<unsigned char> frame = { 8, static_cast<unsigned char>(height >> 8), static_cast<unsigned char>(height),
+                                         static_cast<unsigned char>(width >> 8), static_cast<unsigned char>(width), static_cast<unsigned char>(components) };
+    for (int c = 0; c < components; c++)
+    {
+        frame.push_back(static_cast<unsigned char>(c + 1));
+        frame.push_back(color && c == 0 ? 0x22 : 0x11);
+        frame.push_back(static_cast<unsigned char>(c == 0 ? 0 : 1));
+    }
+    segment(0xC0, frame);
+
+    std::vector<unsigned char> huffman;
+    for (int t = 0; t < (color ? 2 : 1); t++)
+    {
+        const JpegHuffmanTable *pair[2] = { &dc_tables[t], &ac_tables[t] };
+        for (int k = 0; k < 2; k++)
+        {
+            huffman.push_back(static_cast<unsigned char>(k << 4 | t));
+            huffman.insert(huffman.end(), pair[k]->counts, pair[k]->counts + 16);
+            huffman.insert(huffman.end(), pair[k]->values.begin(), pair[k]->values.end());
+        }
+    }
+    segment(0xC4, huffman);
+
+    restart_interval = std::min(std::max(restart_interval, 0), 0xFFFF);
+    if (restart_interval > 0)
+        segment(0xDD, { static_cast<unsigned char>(restart_interval >> 8), static_cast<unsigned char>(restart_interval) });
+
+    std::vector<unsigned char> scan = { static_cast<unsigned char>(components) };
+    for (int c = 0; c < components; c++)
+    {
+        scan.push_back(static_cast<unsigned char>(c + 1));
+        scan.push_back(c == 0 ? 0x00 : 0x11);
+    }
+    scan.push_back(0);
+    scan.push_back(63);
+    scan.push_back(0);
+    segment(0xDA, scan);
+
+    // Samples of the three planes, edges repeated out to whole MCUs.
+    const int mcu_size = color ? 16 : 8;
+    auto sample = [&](int x, int y, int c) -> float {
+        const unsigned char *pixel = &pixels[(static_cast<size_t>(std::min(y, height - 1)) * width + std::min(x, width - 1)) * channels];
+        if (!color)
+            return pixel[0];
+        float r = pixel[0], g = pixel[1], b = pixel[2];
+        if (c == 0)
+            return 0.299f * r + 0.587f * g + 0.114f * b;
+        if (c == 1)
+            return -0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f;
+        return 0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f;
+    };
+
+    JpegBitWriter writer(jpeg);
+    int previous_dc[3] = { 0, 0, 0 };
+    auto encode_block = [&](const float (&block)[64], int component) {
+        const int table = component == 0 ? 0 : 1;
+        float rows[64];
+        for (int y = 0; y < 8; y++)
+            for (int u = 0; u < 8; u++)
+            {
+                float sum = 0.0f;
+                for (int x = 0; x < 8; x++)
+                    sum += cosines[u * 8 + x] * (block[y * 8 + x] - 128.0f);
+                rows[y * 8 + u] = sum;
+            }
+        int coefficients[64];
+        for (int v = 0; v < 8; v++)
+            for (int u = 0; u < 8; u++)
+            {
+                float sum = 0.0f;
+                for (int y = 0; y < 8; y++)
+                    sum += cosines[v * 8 + y] * rows[y * 8 + u];
+                coefficients[v * 8 + u] = static_cast<int>(std::lround(sum / quant[table][v * 8 + u]));
+            }
+
+        auto magnitude = [](int value, int &bits) {
+            int absolute = std::abs(value);
+            bits = 0;
+            while (absolute >> bits)
+                bits++;
+            return value < 0 ? value + (1 << bits) - 1 : value;
+        };
+        int bits;
+        int difference = coefficients[0] - previous_dc[component];
+        previous_dc[component] = coefficients[0];
+        int value = magnitude(difference, bits);
+        dc_tables[table].write(writer, bits);
+        if (bits)
+            writer.write(static_cast<uint32_t>(value), bits);
+        int run = 0;
+        for (int i = 1; i < 64; i++)
+        {
+            int coefficient = coefficients[zigzag[i]];
+            if (coefficient == 0)
+            {
+                run++;
+                continue;
+            }
+            while (run >= 16)
+            {
+                ac_tables[table].write(writer, 0xF0);
+                run -= 16;
+            }
+            value = magnitude(coefficient, bits);
+            ac_tables[table].write(writer, run << 4 | bits);
+            writer.write(static_cast<uint32_t>(value), bits);
+            run = 0;
+        }
+        if (run > 0)
+            ac_tables[table].write(writer, 0x00);
+    };
+
+    float block[64];
+    int mcu = 0;
+    for (int mcu_y = 0; mcu_y < height; mcu_y += mcu_size)
+    {
+        for (int mcu_x = 0; mcu_x < width; mcu_x += mcu_size, mcu++)
+        {
+            // Each interval starts byte aligned after its marker, with the DC predictions reset.
+            if (restart_interval > 0 && mcu > 0 && mcu % restart_interval == 0)
+            {
+                writer.flush();
+                jpeg.push_back(0xFF);
+                jpeg.push_back(static_cast<unsigned char>(0xD0 + (mcu / restart_interval - 1) % 8));
+                std::fill(previous_dc, previous_dc + 3, 0);
+            }
+            for (int by = 0; by < mcu_size; by += 8)
+                for (int bx = 0; bx < mcu_size; bx += 8)
+                {
+                    for (int i = 0; i < 64; i++)
+                        block[i] = sample(mcu_x + bx + i % 8, mcu_y + by + i / 8, 0);
+                    encode_block(block, 0);
+                }
+            for (int c = 1; c < components; c++)
+            {
+                for (int i = 0; i < 64; i++)
+                {
+                    int x = mcu_x + (i % 8) * 2, y = mcu_y + (i / 8) * 2;
+                    block[i] = (sample(x, y, c) + sample(x + 1, y, c) + sample(x, y + 1, c) + sample(x + 1, y + 1, c)) * 0.25f;
+                }
+                encode_block(block, c);
+            }
+        }
+    }
+    writer.flush();
+    jpeg.push_back(0xFF);
+    jpeg.push_back(0xD9);
+    return jpeg;
+}
+
+// Sky gradient with a sun far above 1.0, the kind of range environment maps have.
+inline std::vector<float> synthetic_hdr_pixels(int width, int height)
+{
+    std::vector<float> pixels(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            float u = (x + 0.5f) / width, v = (y + 0.5f) / height;
+            float dx = u - 0.3f, dy = v - 0.25f;
+            float sun = 2000.0f * std::exp(-(dx * dx + dy * dy) * 4000.0f);
+            float *pixel = &pixels[(static_cast<size_t>(y) * width + x) * 3];
+            pixel[0] = 0.2f + 0.6f * v + sun;
+            pixel[1] = 0.4f + 0.4f * v + sun * 0.9f;
+            pixel[2] = 1.0f - 0.5f * v + sun * 0.7f;
+        }
+    return pixels;
+}
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef KTX_TEXTURE_HPP
+#define KTX_TEXTURE_HPP
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <filesystem>
+
+#include "mapped_file.hpp"
+#include "gl_extensions.hpp"
+#include "texture_options.hpp"
+#include "texture_format.hpp"
+
+// KTX 1.1 container: identifier, 13 header words, key/value data, then per mip level
+// a 32-bit image size followed by that many bytes for every face, each padded to 4 bytes.
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+// KTXorientation values, images flipped for OpenGL start with the bottom row.
+const char *const KTX_ORIENTATION_KEY = "KTXorientation";
+const char *const KTX_ORIENTATION_UP = "S=r,T=u";
+const char *const KTX_ORIENTATION_DOWN = "S=r,T=d";
+
+struct KtxHeader
+{
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t gl_type;
+    uint32_t gl_type_size;
+    uint32_t gl_format;
+    uint32_t gl_internal_format;
+    uint32_t gl_base_internal_format;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t array_elements;
+    uint32_t faces;
+    uint32_t mip_levels;
+    uint32_t key_value_bytes;
+};
+
+// Image data to be written, images[level * faces + face]. gl_type and gl_format are 0 for compressed formats.
+struct KtxImage
+{
+    uint32_t gl_type = 0;
+    uint32_t gl_type_size = 1;
+    uint32_t gl_format = 0;
+    uint32_t gl_internal_format = 0;
+    uint32_t gl_base_internal_format = GL_RGBA;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t faces = 1;
+    std::map<std::string, std::string> key_values;
+    std::vector<std::vector<unsigned char>> images;
+};
+
+inline bool write_ktx(const std::string &path, const KtxImage &image)
+{
+    KtxHeader header;
+    std::memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.gl_type = image.gl_type;
+    header.gl_type_size = image.gl_type_size;
+    header.gl_format = image.gl_format;
+    header.gl_internal_format = image.gl_internal_format;
+    header.gl_base_internal_format = image.gl_base_internal_format;
+    header.pixel_width = image.width;
+    header.pixel_height = image.height;
+    header.pixel_depth = 0;
+    header.array_elements = 0;
+    header.faces = image.faces;
+    header.mip_levels = static_cast<uint32_t>(image.images.size() / image.faces);
+
+    // Each pair is stored as its size, then key and value both null terminated, padded to 4 bytes.
+    std::vector<unsigned char> key_value_data;
+    for (const auto &pair : image.key_values)
+    {
+        uint32_t pair_size = static_cast<uint32_t>(pair.first.size() + pair.second.size() + 2);
+        const unsigned char *size_bytes = reinterpret_cast<const unsigned char*>(&pair_size);
+        key_value_data.insert(key_value_data.end(), size_bytes, size_bytes + 4);
+        key_value_data.insert(key_value_data.end(), pair.first.begin(), pair.first.end());
+        key_value_data.push_back(0);
+        key_value_data.insert(key_value_data.end(), pair.second.begin(), pair.second.end());
+        key_value_data.push_back(0);
+        key_value_data.resize((key_value_data.size() + 3) & ~static_cast<size_t>(3), 0);
+    }
+    header.key_value_bytes = static_cast<uint32_t>(key_value_data.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::KTX::FILE_NOT_SUCCESFULLY_WRITTEN " << path << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(key_value_data.data()), static_cast<std::streamsize>(key_value_data.size()));
+
+    const char padding[4] = {};
+    for (uint32_t level = 0; level < header.mip_levels; level++)
+    {
+        uint32_t image_size = static_cast<uint32_t>(image.images[level * image.faces].size());
+        file.write(reinterpret_cast<const char*>(&image_size), sizeof(image_size));
+        for (uint32_t face = 0; face < image.faces; face++)
+        {
+            const std::vector<unsigned char> &data = image.images[level * image.faces + face];
+            file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            file.write(padding, static_cast<std::streamsize>((4 - data.size() % 4) % 4));
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// Memory-mapped KTX file, levels are uploaded straight from the mapping.
+class KtxFile
+{
+public:
+    KtxHeader header;
+    std::map<std::string, std::string> key_values;
+
+    bool load(const std::string &path)
+    {
+        images.clear();
+        key_values.clear();
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(KtxHeader))
+            return fail(path, "TRUNCATED");
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+            return fail(path, "INVALID_IDENTIFIER");
+        if (header.endianness != KTX_ENDIANNESS)
+            return fail(path, "UNSUPPORTED_ENDIANNESS");
+        if (header.pixel_depth > 1 || header.array_elements > 0 || (header.faces != 1 && header.faces != 6))
+            return fail(path, "UNSUPPORTED_LAYOUT");
+
+        size_t position = sizeof(KtxHeader) + header.key_value_bytes;
+        if (position > file.size())
+            return fail(path, "TRUNCATED");
+        read_key_values();
+        uint32_t levels = header.mip_levels == 0 ? 1 : header.mip_levels;
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            if (position + 4 > file.size())
+                return fail(path, "TRUNCATED");
+            uint32_t image_size;
+            std::memcpy(&image_size, file.data() + position, 4);
+            position += 4;
+            for (uint32_t face = 0; face < header.faces; face++)
+            {
+                if (position + image_size > file.size())
+                    return fail(path, "TRUNCATED");
+                images.push_back({ file.data() + position, image_size });
+                position += (image_size + 3) & ~3u;
+            }
+        }
+        return true;
+    }
+
+    uint32_t level_count() const
+    {
+        return static_cast<uint32_t>(images.size() / header.faces);
+    }
+
+    const unsigned char *level_data(uint32_t level, uint32_t face = 0) const
+    {
+        return images[level * header.faces + face].data;
+    }
+
+    uint32_t level_size(uint32_t level, uint32_t face = 0) const
+    {
+        return images[level * header.faces + face].size;
+    }
+
+    std::string key_value(const std::string &key) const
+    {
+        auto found = key_values.find(key);
+        return found != key_values.end() ? found->second : std::string();
+    }
+
+    bool is_compressed() const
+    {
+        return header.gl_type == 0;
+    }
+
+    // The format the levels upload with as they are stored, false for layouts TextureFormat cannot describe
+    // or compressed formats the context lacks. Uncompressed rows are padded to 4 bytes, as mip_pitch pads them.
+    bool texture_format(TextureFormat &format) const
+    {
+        format = TextureFormat();
+        format.internal_format = static_cast<GLint>(header.gl_internal_format);
+        if (is_compressed())
+        {
+            format.block_bytes = compressed_block_bytes(header.gl_internal_format);
+            return format.compressed() && is_compressed_format_supported(header.gl_internal_format);
+        }
+        if (header.gl_type != GL_UNSIGNED_BYTE)
+            return false;
+        switch (header.gl_format)
+        {
+        case GL_RED: format.channels = 1; break;
+        case GL_RG: format.channels = 2; break;
+        case GL_RGB: format.channels = 3; break;
+        case GL_RGBA: format.channels = 4; break;
+        default: return false;
+        }
+        format.format = header.gl_format;
+        format.bytes_per_texel = format.channels;
+        format.vram_bytes_per_texel = format.channels == 3 ? 4 : format.channels;
+        if (format.channels <= 2)
+        {
+            const GLint grey[4] = { GL_RED, GL_RED, GL_RED, format.channels == 1 ? GL_ONE : GL_GREEN };
+            std::copy(grey, grey + 4, format.swizzle);
+        }
+        return true;
+    }
+
+    // Creates a texture from the file, or returns 0 when the format is not supported by the context.
+    // Levels larger than options.max_dimension are left out, the first one that fits becomes level 0.
+    unsigned int create_texture(const TextureOptions &options = TextureOptions()) const
+    {
+        if (is_compressed() && !is_compressed_format_supported(header.gl_internal_format))
+        {
+            std::cout << "ERROR::KTX::UNSUPPORTED_FORMAT 0x" << std::hex << header.gl_internal_format << std::dec << "\n";
+            return 0;
+        }
+
+        GLenum target = header.faces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+        GLint previous_texture;
+        glGetIntegerv(target == GL_TEXTURE_2D ? GL_TEXTURE_BINDING_2D : GL_TEXTURE_BINDING_CUBE_MAP, &previous_texture);
+
+        unsigned int texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(target, texture_id);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, options.wrap_s);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, options.wrap_t);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, options.min_filter);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, options.mag_filter);
+        uint32_t first_level = 0;
+        if (options.max_dimension > 0)
+            while (first_level + 1 < level_count() && std::max(header.pixel_width >> first_level, header.pixel_height >> first_level) > static_cast<uint32_t>(options.max_dimension))
+                first_level++;
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level_count() - 1 - first_level));
+        // Grey images read back as grey RGB, the same as decoded ones, see apply_texture_swizzle.
+        if (header.gl_format == GL_RED || header.gl_format == GL_RG)
+        {
+            const GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, header.gl_format == GL_RED ? GL_ONE : GL_GREEN };
+            glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for (uint32_t level = first_level; level < level_count(); level++)
+        {
+            GLsizei level_width = static_cast<GLsizei>(std::max(1u, header.pixel_width >> level));
+            GLsizei level_height = static_cast<GLsizei>(std::max(1u, header.pixel_height >> level));
+            GLint target_level = static_cast<GLint>(level - first_level);
+            for (uint32_t face = 0; face < header.faces; face++)
+            {
+                GLenum face_target = header.faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+                if (is_compressed())
+                    glCompressedTexImage2D(face_target, target_level, header.gl_internal_format, level_width, level_height, 0, static_cast<GLsizei>(level_size(level, face)), level_data(level, face));
+                else
+                    glTexImage2D(face_target, target_level, static_cast<GLint>(header.gl_internal_format), level_width, level_height, 0, header.gl_format, header.gl_type, level_data(level, face));
+            }
+        }
+        if (header.mip_levels == 0 && options.generate_mipmaps)
+        {
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 1000);
+            glGenerateMipmap(target);
+        }
+
+        glBindTexture(target, static_cast<GLuint>(previous_texture));
+        return texture_id;
+    }
+
+    void close()
+    {
+        file.close();
+        images.clear();
+    }
+
+private:
+    struct Image
+    {
+        const unsigned char *data;
+        uint32_t size;
+    };
+
+    MappedFile file;
+    std::vector<Image> images;
+
+    void read_key_values()
+    {
+        const unsigned char *data = file.data() + sizeof(KtxHeader);
+        size_t position = 0;
+        while (position + 4 <= header.key_value_bytes)
+        {
+            uint32_t pair_size;
+            std::memcpy(&pair_size, data + position, 4);
+            position += 4;
+            if (pair_size > header.key_value_bytes - position)
+                break;
+            const char *pair = reinterpret_cast<const char*>(data + position);
+            size_t key_size = strnlen(pair, pair_size);
+            if (key_size < pair_size)
+            {
+                size_t value_size = strnlen(pair + key_size + 1, pair_size - key_size - 1);
+                key_values[std::string(pair, key_size)] = std::string(pair + key_size + 1, value_size);
+            }
+            position += (pair_size + 3) & ~3u;
+        }
+    }
+
+    bool fail(const std::string &path, const std::string &reason)
+    {
+        std::cout << "ERROR::KTX::" << reason << " " << path << "\n";
+        close();
+        return false;
+    }
+};
+
+// Maps the .ktx cooked next to an image, when it is at least as new as the image and stored the way options flip it.
+inline bool load_cooked_ktx(KtxFile &file, const std::string &path, const TextureOptions &options)
+{
+    std::filesystem::path cooked = std::filesystem::path(path).replace_extension(".ktx");
+    if (cooked == std::filesystem::path(path))
+        return false;
+    std::error_code error;
+    if (!std::filesystem::exists(cooked, error))
+        return false;
+    if (std::filesystem::exists(path, error) && std::filesystem::last_write_time(cooked, error) < std::filesystem::last_write_time(path, error))
+        return false;
+
+    if (!file.load(cooked.string()))
+        return false;
+    std::string orientation = file.key_value(KTX_ORIENTATION_KEY);
+    if (!orientation.empty() && orientation != (options.flip_vertically ? KTX_ORIENTATION_UP : KTX_ORIENTATION_DOWN))
+    {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+#endif
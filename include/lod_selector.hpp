@@ -0,0 +1,64 @@
+#ifndef LOD_SELECTOR_HPP
+#define LOD_SELECTOR_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+
+#include "camera.hpp"
+#include "mesh_simplifier.hpp"
+
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_CULL_PIXEL_SIZE = 1.0f;
+
+// Picks a level of detail per instance from its projected screen-space error.
+class LodSelector
+{
+public:
+    float pixel_error;
+    float cull_pixel_size;
+
+    LodSelector(float pixel_error_value = LOD_PIXEL_ERROR, float cull_pixel_size_value = LOD_CULL_PIXEL_SIZE) : pixel_error(pixel_error_value), cull_pixel_size(cull_pixel_size_value), camera_position(0.0f), pixels_per_unit(1.0f)
+    {
+    }
+
+    // Call once per frame with the values used to build the projection matrix.
+    void update(const Camera &camera, int viewport_height)
+    {
+        camera_position = camera.position;
+        pixels_per_unit = static_cast<float>(viewport_height) / (2.0f * std::tan(glm::radians(camera.zoom) * 0.5f));
+    }
+
+    // Projected size in pixels of a world-space length seen at the given distance.
+    float projected_size(float length, float distance) const
+    {
+        return length * pixels_per_unit / std::max(distance, 1e-4f);
+    }
+
+    // Returns the chosen level, or -1 when the bounding sphere covers less than cull_pixel_size pixels.
+    // scale converts the object-space errors of the levels into world units.
+    int select(const std::vector<MeshLod> &lods, const glm::vec3 &center, float radius, float scale = 1.0f) const
+    {
+        float distance = glm::length(center - camera_position) - radius;
+        if (distance <= 0.0f)
+            return 0;
+        if (projected_size(2.0f * radius, distance) < cull_pixel_size)
+            return -1;
+
+        int chosen = 0;
+        for (size_t i = 1; i < lods.size(); i++)
+        {
+            if (projected_size(lods[i].error * scale, distance) > pixel_error)
+                break;
+            chosen = static_cast<int>(i);
+        }
+        return chosen;
+    }
+
+private:
+    glm::vec3 camera_position;
+    float pixels_per_unit;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// How a mapping is about to be read, passed on to the kernel so it can size its readahead.
+enum Access_Hint
+{
+    ACCESS_SEQUENTIAL,
+    ACCESS_RANDOM,
+    ACCESS_WILL_NEED
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() : mapped_data(nullptr), mapped_size(0)
+    {
+    }
+
+    explicit MappedFile(const std::string &path) : mapped_data(nullptr), mapped_size(0)
+    {
+        open(path);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept : mapped_data(other.mapped_data), mapped_size(other.mapped_size)
+    {
+        other.mapped_data = nullptr;
+        other.mapped_size = 0;
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            mapped_data = other.mapped_data;
+            mapped_size = other.mapped_size;
+            other.mapped_data = nullptr;
+            other.mapped_size = 0;
+        }
+        return *this;
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+            return false;
+        void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (view == nullptr)
+            return false;
+        mapped_data = static_cast<const unsigned char*>(view);
+        mapped_size = static_cast<size_t>(file_size.QuadPart);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat file_stat;
+        if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+        {
+            ::close(file);
+            return false;
+        }
+        void *view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (view == MAP_FAILED)
+            return false;
+        mapped_data = static_cast<const unsigned char*>(view);
+        mapped_size = static_cast<size_t>(file_stat.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+        if (mapped_data == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(mapped_data);
+#else
+        munmap(const_cast<unsigned char*>(mapped_data), mapped_size);
+#endif
+        mapped_data = nullptr;
+        mapped_size = 0;
+    }
+
+    // Hints the kernel about a byte range, the whole file when size is 0. Only a hint, failures are ignored.
+    // Windows has no equivalent for ranges, it reads ahead on its own for files opened for sequential scans.
+    void advise(Access_Hint hint, size_t offset = 0, size_t size = 0) const
+    {
+        if (mapped_data == nullptr || offset >= mapped_size)
+            return;
+        if (size == 0 || size > mapped_size - offset)
+            size = mapped_size - offset;
+#ifndef _WIN32
+        // madvise wants a page aligned start
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset / page * page;
+        int advice = hint == ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : (hint == ACCESS_RANDOM ? MADV_RANDOM : MADV_WILLNEED);
+        madvise(const_cast<unsigned char*>(mapped_data) + start, size + offset - start, advice);
+#else
+        (void)hint;
+#endif
+    }
+
+    bool is_open() const
+    {
+        return mapped_data != nullptr;
+    }
+
+    const unsigned char *data() const
+    {
+        return mapped_data;
+    }
+
+    size_t size() const
+    {
+        return mapped_size;
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+private:
+    const unsigned char *mapped_data;
+    size_t mapped_size;
+};
+
+#endif
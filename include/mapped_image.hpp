@@ -0,0 +1,240 @@
+#ifndef MAPPED_IMAGE_HPP
+#define MAPPED_IMAGE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#include "mapped_file.hpp"
+#include "stb_image.h"
+#include "decode_arena.hpp"
+
+// Decodes an image straight from a memory mapping instead of stb_image's buffered stdio reads.
+// Same arguments and result as stbi_load, free the pixels with stbi_image_free.
+// Scratch memory comes from the calling thread's DecodeArena.
+inline unsigned char *load_mapped_image(const std::string &path, int *width, int *height, int *channels, int desired_channels, int max_dimension = 0)
+{
+    MappedFile file;
+    if (!file.open(path) || file.size() > static_cast<size_t>(INT_MAX))
+        return nullptr;
+    file.advise(ACCESS_SEQUENTIAL);
+    file.advise(ACCESS_WILL_NEED);
+    return decode_image_in_arena(file.data(), file.size(), width, height, channels, desired_channels, max_dimension);
+}
+
+// Decodes an image from a memory mapping into caller memory, see stbi_load_from_memory_into.
+// Get the size with stbi_info first, desired_channels is required.
+inline bool load_mapped_image_into(const std::string &path, unsigned char *destination, size_t destination_size, size_t pitch, int desired_channels, bool flip_vertically, int *width, int *height, int *channels)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    file.advise(ACCESS_SEQUENTIAL);
+    file.advise(ACCESS_WILL_NEED);
+    return decode_image_into(file.data(), file.size(), destination, destination_size, pitch, desired_channels, flip_vertically, width, height, channels);
+}
+
+// Packed image archive: header, entry table, names, then the unchanged image files each aligned to 16 bytes.
+const char IMAGE_ARCHIVE_IDENTIFIER[8] = { 'I', 'M', 'G', 'P', 'A', 'C', 'K', '1' };
+const size_t IMAGE_ARCHIVE_ALIGNMENT = 16;
+
+struct ImageArchiveHeader
+{
+    char identifier[8];
+    uint32_t entry_count;
+    uint32_t names_bytes;
+};
+
+struct ImageArchiveEntry
+{
+    uint64_t offset;
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t name_size;
+};
+
+// Packs files into an archive, names[i] is what ImageArchive looks files[i] up by.
+inline bool write_image_archive(const std::string &path, const std::vector<std::string> &files, const std::vector<std::string> &names)
+{
+    ImageArchiveHeader header;
+    std::memcpy(header.identifier, IMAGE_ARCHIVE_IDENTIFIER, sizeof(IMAGE_ARCHIVE_IDENTIFIER));
+    header.entry_count = static_cast<uint32_t>(files.size());
+
+    std::vector<ImageArchiveEntry> entries(files.size());
+    std::string name_data;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        entries[i].name_offset = static_cast<uint32_t>(name_data.size());
+        entries[i].name_size = static_cast<uint32_t>(names[i].size());
+        name_data += names[i];
+    }
+    header.names_bytes = static_cast<uint32_t>(name_data.size());
+
+    std::vector<std::vector<char>> contents(files.size());
+    uint64_t offset = sizeof(header) + sizeof(ImageArchiveEntry) * entries.size() + name_data.size();
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        std::ifstream input(files[i], std::ios::binary);
+        if (!input)
+        {
+            std::cout << "ERROR::IMAGE_ARCHIVE::FILE_NOT_SUCCESFULLY_READ " << files[i] << "\n";
+            return false;
+        }
+        contents[i].assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        offset = (offset + IMAGE_ARCHIVE_ALIGNMENT - 1) & ~static_cast<uint64_t>(IMAGE_ARCHIVE_ALIGNMENT - 1);
+        entries[i].offset = offset;
+        entries[i].size = contents[i].size();
+        offset += contents[i].size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::IMAGE_ARCHIVE::FILE_NOT_SUCCESFULLY_WRITTEN " << path << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(sizeof(ImageArchiveEntry) * entries.size()));
+    file.write(name_data.data(), static_cast<std::streamsize>(name_data.size()));
+    uint64_t position = sizeof(header) + sizeof(ImageArchiveEntry) * entries.size() + name_data.size();
+    const char padding[IMAGE_ARCHIVE_ALIGNMENT] = {};
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        file.write(padding, static_cast<std::streamsize>(entries[i].offset - position));
+        file.write(contents[i].data(), static_cast<std::streamsize>(contents[i].size()));
+        position = entries[i].offset + entries[i].size;
+    }
+    return static_cast<bool>(file);
+}
+
+// Many images in one mapping, so loading them costs one open and no read copies.
+// Lookups and decodes only read the mapping and may run on several threads at once.
+class ImageArchive
+{
+public:
+    bool open(const std::string &path)
+    {
+        close();
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(ImageArchiveHeader))
+            return fail(path, "TRUNCATED");
+        ImageArchiveHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.identifier, IMAGE_ARCHIVE_IDENTIFIER, sizeof(IMAGE_ARCHIVE_IDENTIFIER)) != 0)
+            return fail(path, "INVALID_IDENTIFIER");
+
+        size_t names_start = sizeof(header) + sizeof(ImageArchiveEntry) * static_cast<size_t>(header.entry_count);
+        if (names_start + header.names_bytes > file.size())
+            return fail(path, "TRUNCATED");
+        const char *names = reinterpret_cast<const char*>(file.data() + names_start);
+        for (uint32_t i = 0; i < header.entry_count; i++)
+        {
+            ImageArchiveEntry entry;
+            std::memcpy(&entry, file.data() + sizeof(header) + sizeof(ImageArchiveEntry) * i, sizeof(entry));
+            if (static_cast<uint64_t>(entry.name_offset) + entry.name_size > header.names_bytes || entry.offset > file.size() || entry.size > file.size() - entry.offset)
+                return fail(path, "TRUNCATED");
+            entries[std::string(names + entry.name_offset, entry.name_size)] = entry;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        entries.clear();
+    }
+
+    bool is_open() const
+    {
+        return file.is_open();
+    }
+
+    std::vector<std::string> names() const
+    {
+        std::vector<std::string> result;
+        for (const auto &entry : entries)
+            result.push_back(entry.first);
+        return result;
+    }
+
+    bool contains(const std::string &name) const
+    {
+        return entries.count(name) > 0;
+    }
+
+    // The encoded file as stored, nullptr if the archive has no such entry.
+    const unsigned char *entry_data(const std::string &name, size_t &size) const
+    {
+        auto found = entries.find(name);
+        if (found == entries.end())
+        {
+            size = 0;
+            return nullptr;
+        }
+        size = static_cast<size_t>(found->second.size);
+        return file.data() + found->second.offset;
+    }
+
+    // Starts reading entries in ahead of their decode, e.g. everything a level needs.
+    void prefetch(const std::string &name) const
+    {
+        auto found = entries.find(name);
+        if (found != entries.end())
+            file.advise(ACCESS_WILL_NEED, static_cast<size_t>(found->second.offset), static_cast<size_t>(found->second.size));
+    }
+
+    // Whole archive, for decoding all or most of it in file order.
+    void prefetch_all() const
+    {
+        file.advise(ACCESS_SEQUENTIAL);
+        file.advise(ACCESS_WILL_NEED);
+    }
+
+    bool info(const std::string &name, int *width, int *height, int *channels) const
+    {
+        size_t size;
+        const unsigned char *data = entry_data(name, size);
+        return data && size <= static_cast<size_t>(INT_MAX) && stbi_info_from_memory(data, static_cast<int>(size), width, height, channels);
+    }
+
+    // Same as stbi_load for the named entry, free the pixels with stbi_image_free.
+    unsigned char *load(const std::string &name, int *width, int *height, int *channels, int desired_channels, int max_dimension = 0) const
+    {
+        size_t size;
+        const unsigned char *data = entry_data(name, size);
+        if (!data)
+            return nullptr;
+        prefetch(name);
+        return decode_image_in_arena(data, size, width, height, channels, desired_channels, max_dimension);
+    }
+
+    // Same as load_mapped_image_into for the named entry.
+    bool load_into(const std::string &name, unsigned char *destination, size_t destination_size, size_t pitch, int desired_channels, bool flip_vertically, int *width, int *height, int *channels) const
+    {
+        size_t size;
+        const unsigned char *data = entry_data(name, size);
+        if (!data)
+            return false;
+        prefetch(name);
+        return decode_image_into(data, size, destination, destination_size, pitch, desired_channels, flip_vertically, width, height, channels);
+    }
+
+private:
+    MappedFile file;
+    std::map<std::string, ImageArchiveEntry> entries;
+
+    bool fail(const std::string &path, const std::string &reason)
+    {
+        std::cout << "ERROR::IMAGE_ARCHIVE::" << reason << " " << path << "\n";
+        close();
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include "vertex_format.hpp"
+#include "mapped_file.hpp"
+#include "mesh_simplifier.hpp"
+
+// Binary mesh cache: header, then the vertex blob, the index blob and the LOD table, each aligned to MESH_CACHE_ALIGNMENT.
+// All fields are little-endian, the blobs are in the exact layout the vertex attributes read.
+// The index blob holds every level of detail back to back, the LOD table gives their ranges.
+const uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+const uint32_t MESH_CACHE_VERSION = 2;
+const uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t position_format;
+    uint32_t texture_coord_format;
+    uint32_t normal_format;
+    uint32_t stride;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_type;
+    uint32_t lod_count;
+    float bounds_min[3];
+    float bounds_max[3];
+    float dequantization[16];
+    uint64_t vertex_offset;
+    uint64_t vertex_size;
+    uint64_t index_offset;
+    uint64_t index_size;
+    uint64_t lod_offset;
+    uint64_t lod_size;
+};
+
+inline uint64_t align_mesh_cache_offset(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+inline bool write_mesh_cache(const std::string &path, const QuantizedMesh &mesh, const std::vector<uint32_t> &indices, std::vector<MeshLod> lods = std::vector<MeshLod>())
+{
+    if (lods.empty())
+        lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f, 0 });
+
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.position_format = mesh.position_format;
+    header.texture_coord_format = mesh.texture_coord_format;
+    header.normal_format = mesh.normal_format;
+    header.stride = mesh.stride;
+    header.vertex_count = mesh.vertex_count;
+    header.index_count = static_cast<uint32_t>(indices.size());
+    header.index_type = mesh.vertex_count <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    header.lod_count = static_cast<uint32_t>(lods.size());
+    for (int i = 0; i < 3; i++)
+    {
+        header.bounds_min[i] = mesh.bounds_min[i];
+        header.bounds_max[i] = mesh.bounds_max[i];
+    }
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+            header.dequantization[column * 4 + row] = mesh.dequantization[column][row];
+    }
+
+    std::vector<unsigned char> index_data;
+    if (header.index_type == GL_UNSIGNED_SHORT)
+    {
+        std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+        index_data.resize(short_indices.size() * sizeof(uint16_t));
+        if (!index_data.empty())
+            std::memcpy(index_data.data(), short_indices.data(), index_data.size());
+    }
+    else
+    {
+        index_data.resize(indices.size() * sizeof(uint32_t));
+        if (!index_data.empty())
+            std::memcpy(index_data.data(), indices.data(), index_data.size());
+    }
+
+    header.vertex_offset = align_mesh_cache_offset(sizeof(MeshCacheHeader));
+    header.vertex_size = mesh.size();
+    header.index_offset = align_mesh_cache_offset(header.vertex_offset + header.vertex_size);
+    header.index_size = index_data.size();
+    header.lod_offset = align_mesh_cache_offset(header.index_offset + header.index_size);
+    header.lod_size = lods.size() * sizeof(MeshLod);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::MESH_CACHE::FILE_NOT_SUCCESFULLY_WRITTEN " << path << "\n";
+        return false;
+    }
+
+    const char padding[MESH_CACHE_ALIGNMENT] = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padding, static_cast<std::streamsize>(header.vertex_offset - sizeof(header)));
+    file.write(reinterpret_cast<const char*>(mesh.data.data()), static_cast<std::streamsize>(header.vertex_size));
+    file.write(padding, static_cast<std::streamsize>(header.index_offset - header.vertex_offset - header.vertex_size));
+    file.write(reinterpret_cast<const char*>(index_data.data()), static_cast<std::streamsize>(header.index_size));
+    file.write(padding, static_cast<std::streamsize>(header.lod_offset - header.index_offset - header.index_size));
+    file.write(reinterpret_cast<const char*>(lods.data()), static_cast<std::streamsize>(header.lod_size));
+    return static_cast<bool>(file);
+}
+
+// Memory-mapped mesh cache. Buffers are filled straight from the mapping, nothing is parsed.
+class MeshCache
+{
+public:
+    MeshCacheHeader header;
+
+    MeshCache()
+    {
+        std::memset(&header, 0, sizeof(header));
+    }
+
+    bool load(const std::string &path)
+    {
+        if (!file.open(path))
+            return false;
+
+        if (file.size() < sizeof(MeshCacheHeader))
+        {
+            std::cout << "ERROR::MESH_CACHE::TRUNCATED " << path << "\n";
+            close();
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION)
+        {
+            std::cout << "ERROR::MESH_CACHE::VERSION_MISMATCH " << path << "\n";
+            close();
+            return false;
+        }
+        if (header.vertex_offset + header.vertex_size > file.size() || header.index_offset + header.index_size > file.size() ||
+            header.lod_offset + header.lod_size > file.size() || header.lod_size != header.lod_count * sizeof(MeshLod))
+        {
+            std::cout << "ERROR::MESH_CACHE::TRUNCATED " << path << "\n";
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    const void *vertex_data() const
+    {
+        return file.data() + header.vertex_offset;
+    }
+
+    const void *index_data() const
+    {
+        return file.data() + header.index_offset;
+    }
+
+    std::vector<MeshLod> lods() const
+    {
+        std::vector<MeshLod> table(header.lod_count);
+        if (!table.empty())
+            std::memcpy(table.data(), file.data() + header.lod_offset, header.lod_size);
+        return table;
+    }
+
+    glm::mat4 dequantization() const
+    {
+        glm::mat4 matrix(1.0f);
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+                matrix[column][row] = header.dequantization[column * 4 + row];
+        }
+        return matrix;
+    }
+
+    // Expects the target VAO, GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER to be bound.
+    void upload() const
+    {
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(header.vertex_size), vertex_data(), GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(header.index_size), index_data(), GL_STATIC_DRAW);
+        setup_vertex_attributes(static_cast<Position_Format>(header.position_format), static_cast<Texture_Coord_Format>(header.texture_coord_format),
+                                static_cast<Normal_Format>(header.normal_format), header.stride);
+    }
+
+    // The mapping is only needed until the buffers are filled.
+    void close()
+    {
+        file.close();
+    }
+
+private:
+    MappedFile file;
+};
+
+#endif
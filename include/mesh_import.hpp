@@ -0,0 +1,650 @@
+#ifndef MESH_IMPORT_HPP
+#define MESH_IMPORT_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+// Indexed mesh with interleaved float vertices: position, then optional texture coord and normal.
+struct ImportedMesh
+{
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    unsigned int stride = 3;
+    int texture_coord_offset = -1;
+    int normal_offset = -1;
+
+    unsigned int vertex_count() const
+    {
+        return stride == 0 ? 0 : static_cast<unsigned int>(vertices.size() / stride);
+    }
+};
+
+// Merges bitwise identical vertices of a non-indexed triangle list.
+inline ImportedMesh weld_vertices(const float *vertices, unsigned int vertex_count, unsigned int stride, int texture_coord_offset = -1, int normal_offset = -1)
+{
+    ImportedMesh mesh;
+    mesh.stride = stride;
+    mesh.texture_coord_offset = texture_coord_offset;
+    mesh.normal_offset = normal_offset;
+
+    std::map<std::vector<float>, uint32_t> unique_vertices;
+    for (unsigned int i = 0; i < vertex_count; i++)
+    {
+        std::vector<float> key(vertices + i * stride, vertices + (i + 1) * stride);
+        auto found = unique_vertices.find(key);
+        if (found == unique_vertices.end())
+        {
+            uint32_t index = mesh.vertex_count();
+            unique_vertices.emplace(key, index);
+            mesh.vertices.insert(mesh.vertices.end(), key.begin(), key.end());
+            mesh.indices.push_back(index);
+        }
+        else
+        {
+            mesh.indices.push_back(found->second);
+        }
+    }
+    return mesh;
+}
+
+inline bool read_file_bytes(const std::string &path, std::vector<unsigned char> &bytes)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    bytes.resize(static_cast<size_t>(size));
+    return size == 0 || static_cast<bool>(file.read(reinterpret_cast<char*>(bytes.data()), size));
+}
+
+inline bool load_obj(const std::string &path, ImportedMesh &mesh)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::MESH_IMPORT::FILE_NOT_SUCCESFULLY_READ " << path << "\n";
+        return false;
+    }
+
+    std::vector<float> positions, texture_coords, normals;
+    struct Corner { int position, texture_coord, normal; };
+    std::vector<Corner> corners;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string type;
+        stream >> type;
+        if (type == "v")
+        {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            stream >> x >> y >> z;
+            positions.insert(positions.end(), { x, y, z });
+        }
+        else if (type == "vt")
+        {
+            float u = 0.0f, v = 0.0f;
+            stream >> u >> v;
+            texture_coords.insert(texture_coords.end(), { u, v });
+        }
+        else if (type == "vn")
+        {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            stream >> x >> y >> z;
+            normals.insert(normals.end(), { x, y, z });
+        }
+        else if (type == "f")
+        {
+            std::vector<Corner> face;
+            std::string token;
+            while (stream >> token)
+            {
+                Corner corner = { 0, 0, 0 };
+                int *fields[3] = { &corner.position, &corner.texture_coord, &corner.normal };
+                int counts[3] = { static_cast<int>(positions.size() / 3), static_cast<int>(texture_coords.size() / 2), static_cast<int>(normals.size() / 3) };
+                size_t start = 0;
+                for (int field = 0; field < 3 && start <= token.size(); field++)
+                {
+                    size_t end = token.find('/', start);
+                    std::string value = token.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                    if (!value.empty())
+                    {
+                        int index = std::atoi(value.c_str());
+                        *fields[field] = index < 0 ? counts[field] + index + 1 : index;
+                    }
+                    if (end == std::string::npos)
+                        break;
+                    start = end + 1;
+                }
+                face.push_back(corner);
+            }
+            for (size_t i = 2; i < face.size(); i++)
+            {
+                corners.push_back(face[0]);
+                corners.push_back(face[i - 1]);
+                corners.push_back(face[i]);
+            }
+        }
+    }
+
+    bool has_texture_coords = !texture_coords.empty();
+    bool has_normals = !normals.empty();
+    mesh = ImportedMesh();
+    mesh.stride = 3;
+    if (has_texture_coords)
+    {
+        mesh.texture_coord_offset = static_cast<int>(mesh.stride);
+        mesh.stride += 2;
+    }
+    if (has_normals)
+    {
+        mesh.normal_offset = static_cast<int>(mesh.stride);
+        mesh.stride += 3;
+    }
+
+    std::map<std::tuple<int, int, int>, uint32_t> unique_corners;
+    for (const Corner &corner : corners)
+    {
+        if (corner.position < 1 || corner.position > static_cast<int>(positions.size() / 3))
+        {
+            std::cout << "ERROR::MESH_IMPORT::INVALID_INDEX " << path << "\n";
+            return false;
+        }
+        auto key = std::make_tuple(corner.position, corner.texture_coord, corner.normal);
+        auto found = unique_corners.find(key);
+        if (found != unique_corners.end())
+        {
+            mesh.indices.push_back(found->second);
+            continue;
+        }
+
+        uint32_t index = mesh.vertex_count();
+        const float *position = &positions[(corner.position - 1) * 3];
+        mesh.vertices.insert(mesh.vertices.end(), position, position + 3);
+        if (has_texture_coords)
+        {
+            bool valid = corner.texture_coord >= 1 && corner.texture_coord <= static_cast<int>(texture_coords.size() / 2);
+            mesh.vertices.push_back(valid ? texture_coords[(corner.texture_coord - 1) * 2] : 0.0f);
+            mesh.vertices.push_back(valid ? texture_coords[(corner.texture_coord - 1) * 2 + 1] : 0.0f);
+        }
+        if (has_normals)
+        {
+            bool valid = corner.normal >= 1 && corner.normal <= static_cast<int>(normals.size() / 3);
+            for (int i = 0; i < 3; i++)
+                mesh.vertices.push_back(valid ? normals[(corner.normal - 1) * 3 + i] : 0.0f);
+        }
+        unique_corners.emplace(key, index);
+        mesh.indices.push_back(index);
+    }
+    return !mesh.indices.empty();
+}
+
+// Minimal JSON reader, enough for glTF documents.
+class JsonValue
+{
+public:
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    static bool parse(const std::string &text, JsonValue &value)
+    {
+        size_t position = 0;
+        if (!parse_value(text, position, value))
+            return false;
+        skip_whitespace(text, position);
+        return position == text.size();
+    }
+
+    bool has(const std::string &key) const
+    {
+        return type == OBJECT && object.count(key) != 0;
+    }
+
+    const JsonValue &operator[](const std::string &key) const
+    {
+        static const JsonValue null_value;
+        auto found = object.find(key);
+        return found == object.end() ? null_value : found->second;
+    }
+
+    const JsonValue &operator[](size_t index) const
+    {
+        static const JsonValue null_value;
+        return index < array.size() ? array[index] : null_value;
+    }
+
+    double number_or(double fallback) const
+    {
+        return type == NUMBER ? number : fallback;
+    }
+
+private:
+    static void skip_whitespace(const std::string &text, size_t &position)
+    {
+        while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+            position++;
+    }
+
+    static bool parse_string(const std::string &text, size_t &position, std::string &result)
+    {
+        if (position >= text.size() || text[position] != '"')
+            return false;
+        position++;
+        result.clear();
+        while (position < text.size() && text[position] != '"')
+        {
+            char c = text[position++];
+            if (c != '\\')
+            {
+                result.push_back(c);
+                continue;
+            }
+            if (position >= text.size())
+                return false;
+            char escape = text[position++];
+            switch (escape)
+            {
+            case 'n': result.push_back('\n'); break;
+            case 't': result.push_back('\t'); break;
+            case 'r': result.push_back('\r'); break;
+            case 'b': result.push_back('\b'); break;
+            case 'f': result.push_back('\f'); break;
+            case 'u':
+            {
+                if (position + 4 > text.size())
+                    return false;
+                unsigned long code = std::strtoul(text.substr(position, 4).c_str(), nullptr, 16);
+                position += 4;
+                if (code < 0x80)
+                {
+                    result.push_back(static_cast<char>(code));
+                }
+                else if (code < 0x800)
+                {
+                    result.push_back(static_cast<char>(0xc0 | (code >> 6)));
+                    result.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                }
+                else
+                {
+                    result.push_back(static_cast<char>(0xe0 | (code >> 12)));
+                    result.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                    result.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                }
+                break;
+            }
+            default: result.push_back(escape); break;
+            }
+        }
+        if (position >= text.size())
+            return false;
+        position++;
+        return true;
+    }
+
+    static bool parse_value(const std::string &text, size_t &position, JsonValue &value)
+    {
+        skip_whitespace(text, position);
+        if (position >= text.size())
+            return false;
+
+        char c = text[position];
+        if (c == '{')
+        {
+            value.type = OBJECT;
+            position++;
+            skip_whitespace(text, position);
+            if (position < text.size() && text[position] == '}')
+            {
+                position++;
+                return true;
+            }
+            while (true)
+            {
+                std::string key;
+                skip_whitespace(text, position);
+                if (!parse_string(text, position, key))
+                    return false;
+                skip_whitespace(text, position);
+                if (position >= text.size() || text[position] != ':')
+                    return false;
+                position++;
+                if (!parse_value(text, position, value.object[key]))
+                    return false;
+                skip_whitespace(text, position);
+                if (position < text.size() && text[position] == ',')
+                {
+                    position++;
+                    continue;
+                }
+                if (position < text.size() && text[position] == '}')
+                {
+                    position++;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '[')
+        {
+            value.type = ARRAY;
+            position++;
+            skip_whitespace(text, position);
+            if (position < text.size() && text[position] == ']')
+            {
+                position++;
+                return true;
+            }
+            while (true)
+            {
+                value.array.emplace_back();
+                if (!parse_value(text, position, value.array.back()))
+                    return false;
+                skip_whitespace(text, position);
+                if (position < text.size() && text[position] == ',')
+                {
+                    position++;
+                    continue;
+                }
+                if (position < text.size() && text[position] == ']')
+                {
+                    position++;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '"')
+        {
+            value.type = STRING;
+            return parse_string(text, position, value.string);
+        }
+        if (text.compare(position, 4, "true") == 0)
+        {
+            value.type = BOOLEAN;
+            value.boolean = true;
+            position += 4;
+            return true;
+        }
+        if (text.compare(position, 5, "false") == 0)
+        {
+            value.type = BOOLEAN;
+            position += 5;
+            return true;
+        }
+        if (text.compare(position, 4, "null") == 0)
+        {
+            position += 4;
+            return true;
+        }
+
+        const char *start = text.c_str() + position;
+        char *end = nullptr;
+        value.number = std::strtod(start, &end);
+        if (end == start)
+            return false;
+        value.type = NUMBER;
+        position += static_cast<size_t>(end - start);
+        return true;
+    }
+};
+
+inline bool decode_base64(const std::string &text, std::vector<unsigned char> &bytes)
+{
+    bytes.clear();
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for (char c : text)
+    {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+' || c == '-') value = 62;
+        else if (c == '/' || c == '_') value = 63;
+        else if (c == '=') break;
+        else continue;
+        accumulator = (accumulator << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            bytes.push_back(static_cast<unsigned char>((accumulator >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+// Reads accessor elements converted to T, normalized integer types are mapped to [0, 1] or [-1, 1].
+template <typename T>
+bool read_gltf_accessor(const JsonValue &document, const std::vector<std::vector<unsigned char>> &buffers, size_t accessor_index, unsigned int components, std::vector<T> &values)
+{
+    const JsonValue &accessor = document["accessors"][accessor_index];
+    if (accessor.type != JsonValue::OBJECT || !accessor.has("bufferView"))
+        return false;
+    const JsonValue &view = document["bufferViews"][static_cast<size_t>(accessor["bufferView"].number)];
+    size_t buffer_index = static_cast<size_t>(view["buffer"].number_or(0));
+    if (buffer_index >= buffers.size())
+        return false;
+    const std::vector<unsigned char> &buffer = buffers[buffer_index];
+
+    int component_type = static_cast<int>(accessor["componentType"].number);
+    size_t component_size;
+    switch (component_type)
+    {
+    case 5120: case 5121: component_size = 1; break;
+    case 5122: case 5123: component_size = 2; break;
+    case 5125: case 5126: component_size = 4; break;
+    default: return false;
+    }
+    bool normalized = accessor["normalized"].boolean;
+    size_t count = static_cast<size_t>(accessor["count"].number);
+    size_t offset = static_cast<size_t>(view["byteOffset"].number_or(0)) + static_cast<size_t>(accessor["byteOffset"].number_or(0));
+    size_t element_stride = static_cast<size_t>(view["byteStride"].number_or(0));
+    if (element_stride == 0)
+        element_stride = component_size * components;
+    if (count > 0 && offset + (count - 1) * element_stride + component_size * components > buffer.size())
+        return false;
+
+    values.resize(count * components);
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *element = buffer.data() + offset + i * element_stride;
+        for (unsigned int c = 0; c < components; c++)
+        {
+            const unsigned char *source = element + c * component_size;
+            double value = 0.0;
+            switch (component_type)
+            {
+            case 5120: { int8_t v; std::memcpy(&v, source, 1); value = normalized ? std::max(v / 127.0, -1.0) : v; break; }
+            case 5121: { uint8_t v; std::memcpy(&v, source, 1); value = normalized ? v / 255.0 : v; break; }
+            case 5122: { int16_t v; std::memcpy(&v, source, 2); value = normalized ? std::max(v / 32767.0, -1.0) : v; break; }
+            case 5123: { uint16_t v; std::memcpy(&v, source, 2); value = normalized ? v / 65535.0 : v; break; }
+            case 5125: { uint32_t v; std::memcpy(&v, source, 4); value = v; break; }
+            case 5126: { float v; std::memcpy(&v, source, 4); value = v; break; }
+            }
+            values[i * components + c] = static_cast<T>(value);
+        }
+    }
+    return true;
+}
+
+// Imports every triangle primitive of every mesh in a .gltf or .glb file, in mesh-local space.
+inline bool load_gltf(const std::string &path, ImportedMesh &mesh)
+{
+    std::vector<unsigned char> file;
+    if (!read_file_bytes(path, file))
+    {
+        std::cout << "ERROR::MESH_IMPORT::FILE_NOT_SUCCESFULLY_READ " << path << "\n";
+        return false;
+    }
+
+    std::string json_text;
+    std::vector<unsigned char> binary_chunk;
+    const uint32_t glb_magic = 0x46546c67;
+    uint32_t magic = 0;
+    if (file.size() >= 12)
+        std::memcpy(&magic, file.data(), 4);
+    if (magic == glb_magic)
+    {
+        size_t position = 12;
+        while (position + 8 <= file.size())
+        {
+            uint32_t chunk_length, chunk_type;
+            std::memcpy(&chunk_length, file.data() + position, 4);
+            std::memcpy(&chunk_type, file.data() + position + 4, 4);
+            position += 8;
+            if (position + chunk_length > file.size())
+                break;
+            if (chunk_type == 0x4e4f534a)
+                json_text.assign(reinterpret_cast<const char*>(file.data() + position), chunk_length);
+            else if (chunk_type == 0x004e4942)
+                binary_chunk.assign(file.data() + position, file.data() + position + chunk_length);
+            position += (chunk_length + 3) & ~3u;
+        }
+    }
+    else
+    {
+        json_text.assign(file.begin(), file.end());
+    }
+
+    JsonValue document;
+    if (!JsonValue::parse(json_text, document))
+    {
+        std::cout << "ERROR::MESH_IMPORT::INVALID_JSON " << path << "\n";
+        return false;
+    }
+
+    std::string directory;
+    size_t slash = path.find_last_of("/\\");
+    if (slash != std::string::npos)
+        directory = path.substr(0, slash + 1);
+
+    std::vector<std::vector<unsigned char>> buffers;
+    for (const JsonValue &buffer : document["buffers"].array)
+    {
+        buffers.emplace_back();
+        if (!buffer.has("uri"))
+        {
+            buffers.back() = binary_chunk;
+            continue;
+        }
+        const std::string &uri = buffer["uri"].string;
+        if (uri.compare(0, 5, "data:") == 0)
+        {
+            size_t comma = uri.find(',');
+            if (comma == std::string::npos || !decode_base64(uri.substr(comma + 1), buffers.back()))
+                return false;
+        }
+        else if (!read_file_bytes(directory + uri, buffers.back()))
+        {
+            std::cout << "ERROR::MESH_IMPORT::FILE_NOT_SUCCESFULLY_READ " << directory + uri << "\n";
+            return false;
+        }
+    }
+
+    // Decide the layout from the first primitive, the rest must match it.
+    bool has_texture_coords = false, has_normals = false, first = true;
+    mesh = ImportedMesh();
+    for (const JsonValue &gltf_mesh : document["meshes"].array)
+    {
+        for (const JsonValue &primitive : gltf_mesh["primitives"].array)
+        {
+            if (primitive["mode"].number_or(4) != 4)
+                continue;
+            const JsonValue &attributes = primitive["attributes"];
+            if (!attributes.has("POSITION"))
+                continue;
+            if (first)
+            {
+                has_texture_coords = attributes.has("TEXCOORD_0");
+                has_normals = attributes.has("NORMAL");
+                mesh.stride = 3;
+                if (has_texture_coords)
+                {
+                    mesh.texture_coord_offset = static_cast<int>(mesh.stride);
+                    mesh.stride += 2;
+                }
+                if (has_normals)
+                {
+                    mesh.normal_offset = static_cast<int>(mesh.stride);
+                    mesh.stride += 3;
+                }
+                first = false;
+            }
+
+            std::vector<float> positions, texture_coords, normals;
+            std::vector<uint32_t> indices;
+            if (!read_gltf_accessor(document, buffers, static_cast<size_t>(attributes["POSITION"].number), 3, positions))
+                return false;
+            size_t vertex_count = positions.size() / 3;
+            if (has_texture_coords && (!attributes.has("TEXCOORD_0") || !read_gltf_accessor(document, buffers, static_cast<size_t>(attributes["TEXCOORD_0"].number), 2, texture_coords)))
+                texture_coords.assign(vertex_count * 2, 0.0f);
+            if (has_normals && (!attributes.has("NORMAL") || !read_gltf_accessor(document, buffers, static_cast<size_t>(attributes["NORMAL"].number), 3, normals)))
+                normals.assign(vertex_count * 3, 0.0f);
+            if (primitive.has("indices"))
+            {
+                if (!read_gltf_accessor(document, buffers, static_cast<size_t>(primitive["indices"].number), 1, indices))
+                    return false;
+            }
+            else
+            {
+                for (size_t i = 0; i < vertex_count; i++)
+                    indices.push_back(static_cast<uint32_t>(i));
+            }
+
+            uint32_t base = mesh.vertex_count();
+            for (size_t i = 0; i < vertex_count; i++)
+            {
+                mesh.vertices.insert(mesh.vertices.end(), positions.begin() + i * 3, positions.begin() + i * 3 + 3);
+                if (has_texture_coords)
+                {
+                    // glTF puts the texture origin at the top left, OpenGL at the bottom left
+                    mesh.vertices.push_back(texture_coords[i * 2]);
+                    mesh.vertices.push_back(1.0f - texture_coords[i * 2 + 1]);
+                }
+                if (has_normals)
+                    mesh.vertices.insert(mesh.vertices.end(), normals.begin() + i * 3, normals.begin() + i * 3 + 3);
+            }
+            for (uint32_t index : indices)
+            {
+                if (index >= vertex_count)
+                    return false;
+                mesh.indices.push_back(base + index);
+            }
+        }
+    }
+    return !mesh.indices.empty();
+}
+
+inline bool load_mesh(const std::string &path, ImportedMesh &mesh)
+{
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    for (char &c : extension)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (extension == "obj")
+        return load_obj(path, mesh);
+    if (extension == "gltf" || extension == "glb")
+        return load_gltf(path, mesh);
+    std::cout << "ERROR::MESH_IMPORT::UNKNOWN_FORMAT " << path << "\n";
+    return false;
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef MESH_SIMPLIFIER_HPP
+#define MESH_SIMPLIFIER_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+// Range of the shared index buffer holding one level of detail. error is in object-space units.
+struct MeshLod
+{
+    uint32_t index_offset;
+    uint32_t index_count;
+    float error;
+    uint32_t reserved;
+};
+
+// Symmetric 4x4 plane quadric, stored as its 10 unique coefficients.
+struct Quadric
+{
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    static Quadric from_plane(double a, double b, double c, double d, double weight)
+    {
+        Quadric q;
+        q.a2 = a * a * weight; q.ab = a * b * weight; q.ac = a * c * weight; q.ad = a * d * weight;
+        q.b2 = b * b * weight; q.bc = b * c * weight; q.bd = b * d * weight;
+        q.c2 = c * c * weight; q.cd = c * d * weight;
+        q.d2 = d * d * weight;
+        return q;
+    }
+
+    Quadric &operator+=(const Quadric &o)
+    {
+        a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+        b2 += o.b2; bc += o.bc; bd += o.bd;
+        c2 += o.c2; cd += o.cd;
+        d2 += o.d2;
+        return *this;
+    }
+
+    double evaluate(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double result = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                      + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                      + c2 * z * z + 2 * cd * z
+                      + d2;
+        return std::max(result, 0.0);
+    }
+};
+
+// Quadric error metric simplifier using half-edge collapses, so every LOD indexes the original vertex buffer.
+// Vertices on open borders and attribute seams are locked to keep silhouettes and texture mapping intact.
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const float *vertices_value, unsigned int vertex_count_value, unsigned int stride_value) : vertices(vertices_value), vertex_count(vertex_count_value), stride(stride_value)
+    {
+        build_position_groups();
+    }
+
+    // Collapses edges until the index count reaches target_index_count or the next collapse would exceed target_error.
+    std::vector<uint32_t> simplify(const std::vector<uint32_t> &indices, size_t target_index_count, float target_error, float &result_error) const
+    {
+        std::vector<uint32_t> result = indices;
+        std::vector<uint32_t> remap(vertex_count);
+        for (unsigned int i = 0; i < vertex_count; i++)
+            remap[i] = i;
+
+        std::vector<Quadric> quadrics(vertex_count);
+        for (size_t i = 0; i + 2 < result.size(); i += 3)
+        {
+            glm::vec3 p0 = position(result[i]), p1 = position(result[i + 1]), p2 = position(result[i + 2]);
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            if (area <= 0.0f)
+                continue;
+            normal = normal / area;
+            Quadric q = Quadric::from_plane(normal.x, normal.y, normal.z, -glm::dot(normal, p0), 1.0);
+            for (int j = 0; j < 3; j++)
+                quadrics[result[i + j]] += q;
+        }
+        // Vertices sharing a position accumulate the same quadric.
+        for (unsigned int i = 0; i < vertex_count; i++)
+        {
+            if (position_group[i] != i)
+                quadrics[position_group[i]] += quadrics[i];
+        }
+        for (unsigned int i = 0; i < vertex_count; i++)
+            quadrics[i] = quadrics[position_group[i]];
+
+        std::vector<bool> locked = find_locked_vertices(result);
+
+        result_error = 0.0f;
+        double error_limit = static_cast<double>(target_error) * target_error;
+        while (result.size() > target_index_count)
+        {
+            struct Collapse { uint32_t from, to; double cost; };
+            std::vector<Collapse> collapses;
+            for (size_t i = 0; i + 2 < result.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    uint32_t a = result[i + e], b = result[i + (e + 1) % 3];
+                    if (!locked[a])
+                        collapses.push_back({ a, b, quadrics[a].evaluate(position(b)) });
+                    if (!locked[b])
+                        collapses.push_back({ b, a, quadrics[b].evaluate(position(a)) });
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &l, const Collapse &r) { return l.cost < r.cost; });
+
+            std::vector<std::vector<uint32_t>> vertex_triangles(vertex_count);
+            for (size_t i = 0; i + 2 < result.size(); i += 3)
+            {
+                for (int j = 0; j < 3; j++)
+                    vertex_triangles[result[i + j]].push_back(static_cast<uint32_t>(i));
+            }
+
+            std::vector<bool> touched(vertex_count, false);
+            size_t triangles_to_remove = (result.size() - target_index_count + 2) / 3;
+            size_t removed = 0;
+            bool collapsed = false;
+            for (const Collapse &collapse : collapses)
+            {
+                if (collapse.cost > error_limit || removed >= triangles_to_remove)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to] || remap[collapse.from] != collapse.from)
+                    continue;
+                if (flips_triangles(result, vertex_triangles[collapse.from], collapse.from, collapse.to))
+                    continue;
+
+                for (uint32_t triangle : vertex_triangles[collapse.from])
+                {
+                    for (int j = 0; j < 3; j++)
+                        touched[result[triangle + j]] = true;
+                    for (int j = 0; j < 3; j++)
+                    {
+                        if (result[triangle + j] == collapse.to)
+                        {
+                            removed++;
+                            break;
+                        }
+                    }
+                }
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                result_error = std::max(result_error, static_cast<float>(std::sqrt(collapse.cost)));
+                collapsed = true;
+            }
+            if (!collapsed)
+                break;
+
+            std::vector<uint32_t> compacted;
+            compacted.reserve(result.size());
+            for (size_t i = 0; i + 2 < result.size(); i += 3)
+            {
+                uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                compacted.push_back(a);
+                compacted.push_back(b);
+                compacted.push_back(c);
+            }
+            result.swap(compacted);
+        }
+        return result;
+    }
+
+    // Replaces indices with the concatenation of all levels, level 0 first, and returns the level table.
+    // Each level targets half the triangles of the previous one within the next error bound.
+    std::vector<MeshLod> build_lod_chain(std::vector<uint32_t> &indices, const std::vector<float> &error_bounds, float min_reduction = 0.8f) const
+    {
+        std::vector<MeshLod> lods;
+        std::vector<uint32_t> chain = indices;
+        lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f, 0 });
+
+        std::vector<uint32_t> previous = indices;
+        for (float error_bound : error_bounds)
+        {
+            float error = 0.0f;
+            std::vector<uint32_t> level = simplify(previous, previous.size() / 2 / 3 * 3, error_bound, error);
+            if (level.empty() || level.size() > previous.size() * min_reduction)
+                continue;
+
+            MeshLod lod;
+            lod.index_offset = static_cast<uint32_t>(chain.size());
+            lod.index_count = static_cast<uint32_t>(level.size());
+            lod.error = std::max(error, lods.back().error);
+            lod.reserved = 0;
+            lods.push_back(lod);
+            chain.insert(chain.end(), level.begin(), level.end());
+            previous.swap(level);
+        }
+        indices.swap(chain);
+        return lods;
+    }
+
+private:
+    const float *vertices;
+    unsigned int vertex_count;
+    unsigned int stride;
+    std::vector<uint32_t> position_group;
+
+    glm::vec3 position(uint32_t index) const
+    {
+        const float *vertex = vertices + static_cast<size_t>(index) * stride;
+        return glm::vec3(vertex[0], vertex[1], vertex[2]);
+    }
+
+    void build_position_groups()
+    {
+        position_group.resize(vertex_count);
+        std::map<std::tuple<float, float, float>, uint32_t> first_vertex;
+        for (unsigned int i = 0; i < vertex_count; i++)
+        {
+            const float *vertex = vertices + static_cast<size_t>(i) * stride;
+            auto key = std::make_tuple(vertex[0], vertex[1], vertex[2]);
+            auto found = first_vertex.emplace(key, i);
+            position_group[i] = found.first->second;
+        }
+    }
+
+    std::vector<bool> find_locked_vertices(const std::vector<uint32_t> &indices) const
+    {
+        std::vector<bool> locked(vertex_count, false);
+
+        // An edge used by only one triangle (counted by vertex index) is an open border or an attribute seam.
+        std::map<std::pair<uint32_t, uint32_t>, int> edge_use;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                uint32_t a = indices[i + e], b = indices[i + (e + 1) % 3];
+                edge_use[std::make_pair(std::min(a, b), std::max(a, b))]++;
+            }
+        }
+        for (const auto &edge : edge_use)
+        {
+            if (edge.second == 1)
+            {
+                locked[edge.first.first] = true;
+                locked[edge.first.second] = true;
+            }
+        }
+
+        // Vertices split for attributes must move together, lock every copy.
+        std::vector<int> group_size(vertex_count, 0);
+        for (unsigned int i = 0; i < vertex_count; i++)
+            group_size[position_group[i]]++;
+        for (unsigned int i = 0; i < vertex_count; i++)
+        {
+            if (group_size[position_group[i]] > 1)
+                locked[i] = true;
+        }
+        return locked;
+    }
+
+    bool flips_triangles(const std::vector<uint32_t> &indices, const std::vector<uint32_t> &triangles, uint32_t from, uint32_t to) const
+    {
+        for (uint32_t triangle : triangles)
+        {
+            uint32_t corners[3] = { indices[triangle], indices[triangle + 1], indices[triangle + 2] };
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+                continue;
+
+            glm::vec3 before = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+            for (int j = 0; j < 3; j++)
+            {
+                if (corners[j] == from)
+                    corners[j] = to;
+            }
+            glm::vec3 after = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif
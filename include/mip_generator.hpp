@@ -0,0 +1,248 @@
+#ifndef MIP_GENERATOR_HPP
+#define MIP_GENERATOR_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "thread_pool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define MIP_GENERATOR_AVX2
+#include <immintrin.h>
+#endif
+
+// One level of a mip chain. Rows are padded to 4 bytes, which is both the default
+// GL_UNPACK_ALIGNMENT and the row alignment KTX requires for uncompressed data.
+struct MipLevel
+{
+    int width = 0;
+    int height = 0;
+    size_t pitch = 0;
+    std::vector<unsigned char> data;
+};
+
+inline size_t mip_pitch(int width, int channels)
+{
+    return (static_cast<size_t>(width) * channels + 3) & ~static_cast<size_t>(3);
+}
+
+inline int mip_level_count(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+inline const float *srgb_to_linear_table()
+{
+    static const std::vector<float> table = []() {
+        std::vector<float> values(256);
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+inline unsigned char linear_to_srgb(float value)
+{
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(c * 255.0f + 0.5f);
+}
+
+// Averages 2x2 texels of a float RGBA image. Odd sizes drop the last row or column like GL does,
+// a dimension of 1 repeats its only texel.
+inline void downsample_rgba_row(const float *source, int source_width, int source_height, float *row, int width, int y)
+{
+    const float *row0 = source + static_cast<size_t>(std::min(y * 2, source_height - 1)) * source_width * 4;
+    const float *row1 = source + static_cast<size_t>(std::min(y * 2 + 1, source_height - 1)) * source_width * 4;
+    int x = 0;
+    if (source_width >= 2)
+    {
+#ifdef MIP_GENERATOR_AVX2
+        const __m256 quarter8 = _mm256_set1_ps(0.25f);
+        for (; x + 2 <= width; x += 2)
+        {
+            __m256 left = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+            __m256 right = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+            __m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(left, right, 0x20), _mm256_permute2f128_ps(left, right, 0x31));
+            _mm256_storeu_ps(row + x * 4, _mm256_mul_ps(sum, quarter8));
+        }
+#endif
+#ifdef MIP_GENERATOR_SSE2
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for (; x < width; x++)
+        {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4)),
+                                    _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4)));
+            _mm_storeu_ps(row + x * 4, _mm_mul_ps(sum, quarter));
+        }
+#endif
+    }
+    for (; x < width; x++)
+    {
+        int x0 = std::min(x * 2, source_width - 1) * 4;
+        int x1 = std::min(x * 2 + 1, source_width - 1) * 4;
+        for (int c = 0; c < 4; c++)
+            row[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+    }
+}
+
+// Fills in levels 1 and up of a chain whose level 0 is already in place, e.g. decoded straight into it.
+// With srgb the color channels are filtered in linear light, alpha always stays linear.
+// With alpha_weighted colors are averaged premultiplied, so transparent texels do not bleed their color.
+// Channels follow stb_image: 1 grey, 2 grey and alpha, 3 RGB, 4 RGBA.
+// Rows of each level are split across the pool when one is given.
+inline void generate_mip_levels(std::vector<MipLevel> &levels, int channels, bool srgb, bool alpha_weighted = true, ThreadPool *pool = nullptr)
+{
+    const int color_channels = channels >= 3 ? 3 : 1;
+    const int alpha_channel = channels == 4 ? 3 : (channels == 2 ? 1 : -1);
+    const float *to_linear = srgb_to_linear_table();
+    alpha_weighted = alpha_weighted && alpha_channel >= 0;
+
+    auto for_rows = [pool](int rows, auto function) {
+        if (pool && rows > 1)
+            pool->parallel_for(0, static_cast<size_t>(rows), [&function](size_t y) { function(static_cast<int>(y)); }, 16);
+        else
+            for (int y = 0; y < rows; y++)
+                function(y);
+    };
+
+    const int width = levels[0].width;
+    const int height = levels[0].height;
+    levels.resize(static_cast<size_t>(mip_level_count(width, height)));
+    if (levels.size() == 1)
+        return;
+    const unsigned char *pixels = levels[0].data.data();
+    const size_t pitch = levels[0].pitch;
+
+    // Filtering runs on linear, optionally premultiplied RGBA floats so every texel is one SIMD register.
+    std::vector<float> current(static_cast<size_t>(width) * height * 4);
+    for_rows(height, [&](int y) {
+        const unsigned char *source = pixels + pitch * y;
+        float *row = current.data() + static_cast<size_t>(width) * 4 * y;
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *texel = source + x * channels;
+            float alpha = alpha_channel >= 0 ? texel[alpha_channel] / 255.0f : 1.0f;
+            float weight = alpha_weighted ? alpha : 1.0f;
+            for (int c = 0; c < color_channels; c++)
+                row[x * 4 + c] = (srgb ? to_linear[texel[c]] : texel[c] / 255.0f) * weight;
+            for (int c = color_channels; c < 3; c++)
+                row[x * 4 + c] = 0.0f;
+            row[x * 4 + 3] = alpha;
+        }
+    });
+
+    std::vector<float> next;
+    int current_width = width, current_height = height;
+    for (size_t level = 1; level < levels.size(); level++)
+    {
+        MipLevel &mip = levels[level];
+        mip.width = std::max(1, current_width / 2);
+        mip.height = std::max(1, current_height / 2);
+        mip.pitch = mip_pitch(mip.width, channels);
+        mip.data.resize(mip.pitch * mip.height);
+        next.resize(static_cast<size_t>(mip.width) * mip.height * 4);
+
+        for_rows(mip.height, [&](int y) {
+            float *row = next.data() + static_cast<size_t>(mip.width) * 4 * y;
+            downsample_rgba_row(current.data(), current_width, current_height, row, mip.width, y);
+
+            unsigned char *target = mip.data.data() + mip.pitch * y;
+            for (int x = 0; x < mip.width; x++)
+            {
+                const float *texel = row + x * 4;
+                float alpha = texel[3];
+                float weight = alpha_weighted && alpha > 0.0f ? 1.0f / alpha : 1.0f;
+                for (int c = 0; c < color_channels; c++)
+                {
+                    float value = texel[c] * weight;
+                    target[x * channels + c] = srgb ? linear_to_srgb(value) : static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+                }
+                if (alpha_channel >= 0)
+                    target[x * channels + alpha_channel] = static_cast<unsigned char>(std::min(std::max(alpha, 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+        });
+
+        current.swap(next);
+        current_width = mip.width;
+        current_height = mip.height;
+    }
+}
+
+// Builds the full mip chain of an 8-bit image with tightly packed rows, level 0 included.
+inline std::vector<MipLevel> generate_mip_chain(const unsigned char *pixels, int width, int height, int channels, bool srgb, bool alpha_weighted = true, ThreadPool *pool = nullptr)
+{
+    std::vector<MipLevel> levels(1);
+    MipLevel &base = levels[0];
+    base.width = width;
+    base.height = height;
+    base.pitch = mip_pitch(width, channels);
+    base.data.resize(base.pitch * height);
+    for (int y = 0; y < height; y++)
+        std::memcpy(base.data.data() + base.pitch * y, pixels + static_cast<size_t>(width) * channels * y, static_cast<size_t>(width) * channels);
+    generate_mip_levels(levels, channels, srgb, alpha_weighted, pool);
+    return levels;
+}
+
+// Copies an 8-bit image with tightly packed rows into a level of exactly width by height, bilinearly
+// resampled when the sizes differ. For images decoded to roughly a mip size, so the difference is a texel
+// or two and filtering in the stored encoding is close enough.
+inline MipLevel resample_level(const unsigned char *pixels, int source_width, int source_height, int channels, int width, int height)
+{
+    MipLevel level;
+    level.width = width;
+    level.height = height;
+    level.pitch = mip_pitch(width, channels);
+    level.data.resize(level.pitch * height);
+    const size_t source_pitch = static_cast<size_t>(source_width) * channels;
+    if (source_width == width && source_height == height)
+    {
+        for (int y = 0; y < height; y++)
+            std::memcpy(level.data.data() + level.pitch * y, pixels + source_pitch * y, source_pitch);
+        return level;
+    }
+    const float scale_x = static_cast<float>(source_width) / width;
+    const float scale_y = static_cast<float>(source_height) / height;
+    for (int y = 0; y < height; y++)
+    {
+        float source_y = std::min(std::max((y + 0.5f) * scale_y - 0.5f, 0.0f), static_cast<float>(source_height - 1));
+        int y0 = static_cast<int>(source_y);
+        int y1 = std::min(y0 + 1, source_height - 1);
+        float fy = source_y - y0;
+        unsigned char *target = level.data.data() + level.pitch * y;
+        for (int x = 0; x < width; x++)
+        {
+            float source_x = std::min(std::max((x + 0.5f) * scale_x - 0.5f, 0.0f), static_cast<float>(source_width - 1));
+            int x0 = static_cast<int>(source_x);
+            int x1 = std::min(x0 + 1, source_width - 1);
+            float fx = source_x - x0;
+            for (int c = 0; c < channels; c++)
+            {
+                float top = pixels[source_pitch * y0 + x0 * channels + c] * (1.0f - fx) + pixels[source_pitch * y0 + x1 * channels + c] * fx;
+                float bottom = pixels[source_pitch * y1 + x0 * channels + c] * (1.0f - fx) + pixels[source_pitch * y1 + x1 * channels + c] * fx;
+                target[x * channels + c] = static_cast<unsigned char>(top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return level;
+}
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "thread_pool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+const int OCCLUSION_TILE_SIZE = 32;
+
+// Software occlusion culling: large occluders are rasterized into a low resolution depth buffer,
+// which is reduced into a max-depth pyramid that instance bounding boxes are tested against.
+// Depth is window-space z in [0, 1] with 1 as the far plane. Occluders and tests run on the pool.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(ThreadPool &pool_value, int width_value = OCCLUSION_WIDTH, int height_value = OCCLUSION_HEIGHT) : pool(pool_value)
+    {
+        width = (width_value + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE;
+        height = (height_value + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE;
+        tiles_x = width / OCCLUSION_TILE_SIZE;
+        tiles_y = height / OCCLUSION_TILE_SIZE;
+        tile_triangles.resize(static_cast<size_t>(tiles_x) * tiles_y);
+
+        int level_width = width, level_height = height;
+        while (true)
+        {
+            levels.push_back({ level_width, level_height, std::vector<float>(static_cast<size_t>(level_width) * level_height, 1.0f) });
+            if (level_width == 1 && level_height == 1)
+                break;
+            level_width = std::max(1, level_width / 2);
+            level_height = std::max(1, level_height / 2);
+        }
+    }
+
+    void begin_frame(const glm::mat4 &view_projection_value)
+    {
+        view_projection = view_projection_value;
+        triangles.clear();
+        for (std::vector<uint32_t> &bin : tile_triangles)
+            bin.clear();
+    }
+
+    // Adds the faces of a world-space box as occluder triangles.
+    void add_box_occluder(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max)
+    {
+        glm::vec4 corners[8];
+        project_box(bounds_min, bounds_max, corners);
+
+        static const int faces[6][4] = {
+            { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 },
+            { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 }
+        };
+        for (const int *face : faces)
+        {
+            add_triangle(corners[face[0]], corners[face[1]], corners[face[2]]);
+            add_triangle(corners[face[0]], corners[face[2]], corners[face[3]]);
+        }
+    }
+
+    // Rasterizes all occluders tile by tile and rebuilds the depth pyramid.
+    void rasterize()
+    {
+        std::vector<float> &depth = levels[0].depth;
+        pool.parallel_for(0, tile_triangles.size(), [&](size_t tile) {
+            int tile_x = static_cast<int>(tile % tiles_x) * OCCLUSION_TILE_SIZE;
+            int tile_y = static_cast<int>(tile / tiles_x) * OCCLUSION_TILE_SIZE;
+            for (int y = tile_y; y < tile_y + OCCLUSION_TILE_SIZE; y++)
+                std::fill(depth.begin() + y * width + tile_x, depth.begin() + y * width + tile_x + OCCLUSION_TILE_SIZE, 1.0f);
+            for (uint32_t triangle : tile_triangles[tile])
+                rasterize_triangle(triangles[triangle], tile_x, tile_y);
+        });
+
+        for (size_t level = 1; level < levels.size(); level++)
+        {
+            const Level &source = levels[level - 1];
+            Level &target = levels[level];
+            pool.parallel_for(0, static_cast<size_t>(target.height), [&](size_t row) {
+                int y0 = std::min(static_cast<int>(row) * 2, source.height - 1);
+                int y1 = std::min(y0 + 1, source.height - 1);
+                for (int x = 0; x < target.width; x++)
+                {
+                    int x0 = std::min(x * 2, source.width - 1);
+                    int x1 = std::min(x0 + 1, source.width - 1);
+                    float farthest = std::max(std::max(source.at(x0, y0), source.at(x1, y0)), std::max(source.at(x0, y1), source.at(x1, y1)));
+                    target.depth[row * target.width + x] = farthest;
+                }
+            }, 8);
+        }
+    }
+
+    // True unless the whole box lies behind the occluders. Boxes crossing the near plane are always visible.
+    bool is_visible(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max) const
+    {
+        glm::vec4 corners[8];
+        project_box(bounds_min, bounds_max, corners);
+
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY, nearest = INFINITY;
+        for (const glm::vec4 &corner : corners)
+        {
+            if (corner.w <= 1e-5f)
+                return true;
+            glm::vec3 window = to_window(corner);
+            min_x = std::min(min_x, window.x);
+            max_x = std::max(max_x, window.x);
+            min_y = std::min(min_y, window.y);
+            max_y = std::max(max_y, window.y);
+            nearest = std::min(nearest, window.z);
+        }
+        if (max_x < 0.0f || max_y < 0.0f || min_x >= width || min_y >= height || nearest > 1.0f)
+            return false;
+
+        int x0 = std::max(0, static_cast<int>(min_x));
+        int y0 = std::max(0, static_cast<int>(min_y));
+        int x1 = std::min(width - 1, static_cast<int>(max_x));
+        int y1 = std::min(height - 1, static_cast<int>(max_y));
+
+        // Pick the level at which the rectangle spans at most two texels per axis.
+        int extent = std::max(x1 - x0, y1 - y0);
+        size_t level = 0;
+        while (extent > 1 && level + 1 < levels.size())
+        {
+            extent >>= 1;
+            level++;
+        }
+
+        const Level &pyramid = levels[level];
+        for (int y = std::min(y0 >> level, pyramid.height - 1); y <= std::min(y1 >> level, pyramid.height - 1); y++)
+        {
+            for (int x = std::min(x0 >> level, pyramid.width - 1); x <= std::min(x1 >> level, pyramid.width - 1); x++)
+            {
+                if (nearest <= pyramid.at(x, y))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // Tests many boxes on the pool, visible[i] is set to 1 or 0.
+    void test_boxes(const std::vector<glm::vec3> &bounds_min, const std::vector<glm::vec3> &bounds_max, std::vector<uint8_t> &visible) const
+    {
+        visible.resize(bounds_min.size());
+        pool.parallel_for(0, bounds_min.size(), [&](size_t i) {
+            visible[i] = is_visible(bounds_min[i], bounds_max[i]) ? 1 : 0;
+        }, 16);
+    }
+
+    int buffer_width() const
+    {
+        return width;
+    }
+
+    int buffer_height() const
+    {
+        return height;
+    }
+
+private:
+    struct Triangle
+    {
+        glm::vec3 vertices[3];
+    };
+
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<float> depth;
+
+        float at(int x, int y) const
+        {
+            return depth[static_cast<size_t>(y) * width + x];
+        }
+    };
+
+    ThreadPool &pool;
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    glm::mat4 view_projection;
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> tile_triangles;
+    std::vector<Level> levels;
+
+    void project_box(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max, glm::vec4 corners[8]) const
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner((i & 1) ? bounds_max.x : bounds_min.x, (i & 2) ? bounds_max.y : bounds_min.y, (i & 4) ? bounds_max.z : bounds_min.z);
+            corners[i] = view_projection * glm::vec4(corner, 1.0f);
+        }
+    }
+
+    glm::vec3 to_window(const glm::vec4 &clip) const
+    {
+        float inverse_w = 1.0f / clip.w;
+        return glm::vec3((clip.x * inverse_w * 0.5f + 0.5f) * width, (clip.y * inverse_w * 0.5f + 0.5f) * height, clip.z * inverse_w * 0.5f + 0.5f);
+    }
+
+    // Clips against the near plane, z >= -w in clip space, so only the part in front of the camera occludes.
+    // Dividing vertices behind it by w would mirror them and cover pixels the occluder does not.
+    void add_triangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+    {
+        const glm::vec4 input[3] = { a, b, c };
+        glm::vec4 clipped[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec4 &current = input[i];
+            const glm::vec4 &next = input[(i + 1) % 3];
+            float current_distance = current.z + current.w;
+            float next_distance = next.z + next.w;
+            if (current_distance >= 0.0f)
+                clipped[count++] = current;
+            if ((current_distance >= 0.0f) != (next_distance >= 0.0f))
+                clipped[count++] = current + (next - current) * (current_distance / (current_distance - next_distance));
+        }
+        for (int i = 1; i + 1 < count; i++)
+            add_clipped_triangle(clipped[0], clipped[i], clipped[i + 1]);
+    }
+
+    void add_clipped_triangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+    {
+        // In front of the near plane w is at least the near distance, unless the projection is degenerate.
+        if (a.w <= 1e-5f || b.w <= 1e-5f || c.w <= 1e-5f)
+            return;
+
+        Triangle triangle = { { to_window(a), to_window(b), to_window(c) } };
+        float min_x = std::min(triangle.vertices[0].x, std::min(triangle.vertices[1].x, triangle.vertices[2].x));
+        float max_x = std::max(triangle.vertices[0].x, std::max(triangle.vertices[1].x, triangle.vertices[2].x));
+        float min_y = std::min(triangle.vertices[0].y, std::min(triangle.vertices[1].y, triangle.vertices[2].y));
+        float max_y = std::max(triangle.vertices[0].y, std::max(triangle.vertices[1].y, triangle.vertices[2].y));
+        if (max_x < 0.0f || max_y < 0.0f || min_x >= width || min_y >= height)
+            return;
+
+        uint32_t index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(triangle);
+
+        int first_tile_x = std::max(0, static_cast<int>(min_x) / OCCLUSION_TILE_SIZE);
+        int last_tile_x = std::min(tiles_x - 1, static_cast<int>(max_x) / OCCLUSION_TILE_SIZE);
+        int first_tile_y = std::max(0, static_cast<int>(min_y) / OCCLUSION_TILE_SIZE);
+        int last_tile_y = std::min(tiles_y - 1, static_cast<int>(max_y) / OCCLUSION_TILE_SIZE);
+        for (int tile_y = first_tile_y; tile_y <= last_tile_y; tile_y++)
+        {
+            for (int tile_x = first_tile_x; tile_x <= last_tile_x; tile_x++)
+                tile_triangles[static_cast<size_t>(tile_y) * tiles_x + tile_x].push_back(index);
+        }
+    }
+
+    // Edge-function rasterizer sampling pixel centers, four pixels per step, keeping the nearest depth.
+    void rasterize_triangle(const Triangle &triangle, int tile_x, int tile_y)
+    {
+        glm::vec3 v0 = triangle.vertices[0], v1 = triangle.vertices[1], v2 = triangle.vertices[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (std::fabs(area) < 1e-8f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        // Edge i is positive inside, E(x, y) = a * x + b * y + c.
+        float edge_a[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+        float edge_b[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+        float edge_c[3] = { v1.x * v2.y - v2.x * v1.y, v2.x * v0.y - v0.x * v2.y, v0.x * v1.y - v1.x * v0.y };
+
+        float inverse_area = 1.0f / area;
+        float depth_dx = (edge_a[0] * v0.z + edge_a[1] * v1.z + edge_a[2] * v2.z) * inverse_area;
+        float depth_dy = (edge_b[0] * v0.z + edge_b[1] * v1.z + edge_b[2] * v2.z) * inverse_area;
+        float depth_c = (edge_c[0] * v0.z + edge_c[1] * v1.z + edge_c[2] * v2.z) * inverse_area;
+
+        int min_x = std::max(tile_x, static_cast<int>(std::floor(std::min(v0.x, std::min(v1.x, v2.x)))));
+        int max_x = std::min(tile_x + OCCLUSION_TILE_SIZE - 1, static_cast<int>(std::ceil(std::max(v0.x, std::max(v1.x, v2.x)))));
+        int min_y = std::max(tile_y, static_cast<int>(std::floor(std::min(v0.y, std::min(v1.y, v2.y)))));
+        int max_y = std::min(tile_y + OCCLUSION_TILE_SIZE - 1, static_cast<int>(std::ceil(std::max(v0.y, std::max(v1.y, v2.y)))));
+        if (min_x > max_x || min_y > max_y)
+            return;
+        min_x &= ~3;
+
+        float *depth = levels[0].depth.data();
+#ifdef OCCLUSION_CULLER_SSE2
+        const __m128 lane_offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 a0 = _mm_set1_ps(edge_a[0]), a1 = _mm_set1_ps(edge_a[1]), a2 = _mm_set1_ps(edge_a[2]);
+        __m128 zero = _mm_setzero_ps();
+        __m128 depth_step = _mm_set1_ps(depth_dx);
+        for (int y = min_y; y <= max_y; y++)
+        {
+            float center_y = y + 0.5f;
+            __m128 x = _mm_add_ps(_mm_set1_ps(static_cast<float>(min_x)), lane_offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, x), _mm_set1_ps(edge_b[0] * center_y + edge_c[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, x), _mm_set1_ps(edge_b[1] * center_y + edge_c[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, x), _mm_set1_ps(edge_b[2] * center_y + edge_c[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(depth_step, x), _mm_set1_ps(depth_dy * center_y + depth_c));
+            __m128 e0_step = _mm_set1_ps(edge_a[0] * 4.0f), e1_step = _mm_set1_ps(edge_a[1] * 4.0f), e2_step = _mm_set1_ps(edge_a[2] * 4.0f);
+            __m128 z_step = _mm_set1_ps(depth_dx * 4.0f);
+
+            float *row = depth + static_cast<size_t>(y) * width;
+            for (int x_block = min_x; x_block <= max_x; x_block += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside))
+                {
+                    __m128 current = _mm_loadu_ps(row + x_block);
+                    __m128 nearer = _mm_and_ps(inside, _mm_cmplt_ps(z, current));
+                    _mm_storeu_ps(row + x_block, _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, current)));
+                }
+                e0 = _mm_add_ps(e0, e0_step);
+                e1 = _mm_add_ps(e1, e1_step);
+                e2 = _mm_add_ps(e2, e2_step);
+                z = _mm_add_ps(z, z_step);
+            }
+        }
+#else
+        for (int y = min_y; y <= max_y; y++)
+        {
+            float center_y = y + 0.5f;
+            float *row = depth + static_cast<size_t>(y) * width;
+            for (int x = min_x; x < ((max_x + 4) & ~3); x++)
+            {
+                float center_x = x + 0.5f;
+                if (edge_a[0] * center_x + edge_b[0] * center_y + edge_c[0] < 0.0f ||
+                    edge_a[1] * center_x + edge_b[1] * center_y + edge_c[1] < 0.0f ||
+                    edge_a[2] * center_x + edge_b[2] * center_y + edge_c[2] < 0.0f)
+                    continue;
+                float z = depth_dx * center_x + depth_dy * center_y + depth_c;
+                row[x] = std::min(row[x], z);
+            }
+        }
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef OCCLUSION_QUERIES_HPP
+#define OCCLUSION_QUERIES_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+#include "shader.hpp"
+
+const unsigned int OCCLUSION_REQUERY_INTERVAL = 4;
+
+// Hardware occlusion culling for groups of objects.
+// Groups that were visible are drawn directly, and their own draw is wrapped in a query every few frames.
+// Groups that were hidden get a bounding box proxy query and are drawn with conditional rendering,
+// so the GPU decides. Results are read only once they are available, and the CPU never waits on them.
+class OcclusionQueries
+{
+public:
+    OcclusionQueries(const std::string &vertex_path, const std::string &fragment_path, unsigned int requery_interval_value = OCCLUSION_REQUERY_INTERVAL) : proxy_shader(vertex_path, fragment_path), requery_interval(requery_interval_value), frame(0)
+    {
+        const float corners[] =
+        {
+            0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 1.0f,  1.0f, 1.0f, 1.0f
+        };
+        const unsigned char faces[] =
+        {
+            0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+            0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+            0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5
+        };
+
+        glGenVertexArrays(1, &proxy_VAO);
+        glGenBuffers(1, &proxy_VBO);
+        glGenBuffers(1, &proxy_EBO);
+
+        glBindVertexArray(proxy_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, proxy_VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, proxy_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)(0));
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+    }
+
+    OcclusionQueries(const OcclusionQueries &) = delete;
+    OcclusionQueries &operator=(const OcclusionQueries &) = delete;
+
+    size_t add_group(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max)
+    {
+        Group group;
+        group.bounds_min = bounds_min;
+        group.bounds_max = bounds_max;
+        glGenQueries(1, &group.query);
+        groups.push_back(group);
+        return groups.size() - 1;
+    }
+
+    // draw_group(index) must draw the group with whatever program and VAO it needs,
+    // both are restored around the proxy pass. Depth testing must be enabled.
+    template <typename DrawGroup>
+    void render(const glm::mat4 &view_projection, const glm::vec3 &camera_position, float near_plane, DrawGroup draw_group)
+    {
+        frame++;
+        collect_results();
+
+        // Front to back by view depth, so near groups fill the depth buffer before farther ones are drawn and queried.
+        order.clear();
+        for (size_t i = 0; i < groups.size(); i++)
+        {
+            glm::vec4 center = view_projection * glm::vec4((groups[i].bounds_min + groups[i].bounds_max) * 0.5f, 1.0f);
+            order.push_back({ center.w, i });
+        }
+        std::sort(order.begin(), order.end());
+
+        // Visible groups first, they lay down the depth the hidden ones are tested against.
+        for (const auto &item : order)
+        {
+            size_t i = item.second;
+            Group &group = groups[i];
+            group.camera_inside = contains(group, camera_position, near_plane);
+            if (!group.visible && !group.camera_inside)
+                continue;
+
+            bool requery = !group.pending && (frame + i) % requery_interval == 0 && !group.camera_inside;
+            if (requery)
+                glBeginQuery(GL_ANY_SAMPLES_PASSED, group.query);
+            draw_group(i);
+            if (requery)
+            {
+                glEndQuery(GL_ANY_SAMPLES_PASSED);
+                group.pending = true;
+            }
+        }
+
+        GLint previous_program, previous_VAO;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_VAO);
+
+        std::vector<size_t> hidden;
+        for (const auto &item : order)
+        {
+            if (!groups[item.second].visible && !groups[item.second].camera_inside)
+                hidden.push_back(item.second);
+        }
+        if (hidden.empty())
+            return;
+
+        proxy_shader.use();
+        proxy_shader.set_mat4("view_projection", view_projection);
+        glBindVertexArray(proxy_VAO);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        for (size_t i : hidden)
+        {
+            Group &group = groups[i];
+            // A query still in flight keeps predicating the draw below, it is not reissued.
+            if (group.pending)
+                continue;
+            proxy_shader.set_vec3("bounds_min", group.bounds_min);
+            proxy_shader.set_vec3("bounds_max", group.bounds_max);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, group.query);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)(0));
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            group.pending = true;
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+
+        glUseProgram(static_cast<GLuint>(previous_program));
+        glBindVertexArray(static_cast<GLuint>(previous_VAO));
+        for (size_t i : hidden)
+        {
+            // Draws unless the GPU already knows the proxy was hidden, and never stalls if it does not know yet.
+            glBeginConditionalRender(groups[i].query, GL_QUERY_NO_WAIT);
+            draw_group(i);
+            glEndConditionalRender();
+        }
+    }
+
+    bool is_visible(size_t group) const
+    {
+        return groups[group].visible;
+    }
+
+    size_t visible_count() const
+    {
+        size_t count = 0;
+        for (const Group &group : groups)
+            count += group.visible ? 1 : 0;
+        return count;
+    }
+
+    size_t group_count() const
+    {
+        return groups.size();
+    }
+
+    ~OcclusionQueries()
+    {
+        for (Group &group : groups)
+            glDeleteQueries(1, &group.query);
+        glDeleteVertexArrays(1, &proxy_VAO);
+        glDeleteBuffers(1, &proxy_VBO);
+        glDeleteBuffers(1, &proxy_EBO);
+    }
+
+private:
+    struct Group
+    {
+        glm::vec3 bounds_min;
+        glm::vec3 bounds_max;
+        unsigned int query = 0;
+        bool pending = false;
+        bool visible = true;
+        bool camera_inside = false;
+    };
+
+    Shader proxy_shader;
+    unsigned int proxy_VAO, proxy_VBO, proxy_EBO;
+    unsigned int requery_interval;
+    uint64_t frame;
+    std::vector<Group> groups;
+    // View depth and index of every group, rebuilt each frame.
+    std::vector<std::pair<float, size_t>> order;
+
+    void collect_results()
+    {
+        for (Group &group : groups)
+        {
+            if (!group.pending)
+                continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(group.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint samples_passed = 0;
+            glGetQueryObjectuiv(group.query, GL_QUERY_RESULT, &samples_passed);
+            group.visible = samples_passed != 0;
+            group.pending = false;
+        }
+    }
+
+    // The proxy box is clipped away when the camera sits inside it, such groups are always visible.
+    static bool contains(const Group &group, const glm::vec3 &point, float margin)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (point[i] < group.bounds_min[i] - margin || point[i] > group.bounds_max[i] + margin)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
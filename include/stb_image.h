@@ -426,6 +426,25 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+// Same as stbi_load, but neither dimension of the result exceeds max_dimension (0 means no limit).
+// JPEGs are decoded at 1/2, 1/4 or 1/8 scale with a truncated IDCT, down to the smallest scale still at least
+// max_dimension, whatever remains is area averaged like every other format. The aspect ratio is kept.
+STBIDEF stbi_uc *stbi_load_from_memory_max(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, int max_dimension);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_max(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, int max_dimension);
+#endif
+
+// Decodes into memory the caller owns, e.g. a mapped pixel unpack buffer, instead of a new allocation.
+// Get the size with stbi_info first. Rows start dest_pitch bytes apart, desired_channels must be 1..4,
+// and the image must fit in dest_size bytes or nothing is written. flip_vertically stores the bottom row
+// first, independent of stbi_set_flip_vertically_on_load. Returns 1 on success, 0 with stbi_failure_reason.
+// JPEG rows are color converted straight into dest, other formats are decoded as usual and their rows
+// copied over, flipped on the way.
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dest, size_t dest_size, int dest_pitch, int desired_channels, int flip_vertically, int *x, int *y, int *channels_in_file);
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *dest, size_t dest_size, int dest_pitch, int desired_channels, int flip_vertically, int *x, int *y, int *channels_in_file);
+#endif
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
@@ -520,6 +539,21 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+// returns 1 and stores the flag if this thread set its own, 0 if it follows the global one.
+// unset drops the flag of this thread, so it follows the global one again
+STBIDEF int stbi_get_flip_vertically_on_load_thread(int *flag_true_if_should_flip);
+STBIDEF void stbi_unset_flip_vertically_on_load_thread(void);
+
+// spread decoding across threads. parallel_for must call task(task_data, i) for every i
+// in [0,count), in any order and possibly concurrently, and return once all have finished.
+// baseline JPEGs with restart markers decode their restart intervals in parallel, and
+// JPEG upsampling and color conversion run in row bands. pass NULL to decode serially.
+typedef void stbi_parallel_for_func(void *user, int count, void (*task)(void *task_data, int index), void *task_data);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *parallel_for, void *user);
+
+// PNG decoding uses SSE2 unfilters and a two-literal inflate fast path by default.
+// pass 0 to fall back to the original scalar code, e.g. to compare the two.
+STBIDEF void stbi_set_png_fast_path(int flag_true_if_should_use_fast_path);
 
 // ZLIB client - used by PNG, available for other purposes
 
@@ -814,6 +848,13 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   int max_dimension; // decoders that can produce a smaller image directly may use this, 0 if unlimited
+
+   // caller memory to decode into, decoders that can write their final rows directly may use it
+   stbi_uc *into;
+   size_t into_size;
+   int into_pitch, into_flip;
 } stbi__context;
 
 
@@ -827,6 +868,8 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->max_dimension = 0;
+   s->into = NULL;
 }
 
 // initialize a callback-based context
@@ -837,6 +880,8 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
+   s->max_dimension = 0;
+   s->into = NULL;
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
@@ -1109,11 +1154,40 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
    stbi__vertically_flip_on_load_set = 1;
 }
 
+STBIDEF int stbi_get_flip_vertically_on_load_thread(int *flag_true_if_should_flip)
+{
+   if (stbi__vertically_flip_on_load_set && flag_true_if_should_flip)
+      *flag_true_if_should_flip = stbi__vertically_flip_on_load_local;
+   return stbi__vertically_flip_on_load_set;
+}
+
+STBIDEF void stbi_unset_flip_vertically_on_load_thread(void)
+{
+   stbi__vertically_flip_on_load_local = 0;
+   stbi__vertically_flip_on_load_set = 0;
+}
+
 #define stbi__vertically_flip_on_load  (stbi__vertically_flip_on_load_set       \
                                          ? stbi__vertically_flip_on_load_local  \
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static stbi_parallel_for_func *stbi__parallel_for = NULL;
+static void *stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func *parallel_for, void *user)
+{
+   stbi__parallel_for = parallel_for;
+   stbi__parallel_for_user = user;
+}
+
+static int stbi__png_fast_path = 1;
+
+STBIDEF void stbi_set_png_fast_path(int flag_true_if_should_use_fast_path)
+{
+   stbi__png_fast_path = flag_true_if_should_use_fast_path;
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1420,6 +1494,242 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+// box filter taps: output sample i averages source [i*scale, (i+1)*scale), each source sample
+// weighted by how much of it is covered. weights already include the 1/scale normalization.
+typedef struct
+{
+   int *first, *count;
+   float *weights;
+   int taps;
+} stbi__area_taps;
+
+static int stbi__area_taps_build(stbi__area_taps *t, int in_size, int out_size)
+{
+   float scale = (float) in_size / out_size;
+   int i, k;
+   t->taps = (int) scale + 2;
+   t->first = (int *) stbi__malloc_mad2(out_size, sizeof(int), 0);
+   t->count = (int *) stbi__malloc_mad2(out_size, sizeof(int), 0);
+   t->weights = (float *) stbi__malloc_mad3(out_size, t->taps, sizeof(float), 0);
+   if (!t->first || !t->count || !t->weights) return 0;
+   for (i=0; i < out_size; ++i) {
+      float x0 = i * scale, x1 = x0 + scale;
+      int first = (int) x0, last = (int) x1;
+      if (last >= in_size) last = in_size-1;
+      if (last - first + 1 > t->taps) last = first + t->taps - 1;
+      t->first[i] = first;
+      t->count[i] = 0;
+      for (k=first; k <= last; ++k) {
+         float left = k > x0 ? (float) k : x0;
+         float right = k+1 < x1 ? (float) (k+1) : x1;
+         t->weights[i*t->taps + t->count[i]++] = right > left ? (right - left) / scale : 0;
+      }
+   }
+   return 1;
+}
+
+static void stbi__area_taps_free(stbi__area_taps *t)
+{
+   STBI_FREE(t->first);
+   STBI_FREE(t->count);
+   STBI_FREE(t->weights);
+}
+
+static void stbi__resize_area_row(const stbi_uc *in, int n, float *out, int out_w, const stbi__area_taps *t)
+{
+   int i, k, c;
+   for (i=0; i < out_w; ++i) {
+      const stbi_uc *p = in + t->first[i]*n;
+      const float *w = t->weights + i*t->taps;
+#ifdef STBI_SSE2
+      if (n == 4) {
+         __m128i zero = _mm_setzero_si128();
+         __m128 sum = _mm_setzero_ps();
+         for (k=0; k < t->count[i]; ++k) {
+            int v;
+            __m128i pixel;
+            memcpy(&v, p + k*4, 4);
+            pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(pixel), _mm_set1_ps(w[k])));
+         }
+         _mm_storeu_ps(out + i*4, sum);
+         continue;
+      }
+#endif
+      for (c=0; c < n; ++c) {
+         float sum = 0;
+         for (k=0; k < t->count[i]; ++k)
+            sum += p[k*n+c] * w[k];
+         out[i*n+c] = sum;
+      }
+   }
+}
+
+// area averaging downscale, channels are averaged independently
+static stbi_uc *stbi__resize_area(const stbi_uc *in, int w, int h, int n, int out_w, int out_h)
+{
+   stbi__area_taps horizontal, vertical;
+   int count = out_w * n, i, k, oy;
+   stbi_uc *out = (stbi_uc *) stbi__malloc_mad3(out_w, out_h, n, 0);
+   float *row = (float *) stbi__malloc_mad2(count, sizeof(float), 0);
+   float *sum = (float *) stbi__malloc_mad2(count, sizeof(float), 0);
+   int ok = stbi__area_taps_build(&horizontal, w, out_w);
+   ok = stbi__area_taps_build(&vertical, h, out_h) && ok;
+   if (!out || !row || !sum || !ok) {
+      STBI_FREE(out); out = NULL;
+      goto done;
+   }
+   for (oy=0; oy < out_h; ++oy) {
+      stbi_uc *dest = out + (size_t) oy * count;
+      memset(sum, 0, count * sizeof(float));
+      for (k=0; k < vertical.count[oy]; ++k) {
+         float weight = vertical.weights[oy*vertical.taps + k];
+         if (weight <= 0) continue;
+         stbi__resize_area_row(in + (size_t) (vertical.first[oy] + k) * w * n, n, row, out_w, &horizontal);
+         i = 0;
+#ifdef STBI_SSE2
+         {
+            __m128 weight4 = _mm_set1_ps(weight);
+            for (; i+4 <= count; i += 4)
+               _mm_storeu_ps(sum+i, _mm_add_ps(_mm_loadu_ps(sum+i), _mm_mul_ps(_mm_loadu_ps(row+i), weight4)));
+         }
+#endif
+         for (; i < count; ++i)
+            sum[i] += row[i] * weight;
+      }
+      i = 0;
+#ifdef STBI_SSE2
+      {
+         __m128 half = _mm_set1_ps(0.5f);
+         for (; i+8 <= count; i += 8) {
+            __m128i lo = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(sum+i), half));
+            __m128i hi = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(sum+i+4), half));
+            _mm_storel_epi64((__m128i *) (dest+i), _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+         }
+      }
+#endif
+      for (; i < count; ++i) {
+         float value = sum[i] + 0.5f;
+         dest[i] = (stbi_uc) (value >= 255 ? 255 : (int) value);
+      }
+   }
+done:
+   stbi__area_taps_free(&horizontal);
+   stbi__area_taps_free(&vertical);
+   STBI_FREE(row);
+   STBI_FREE(sum);
+   return out;
+}
+
+static stbi_uc *stbi__fit_max_dimension(stbi_uc *result, int *x, int *y, int n, int max_dimension)
+{
+   int out_w, out_h;
+   stbi_uc *resized;
+   if (!result || max_dimension <= 0 || (*x <= max_dimension && *y <= max_dimension))
+      return result;
+   if (*x >= *y) {
+      out_w = max_dimension;
+      out_h = (int) ((double) *y * max_dimension / *x + 0.5);
+   } else {
+      out_h = max_dimension;
+      out_w = (int) ((double) *x * max_dimension / *y + 0.5);
+   }
+   if (out_w < 1) out_w = 1;
+   if (out_h < 1) out_h = 1;
+   resized = stbi__resize_area(result, *x, *y, n, out_w, out_h);
+   STBI_FREE(result);
+   if (!resized) return stbi__errpuc("outofmem", "Out of memory");
+   *x = out_w;
+   *y = out_h;
+   return resized;
+}
+
+STBIDEF stbi_uc *stbi_load_from_memory_max(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int max_dimension)
+{
+   stbi__context s;
+   stbi_uc *result;
+   int channels;
+   stbi__start_mem(&s,buffer,len);
+   s.max_dimension = max_dimension;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,&channels,req_comp);
+   if (!result) return NULL;
+   if (comp) *comp = channels;
+   return stbi__fit_max_dimension(result, x, y, req_comp ? req_comp : channels, max_dimension);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_max(char const *filename, int *x, int *y, int *comp, int req_comp, int max_dimension)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   stbi_uc *result;
+   int channels;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   s.max_dimension = max_dimension;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,&channels,req_comp);
+   fclose(f);
+   if (!result) return NULL;
+   if (comp) *comp = channels;
+   return stbi__fit_max_dimension(result, x, y, req_comp ? req_comp : channels, max_dimension);
+}
+#endif
+
+static int stbi__into_fits(stbi__context *s, int x, int y, int n)
+{
+   return s->into_pitch >= x * n && (size_t) s->into_pitch * (y-1) + (size_t) x * n <= s->into_size;
+}
+
+static int stbi__load_into(stbi__context *s, stbi_uc *dest, size_t dest_size, int dest_pitch, int req_comp, int flip, int *x, int *y, int *comp)
+{
+   stbi__result_info ri;
+   stbi_uc *result;
+   int channels, j;
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   s->into = dest;
+   s->into_size = dest_size;
+   s->into_pitch = dest_pitch;
+   s->into_flip = flip;
+   result = (stbi_uc *) stbi__load_main(s, x, y, &channels, req_comp, &ri, 8);
+   if (!result) return 0;
+   if (comp) *comp = channels;
+   if (result == dest) return 1;
+
+   if (ri.bits_per_channel != 8) {
+      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp);
+      if (!result) return 0;
+   }
+   if (!stbi__into_fits(s, *x, *y, req_comp)) {
+      STBI_FREE(result);
+      return stbi__err("too small", "Destination buffer too small");
+   }
+   for (j=0; j < *y; ++j)
+      memcpy(dest + (size_t) dest_pitch * (flip ? *y-1-j : j), result + (size_t) *x * req_comp * j, (size_t) *x * req_comp);
+   STBI_FREE(result);
+   return 1;
+}
+
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *dest, size_t dest_size, int dest_pitch, int desired_channels, int flip_vertically, int *x, int *y, int *channels_in_file)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s, dest, dest_size, dest_pitch, desired_channels, flip_vertically, x, y, channels_in_file);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *dest, size_t dest_size, int dest_pitch, int desired_channels, int flip_vertically, int *x, int *y, int *channels_in_file)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_into(&s, dest, dest_size, dest_pitch, desired_channels, flip_vertically, x, y, channels_in_file);
+   fclose(f);
+   return result;
+}
+#endif
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1974,6 +2284,9 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   // blocks are decoded to 8 >> scale_shift pixels per side
+   int scale_shift;
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
@@ -2912,6 +3225,82 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// C(u)/2 * cos((2x+1)u*pi/2n) for n = 4 and n = 2, indexed [x][u]
+static const float stbi__idct_4[4][4] = {
+   { 0.35355339f,  0.46193977f,  0.35355339f,  0.19134172f },
+   { 0.35355339f,  0.19134172f, -0.35355339f, -0.46193977f },
+   { 0.35355339f, -0.19134172f, -0.35355339f,  0.46193977f },
+   { 0.35355339f, -0.46193977f,  0.35355339f, -0.19134172f },
+};
+static const float stbi__idct_2[2][2] = {
+   { 0.35355339f,  0.35355339f },
+   { 0.35355339f, -0.35355339f },
+};
+
+// IDCT of only the lowest size x size coefficients, giving the block at 1/2, 1/4 or 1/8 scale.
+// the 8-point normalization is kept so a flat block comes out the same at every size.
+static void stbi__idct_scaled(stbi_uc *out, int out_stride, short data[64], int size)
+{
+   float tmp[4][4];
+   const float *table = size == 4 ? stbi__idct_4[0] : stbi__idct_2[0];
+   int x, y, k;
+   if (size == 1) {
+      out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+      return;
+   }
+#ifdef STBI_SSE2
+   if (size == 4 && stbi__sse2_available()) {
+      // one register holds a row of four outputs
+      __m128 column[4], rows[4];
+      __m128i zero = _mm_setzero_si128();
+      for (k=0; k < 4; ++k)
+         column[k] = _mm_setr_ps(stbi__idct_4[0][k], stbi__idct_4[1][k], stbi__idct_4[2][k], stbi__idct_4[3][k]);
+      for (y=0; y < 4; ++y) {
+         __m128 sum = _mm_mul_ps(_mm_set1_ps(data[y*8+0]), column[0]);
+         for (k=1; k < 4; ++k)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(data[y*8+k]), column[k]));
+         rows[y] = sum;
+      }
+      for (y=0; y < 4; ++y) {
+         __m128 sum = _mm_set1_ps(128.0f);
+         __m128i pixels;
+         for (k=0; k < 4; ++k)
+            sum = _mm_add_ps(sum, _mm_mul_ps(rows[k], _mm_set1_ps(stbi__idct_4[y][k])));
+         pixels = _mm_cvtps_epi32(sum);
+         pixels = _mm_packus_epi16(_mm_packs_epi32(pixels, zero), zero);
+         x = _mm_cvtsi128_si32(pixels);
+         memcpy(out + y*out_stride, &x, 4);
+      }
+      return;
+   }
+#endif
+   for (y=0; y < size; ++y)
+      for (x=0; x < size; ++x) {
+         float sum = 0;
+         for (k=0; k < size; ++k)
+            sum += data[y*8+k] * table[x*size+k];
+         tmp[y][x] = sum;
+      }
+   for (y=0; y < size; ++y)
+      for (x=0; x < size; ++x) {
+         float sum = 128.5f;
+         for (k=0; k < size; ++k)
+            sum += tmp[k][x] * table[y*size+k];
+         out[y*out_stride+x] = (stbi_uc) (sum <= 0 ? 0 : sum >= 255 ? 255 : (int) sum);
+      }
+}
+
+// inverse transform the block at block column bx, row by of component n into its plane
+static void stbi__jpeg_idct_store(stbi__jpeg *z, int n, int bx, int by, short data[64])
+{
+   int size = 8 >> z->scale_shift;
+   stbi_uc *out = z->img_comp[n].data + z->img_comp[n].w2*by*size + bx*size;
+   if (z->scale_shift)
+      stbi__idct_scaled(out, z->img_comp[n].w2, data, size);
+   else
+      z->idct_block_kernel(out, z->img_comp[n].w2, data);
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
@@ -2930,7 +3319,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct_store(z, n, i, j, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2954,11 +3343,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = i*z->img_comp[n].h + x;
+                        int y2 = j*z->img_comp[n].v + y;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        stbi__jpeg_idct_store(z, n, x2, y2, data);
                      }
                   }
                }
@@ -3036,6 +3425,176 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
    }
 }
 
+// restart intervals reset the entropy decoder and dc prediction, so in a baseline scan each
+// interval can be decoded on its own once the boundaries are known
+#define STBI__JPEG_PARALLEL_MIN_INTERVALS  4
+#define STBI__JPEG_PARALLEL_MAX_TASKS      64
+
+// decode mcu_count MCUs of a baseline scan starting at first_mcu, the decoder must be at an interval start
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first_mcu, int mcu_count)
+{
+   int m,k,x,y;
+   STBI_SIMD_ALIGN(short, data[64]);
+   stbi__jpeg_reset(z);
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      int ha = z->img_comp[n].ha;
+      for (m=first_mcu; m < first_mcu + mcu_count; ++m) {
+         int i = m % w, j = m / w;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         stbi__jpeg_idct_store(z, n, i, j, data);
+      }
+   } else {
+      for (m=first_mcu; m < first_mcu + mcu_count; ++m) {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = i*z->img_comp[n].h + x;
+                  int y2 = j*z->img_comp[n].v + y;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  stbi__jpeg_idct_store(z, n, x2, y2, data);
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+#ifdef _MSC_VER
+#include <intrin.h>
+typedef long stbi__atomic_flag;
+#define stbi__atomic_set(p)   _InterlockedExchange((p), 1)
+#define stbi__atomic_get(p)   _InterlockedCompareExchange((p), 0, 0)
+#else
+typedef int stbi__atomic_flag;
+#define stbi__atomic_set(p)   __atomic_store_n((p), 1, __ATOMIC_RELAXED)
+#define stbi__atomic_get(p)   __atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc *data;
+   int *interval_start; // byte offset of each interval in data, plus the end
+   int interval_count;
+   int task_count;
+   int mcu_count;
+   stbi__atomic_flag failed; // set by any task, read after parallel_for returns
+} stbi__jpeg_intervals;
+
+static void stbi__jpeg_decode_intervals_task(void *task_data, int index)
+{
+   stbi__jpeg_intervals *t = (stbi__jpeg_intervals *) task_data;
+   int first = index * t->interval_count / t->task_count;
+   int last = (index+1) * t->interval_count / t->task_count;
+   int interval;
+   stbi__context s;
+   // every task decodes with its own copy of the decoder state and its own memory context
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) { stbi__atomic_set(&t->failed); return; }
+   memcpy(z, t->z, sizeof(stbi__jpeg));
+   z->s = &s;
+   for (interval=first; interval < last; ++interval) {
+      int first_mcu = interval * t->z->restart_interval;
+      int mcu_count = t->mcu_count - first_mcu;
+      if (mcu_count > t->z->restart_interval) mcu_count = t->z->restart_interval;
+      if (mcu_count <= 0) break;
+      stbi__start_mem(&s, t->data + t->interval_start[interval], t->interval_start[interval+1] - t->interval_start[interval]);
+      if (!stbi__jpeg_decode_mcus(z, first_mcu, mcu_count)) { stbi__atomic_set(&t->failed); break; }
+   }
+   STBI_FREE(z);
+}
+
+// reads the whole entropy-coded segment, splits it at the RST markers and decodes the
+// intervals through stbi__parallel_for. leaves z->marker at the marker that ended the scan.
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_intervals t;
+   int size = 0, capacity = 1 << 16, expected, c;
+   stbi_uc *data;
+
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      t.mcu_count = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      t.mcu_count = z->img_mcu_x * z->img_mcu_y;
+   }
+   expected = (t.mcu_count + z->restart_interval - 1) / z->restart_interval;
+   if (expected < STBI__JPEG_PARALLEL_MIN_INTERVALS)
+      return stbi__parse_entropy_coded_data(z);
+
+   data = (stbi_uc *) stbi__malloc(capacity);
+   t.interval_start = (int *) stbi__malloc_mad2(expected + 1, sizeof(int), 0);
+   if (!data || !t.interval_start) {
+      STBI_FREE(data);
+      STBI_FREE(t.interval_start);
+      return stbi__err("outofmem", "Out of memory");
+   }
+
+   t.interval_start[0] = 0;
+   t.interval_count = 1;
+   z->marker = STBI__MARKER_none;
+   while (!stbi__at_eof(z->s)) {
+      // copy the run up to the next 0xff straight out of the context's buffer
+      stbi_uc *p = z->s->img_buffer;
+      stbi_uc *ff = p < z->s->img_buffer_end ? (stbi_uc *) memchr(p, 0xff, z->s->img_buffer_end - p) : NULL;
+      int run = (int) ((ff ? ff : z->s->img_buffer_end) - p);
+      while (size + run + 2 > capacity) {
+         stbi_uc *grown = (stbi_uc *) STBI_REALLOC_SIZED(data, capacity, capacity*2);
+         if (!grown) {
+            STBI_FREE(data);
+            STBI_FREE(t.interval_start);
+            return stbi__err("outofmem", "Out of memory");
+         }
+         data = grown;
+         capacity *= 2;
+      }
+      if (run > 0) {
+         memcpy(data + size, p, run);
+         size += run;
+         z->s->img_buffer += run;
+         continue;
+      }
+      c = stbi__get8(z->s);
+      if (c != 0xff) {
+         data[size++] = (stbi_uc) c;
+         continue;
+      }
+      c = stbi__get8(z->s);
+      while (c == 0xff)
+         c = stbi__get8(z->s); // fill bytes before a marker
+      if (c == 0) {
+         // stuffed zero, the entropy decoder expects to see it
+         data[size++] = 0xff;
+         data[size++] = 0;
+      } else if (STBI__RESTART(c)) {
+         if (t.interval_count < expected)
+            t.interval_start[t.interval_count++] = size;
+      } else {
+         z->marker = (unsigned char) c;
+         break;
+      }
+   }
+   t.interval_start[t.interval_count] = size;
+
+   // a truncated scan leaves its missing intervals blank, like the serial decoder
+   t.z = z;
+   t.data = data;
+   t.task_count = t.interval_count < STBI__JPEG_PARALLEL_MAX_TASKS ? t.interval_count : STBI__JPEG_PARALLEL_MAX_TASKS;
+   t.failed = 0;
+   stbi__parallel_for(stbi__parallel_for_user, t.task_count, stbi__jpeg_decode_intervals_task, &t);
+
+   STBI_FREE(data);
+   STBI_FREE(t.interval_start);
+   if (stbi__atomic_get(&t.failed)) return stbi__err("bad restart interval", "Corrupt JPEG");
+   return 1;
+}
+
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
 {
    int i;
@@ -3055,7 +3614,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct_store(z, n, i, j, data);
             }
          }
       }
@@ -3283,6 +3842,14 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_x = (s->img_x + z->img_mcu_w-1) / z->img_mcu_w;
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
+   // pick the smallest scale that still keeps the larger side at or above max_dimension
+   z->scale_shift = 0;
+   if (s->max_dimension > 0) {
+      stbi__uint32 largest = s->img_x > s->img_y ? s->img_x : s->img_y;
+      while (z->scale_shift < 3 && ((largest + (2u << z->scale_shift) - 1) >> (z->scale_shift + 1)) >= (stbi__uint32) s->max_dimension)
+         ++z->scale_shift;
+   }
+
    for (i=0; i < s->img_n; ++i) {
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
@@ -3294,8 +3861,8 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3305,10 +3872,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one 8x8 block of coefficients per block of the plane, whatever size the plane is decoded at
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3365,7 +3932,9 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
-         if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (stbi__parallel_for && !j->progressive && j->restart_interval) {
+            if (!stbi__parse_entropy_coded_data_parallel(j)) return 0;
+         } else if (!stbi__parse_entropy_coded_data(j)) return 0;
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
             while (!stbi__at_eof(j->s)) {
@@ -3808,6 +4377,161 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// upsample and color convert output rows [y_begin,y_end). res_comp holds the resampler
+// state at row 0 and is advanced in place, linebuf[k] is scratch for component k
+// the color converters store a fourth byte even for 3-channel output (and a second one for 1-channel CMYK),
+// so a band writes one byte into the next band's first row. when last_row is given, the band's final row
+// goes through it and is copied out. caller memory (s->into) has no slack byte and may be flipped, so there
+// every row of an odd channel count goes through it.
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi__resample *res_comp, stbi_uc **linebuf, stbi_uc *output, stbi_uc *last_row, int n, int decode_n, int is_rgb, unsigned int y_begin, unsigned int y_end)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   size_t pitch = z->s->into ? (size_t) z->s->into_pitch : (size_t) n * z->s->img_x;
+   int flip = z->s->into ? z->s->into_flip : 0;
+   int every_row = z->s->into && (n & 1);
+
+   // the resampler only moves forward, so skip its state ahead to the first row
+   for (j=0; j < y_begin; ++j) {
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+   }
+
+   for (j=y_begin; j < y_end; ++j) {
+      stbi_uc *row = output + pitch * (flip ? z->s->img_y-1-j : j);
+      stbi_uc *out = (last_row && (every_row || j == y_end-1)) ? last_row : row;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+      if (last_row && (every_row || j == y_end-1))
+         memcpy(row, last_row, n * z->s->img_x);
+   }
+}
+
+#define STBI__JPEG_BAND_ROWS  32
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample *res_comp;
+   stbi_uc *linebuf;
+   stbi_uc *last_rows;
+   stbi_uc *output;
+   int n, decode_n, is_rgb;
+} stbi__jpeg_bands;
+
+static void stbi__jpeg_convert_band_task(void *task_data, int index)
+{
+   stbi__jpeg_bands *b = (stbi__jpeg_bands *) task_data;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   unsigned int y_begin = index * STBI__JPEG_BAND_ROWS;
+   unsigned int y_end = y_begin + STBI__JPEG_BAND_ROWS;
+   int k;
+   if (y_end > b->z->s->img_y) y_end = b->z->s->img_y;
+   for (k=0; k < b->decode_n; ++k) {
+      res_comp[k] = b->res_comp[k];
+      linebuf[k] = b->linebuf + (index * b->decode_n + k) * (b->z->s->img_x + 3);
+   }
+   stbi__jpeg_convert_rows(b->z, res_comp, linebuf, b->output, b->last_rows + index * (b->n * b->z->s->img_x + 1), b->n, b->decode_n, b->is_rgb, y_begin, y_end);
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3819,6 +4543,17 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // the planes were decoded at reduced scale, from here on the image is that size
+   if (z->scale_shift) {
+      int k;
+      z->s->img_x = (z->s->img_x + (1u << z->scale_shift) - 1) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + (1u << z->scale_shift) - 1) >> z->scale_shift;
+      for (k=0; k < z->s->img_n; ++k) {
+         z->img_comp[k].x = (z->s->img_x * z->img_comp[k].h + z->img_h_max-1) / z->img_h_max;
+         z->img_comp[k].y = (z->s->img_y * z->img_comp[k].v + z->img_v_max-1) / z->img_v_max;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3836,9 +4571,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
       stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
 
@@ -3865,102 +4598,45 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       }
 
       // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+      if (z->s->into) {
+         if (!stbi__into_fits(z->s, z->s->img_x, z->s->img_y, n)) { stbi__cleanup_jpeg(z); return stbi__errpuc("too small", "Destination buffer too small"); }
+         output = z->s->into;
+      } else
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
+      {
+         stbi__jpeg_bands b;
+         int band_count = (z->s->img_y + STBI__JPEG_BAND_ROWS - 1) / STBI__JPEG_BAND_ROWS;
+         b.linebuf = b.last_rows = NULL;
+         if (stbi__parallel_for && band_count > 1) {
+            b.linebuf = (stbi_uc *) stbi__malloc_mad3(band_count * decode_n, z->s->img_x + 3, 1, 0);
+            b.last_rows = (stbi_uc *) stbi__malloc_mad3(band_count, n, z->s->img_x, band_count);
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
+         if (b.linebuf && b.last_rows) {
+            b.z = z;
+            b.res_comp = res_comp;
+            b.output = output;
+            b.n = n;
+            b.decode_n = decode_n;
+            b.is_rgb = is_rgb;
+            stbi__parallel_for(stbi__parallel_for_user, band_count, stbi__jpeg_convert_band_task, &b);
+            STBI_FREE(b.last_rows);
+            STBI_FREE(b.linebuf);
          } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            stbi_uc *linebuf[4];
+            stbi_uc *row = NULL;
+            STBI_FREE(b.last_rows);
+            STBI_FREE(b.linebuf);
+            for (k=0; k < decode_n; ++k)
+               linebuf[k] = z->img_comp[k].linebuf;
+            if (z->s->into && (n & 1)) {
+               row = (stbi_uc *) stbi__malloc_mad2(n, z->s->img_x, 1);
+               if (!row) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
             }
+            stbi__jpeg_convert_rows(z, res_comp, linebuf, output, row, n, decode_n, is_rgb, 0, z->s->img_y);
+            STBI_FREE(row);
          }
       }
       stbi__cleanup_jpeg(z);
@@ -4034,6 +4710,9 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
+// two literals whose codes fit in this many bits are decoded with a single lookup
+#define STBI__ZPAIR_BITS  11
+#define STBI__ZPAIR_MASK  ((1 << STBI__ZPAIR_BITS) - 1)
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
@@ -4129,6 +4808,8 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+   // literal | second literal << 8 | total code bits << 16, or 0 when the bits do not start with two literals
+   stbi__uint32 literal_pairs[1 << STBI__ZPAIR_BITS];
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4279,6 +4960,84 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
    }
 }
 
+static void stbi__zbuild_literal_pairs(stbi__zbuf *a)
+{
+   int i;
+   for (i=0; i < (1 << STBI__ZPAIR_BITS); ++i) {
+      int b1 = a->z_length.fast[i & STBI__ZFAST_MASK], b2, s1, s2;
+      a->literal_pairs[i] = 0;
+      if (!b1 || (b1 & 511) >= 256) continue;
+      s1 = b1 >> 9;
+      // bits above STBI__ZPAIR_BITS-s1 are zero here, the fast table repeats each code
+      // across them so the lookup is exact whenever the second code fits
+      b2 = a->z_length.fast[(i >> s1) & STBI__ZFAST_MASK];
+      if (!b2 || (b2 & 511) >= 256) continue;
+      s2 = b2 >> 9;
+      if (s1 + s2 > STBI__ZPAIR_BITS) continue;
+      a->literal_pairs[i] = (stbi__uint32) ((b1 & 255) | ((b2 & 255) << 8) | ((s1 + s2) << 16));
+   }
+}
+
+// stbi__parse_huffman_block with literal pairs and block copies for matches
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a)
+{
+   char *zout = a->zout;
+   for(;;) {
+      int z;
+      if (a->num_bits < 16 && !stbi__zeof(a)) stbi__fill_bits(a);
+      if (a->num_bits >= STBI__ZPAIR_BITS && zout + 2 <= a->zout_end) {
+         stbi__uint32 pair = a->literal_pairs[a->code_buffer & STBI__ZPAIR_MASK];
+         if (pair) {
+            int bits = (int) (pair >> 16);
+            zout[0] = (char) (pair & 255);
+            zout[1] = (char) ((pair >> 8) & 255);
+            zout += 2;
+            a->code_buffer >>= bits;
+            a->num_bits -= bits;
+            continue;
+         }
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
+      if (z < 256) {
+         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+         if (zout >= a->zout_end) {
+            if (!stbi__zexpand(a, zout, 1)) return 0;
+            zout = a->zout;
+         }
+         *zout++ = (char) z;
+      } else {
+         stbi_uc *p;
+         int len,dist;
+         if (z == 256) {
+            a->zout = zout;
+            return 1;
+         }
+         z -= 257;
+         len = stbi__zlength_base[z];
+         if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
+         z = stbi__zhuffman_decode(a, &a->z_distance);
+         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+         dist = stbi__zdist_base[z];
+         if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
+         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+         if (zout + len > a->zout_end) {
+            if (!stbi__zexpand(a, zout, len)) return 0;
+            zout = a->zout;
+         }
+         p = (stbi_uc *) (zout - dist);
+         if (dist == 1) {
+            memset(zout, *p, len);
+            zout += len;
+         } else if (dist >= len) {
+            memcpy(zout, p, len);
+            zout += len;
+         } else {
+            if (len) { do *zout++ = *p++; while (--len); }
+         }
+      }
+   }
+}
+
 static int stbi__compute_huffman_codes(stbi__zbuf *a)
 {
    static const stbi_uc length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
@@ -4423,7 +5182,12 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
-         if (!stbi__parse_huffman_block(a)) return 0;
+         if (stbi__png_fast_path) {
+            stbi__zbuild_literal_pairs(a);
+            if (!stbi__parse_huffman_block_fast(a)) return 0;
+         } else {
+            if (!stbi__parse_huffman_block(a)) return 0;
+         }
       }
    } while (!final);
    return 1;
@@ -4590,6 +5354,133 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// Up works on 16 bytes at a time. Sub, Avg and Paeth depend on the pixel to the left, so
+// like libpng they step one 3 or 4 byte pixel per iteration with all channels in one register,
+// except Sub which turns into a prefix sum over four pixels.
+static __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp)
+{
+   // constant sizes so the copies compile to plain moves
+   stbi__uint32 v;
+   if (bpp == 4) {
+      memcpy(&v, p, 4);
+   } else {
+      stbi__uint16 low;
+      memcpy(&low, p, 2);
+      v = low | ((stbi__uint32) p[2] << 16);
+   }
+   return _mm_cvtsi32_si128((int) v);
+}
+
+static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int bpp)
+{
+   stbi__uint32 x = (stbi__uint32) _mm_cvtsi128_si32(v);
+   if (bpp == 4) {
+      memcpy(p, &x, 4);
+   } else {
+      stbi__uint16 low = (stbi__uint16) x;
+      memcpy(p, &low, 2);
+      p[2] = (stbi_uc) (x >> 16);
+   }
+}
+
+static __m128i stbi__png_select(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static __m128i stbi__png_abs16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+// unfilter n bytes of an 8-bit row whose first pixel is already done, returns 0 if not handled here
+static int stbi__png_unfilter_row_simd(int filter, stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int n, int bpp)
+{
+   int k = 0;
+   if (!stbi__png_fast_path || !stbi__sse2_available()) return 0;
+   if (filter == STBI__F_up) {
+      for (; k + 16 <= n; k += 16)
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw + k)), _mm_loadu_si128((const __m128i *) (prior + k))));
+      for (; k < n; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   if (bpp != 3 && bpp != 4) return 0;
+
+   if (filter == STBI__F_sub) {
+      __m128i a = stbi__png_load_pixel(cur - bpp, bpp);
+      if (bpp == 4) {
+         a = _mm_shuffle_epi32(a, 0);
+         for (; k + 16 <= n; k += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (raw + k));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi8(x, a);
+            _mm_storeu_si128((__m128i *) (cur + k), x);
+            a = _mm_shuffle_epi32(x, 0xff);
+         }
+      } else {
+         // four pixels in the low 12 bytes, the top 4 bytes written here are redone next iteration
+         const __m128i low3 = _mm_cvtsi32_si128(0xffffff);
+         for (; k + 16 <= n; k += 12) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (raw + k));
+            __m128i left = _mm_or_si128(a, _mm_slli_si128(a, 3));
+            left = _mm_or_si128(left, _mm_slli_si128(left, 6));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+            x = _mm_add_epi8(x, left);
+            _mm_storeu_si128((__m128i *) (cur + k), x);
+            a = _mm_and_si128(_mm_srli_si128(x, 9), low3);
+         }
+      }
+      for (; k < n; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-bpp]);
+      return 1;
+   }
+
+   if (filter == STBI__F_avg) {
+      __m128i a = stbi__png_load_pixel(cur - bpp, bpp);
+      const __m128i one = _mm_set1_epi8(1);
+      for (; k < n; k += bpp) {
+         __m128i b = stbi__png_load_pixel(prior + k, bpp);
+         // _mm_avg_epu8 rounds up, the filter rounds down
+         __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), average);
+         stbi__png_store_pixel(cur + k, a, bpp);
+      }
+      return 1;
+   }
+
+   if (filter == STBI__F_paeth) {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i byte_mask = _mm_set1_epi16(0xff);
+      __m128i a = _mm_unpacklo_epi8(stbi__png_load_pixel(cur - bpp, bpp), zero);
+      __m128i c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - bpp, bpp), zero);
+      for (; k < n; k += bpp) {
+         __m128i b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, bpp), zero);
+         __m128i x = _mm_unpacklo_epi8(stbi__png_load_pixel(raw + k, bpp), zero);
+         __m128i pa = _mm_sub_epi16(b, c);   // p-a
+         __m128i pb = _mm_sub_epi16(a, c);   // p-b
+         __m128i pc = _mm_add_epi16(pa, pb); // p-c
+         __m128i smallest, nearest;
+         pa = stbi__png_abs16(pa);
+         pb = stbi__png_abs16(pb);
+         pc = stbi__png_abs16(pc);
+         smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+         // ties favor a, then b, then c
+         nearest = stbi__png_select(_mm_cmpeq_epi16(smallest, pb), b, c);
+         nearest = stbi__png_select(_mm_cmpeq_epi16(smallest, pa), a, nearest);
+         a = _mm_and_si128(_mm_add_epi16(x, nearest), byte_mask);
+         stbi__png_store_pixel(cur + k, _mm_packus_epi16(a, zero), bpp);
+         c = b;
+      }
+      return 1;
+   }
+   return 0;
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4675,6 +5566,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          #define STBI__CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
+#ifdef STBI_SSE2
+         if (depth == 8 && stbi__png_unfilter_row_simd(filter, cur, raw, prior, nk, filter_bytes)) {
+         } else
+#endif
          switch (filter) {
             // "none" filter turns into a memcpy here; make that explicit.
             case STBI__F_none:         memcpy(cur, raw, nk); break;
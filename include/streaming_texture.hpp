@@ -0,0 +1,339 @@
+#ifndef STREAMING_TEXTURE_HPP
+#define STREAMING_TEXTURE_HPP
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <iostream>
+#include <cstdint>
+
+#include "texture_format.hpp"
+#include "texture_residency.hpp"
+
+const int STREAMING_TEXTURE_BUFFERS = 3;
+
+// BGRA with the reversed packed type is the layout drivers copy into RGBA8 without swizzling on the CPU,
+// the one to produce for video sized frames.
+inline TextureFormat streaming_texture_format(bool srgb = false)
+{
+    TextureFormat format;
+    format.internal_format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    format.format = GL_BGRA;
+    format.type = GL_UNSIGNED_INT_8_8_8_8_REV;
+    format.channels = 4;
+    format.bytes_per_texel = 4;
+    format.vram_bytes_per_texel = 4;
+    return format;
+}
+
+// A texture whose contents change every frame, e.g. video or procedural data. A producer thread writes
+// frames into pixel unpack buffers used round-robin, update() on the GL thread starts the copy of the newest
+// finished frame with glTexSubImage2D and fences it. A buffer is mapped for the producer again only once its
+// fence has passed, so the producer writes frame k+1 while the GPU still reads frame k and neither side
+// waits on the other. The copy goes into the texture that was not sampled last frame, so it does not wait
+// on draws either. Storage is specified once and never respecified, 3.3 has no glTexStorage2D. Tracked by a
+// TextureResidency, a texture left unused over budget gives up the second texture and copies into the one
+// it samples until it is restored.
+class StreamingTexture
+{
+public:
+    // Fills a frame of height rows, pitch bytes apart. Block until a frame is due, e.g. a video's next
+    // presentation time. Returning false skips the frame and is called again with the same buffer.
+    using Producer = std::function<bool(unsigned char *pixels, size_t pitch, uint64_t frame)>;
+
+    const int width;
+    const int height;
+    const TextureFormat format;
+    const size_t pitch;
+
+    StreamingTexture(int width_value, int height_value, const TextureFormat &format_value = streaming_texture_format(), int buffer_count = STREAMING_TEXTURE_BUFFERS) :
+        width(width_value), height(height_value), format(format_value),
+        pitch((static_cast<size_t>(width_value) * format_value.bytes_per_texel + 3) & ~static_cast<size_t>(3)),
+        buffers(static_cast<size_t>(std::max(2, buffer_count)))
+    {
+        GLint previous_texture, previous_unpack_buffer;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &previous_unpack_buffer);
+
+        for (unsigned int &texture : textures)
+            create_texture(texture);
+        for (Buffer &buffer : buffers)
+        {
+            glGenBuffers(1, &buffer.id);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(frame_bytes()), nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, static_cast<GLuint>(previous_unpack_buffer));
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+        map_free_buffers();
+    }
+
+    StreamingTexture(const StreamingTexture &) = delete;
+    StreamingTexture &operator=(const StreamingTexture &) = delete;
+
+    // Starts the producer thread, call at most once.
+    void start(Producer producer_value)
+    {
+        producer = std::move(producer_value);
+        worker = std::thread([this]() { produce(); });
+    }
+
+    size_t frame_bytes() const
+    {
+        return pitch * static_cast<size_t>(height);
+    }
+
+    // The texture holding the newest uploaded frame, bind it after update().
+    unsigned int id() const
+    {
+        return textures[front];
+    }
+
+    // Tracks the textures with residency. residency has to outlive the streaming texture.
+    void track_memory(TextureResidency &residency_value)
+    {
+        residency = &residency_value;
+        const size_t texture_bytes = texture_vram_bytes(format, width, height, 1);
+        residency->track(this, 0, (textures[1 - front] ? 2 : 1) * texture_bytes, 2 * texture_bytes, [this, texture_bytes]() {
+            glDeleteTextures(1, &textures[1 - front]);
+            textures[1 - front] = 0;
+            return texture_bytes;
+        }, [this, texture_bytes]() {
+            if (!textures[1 - front])
+            {
+                GLint previous_texture;
+                glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+                create_texture(textures[1 - front]);
+                glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+            }
+            return 2 * texture_bytes;
+        });
+    }
+
+    // Frame number in id(), 0 before the first frame arrived.
+    uint64_t frame() const
+    {
+        return current_frame;
+    }
+
+    // Call once per frame on the GL thread, before drawing with id(). Never blocks on the GPU.
+    void update()
+    {
+        if (residency)
+            residency->use(this, 0);
+        GLint previous_texture, previous_unpack_buffer;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &previous_unpack_buffer);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        for (Buffer &buffer : buffers)
+        {
+            if (buffer.state != State::Uploading)
+                continue;
+            GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            {
+                glDeleteSync(buffer.fence);
+                buffer.fence = nullptr;
+                buffer.state = State::Free;
+            }
+        }
+
+        // Only the newest finished frame is copied, older ones the producer got ahead with are dropped.
+        std::vector<size_t> filled;
+        size_t newest = buffers.size();
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            if (buffers[i].state != State::Filled)
+                continue;
+            filled.push_back(i);
+            if (newest == buffers.size() || buffers[i].frame > buffers[newest].frame)
+                newest = i;
+        }
+        lock.unlock();
+        // The producer leaves filled buffers alone, they are this thread's until mapped again.
+        for (size_t i : filled)
+        {
+            Buffer &buffer = buffers[i];
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+            buffer.pixels = nullptr;
+            buffer.state = State::Free;
+            if (i != newest || !intact)
+            {
+                dropped++;
+                continue;
+            }
+            // Demoted to a single texture, the copy waits for the draws sampling it.
+            const int back = textures[1 - front] ? 1 - front : front;
+            glBindTexture(GL_TEXTURE_2D, textures[back]);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(static_cast<size_t>(width) * format.bytes_per_texel, pitch));
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format.format, format.type, (void*)(0));
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            buffer.state = State::Uploading;
+            front = back;
+            current_frame = buffer.frame;
+            uploaded++;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, static_cast<GLuint>(previous_unpack_buffer));
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+        map_free_buffers();
+    }
+
+    void report() const
+    {
+        std::cout << "STREAMING_TEXTURE: " << width << "x" << height << ", " << buffers.size() << " buffers of "
+                  << frame_bytes() / (1024 * 1024.0) << " MB, " << uploaded << " frames uploaded, " << dropped
+                  << " dropped, producer waited " << producer_waits << " times\n";
+    }
+
+    ~StreamingTexture()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        if (worker.joinable())
+            worker.join();
+        for (Buffer &buffer : buffers)
+        {
+            if (buffer.fence)
+                glDeleteSync(buffer.fence);
+            if (buffer.pixels)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            glDeleteBuffers(1, &buffer.id);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteTextures(2, textures);
+        if (residency)
+            residency->forget(this);
+    }
+
+private:
+    // Free: unmapped, GPU done with it. Mapped: waiting for or being written by the producer.
+    // Filled: a finished frame for update(). Uploading: copy into the texture fenced, GPU may still read it.
+    enum class State
+    {
+        Free,
+        Mapped,
+        Filled,
+        Uploading
+    };
+
+    struct Buffer
+    {
+        unsigned int id = 0;
+        State state = State::Free;
+        unsigned char *pixels = nullptr;
+        GLsync fence = nullptr;
+        uint64_t frame = 0;
+    };
+
+    unsigned int textures[2] = { 0, 0 };
+    int front = 0;
+    TextureResidency *residency = nullptr;
+    uint64_t current_frame = 0;
+    std::vector<Buffer> buffers;
+    // Mapped buffers in the order the producer should fill them.
+    std::deque<size_t> ready;
+    Producer producer;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+    uint64_t next_frame = 1;
+    size_t uploaded = 0;
+    size_t dropped = 0;
+    std::atomic<size_t> producer_waits{ 0 };
+
+    // Creates a texture for frames and leaves it bound.
+    void create_texture(unsigned int &texture)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format.internal_format, width, height, 0, format.format, format.type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        apply_texture_swizzle(GL_TEXTURE_2D, format);
+    }
+
+    // The fence has passed for every free buffer, so mapping unsynchronized never waits on the driver.
+    void map_free_buffers()
+    {
+        GLint previous_unpack_buffer;
+        glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &previous_unpack_buffer);
+        bool mapped_any = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            Buffer &buffer = buffers[i];
+            if (buffer.state != State::Free)
+                continue;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(frame_bytes()),
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (!pixels)
+                continue;
+            buffer.pixels = static_cast<unsigned char*>(pixels);
+            buffer.state = State::Mapped;
+            ready.push_back(i);
+            mapped_any = true;
+        }
+        lock.unlock();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, static_cast<GLuint>(previous_unpack_buffer));
+        if (mapped_any)
+            condition.notify_one();
+    }
+
+    // Runs on the producer thread, touches buffer memory only, never GL.
+    void produce()
+    {
+        while (true)
+        {
+            size_t index;
+            unsigned char *pixels;
+            uint64_t frame_number;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (ready.empty() && !stopping)
+                    producer_waits++;
+                condition.wait(lock, [this]() { return stopping || !ready.empty(); });
+                if (stopping)
+                    return;
+                index = ready.front();
+                ready.pop_front();
+                pixels = buffers[index].pixels;
+                frame_number = next_frame;
+            }
+            bool produced = producer(pixels, pitch, frame_number);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (produced)
+            {
+                buffers[index].frame = frame_number;
+                buffers[index].state = State::Filled;
+                next_frame++;
+            }
+            else
+            {
+                ready.push_front(index);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,1154 @@
+#ifndef TEXTURE_ARRAY_HPP
+#define TEXTURE_ARRAY_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <utility>
+#include <tuple>
+#include <atomic>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <iostream>
+
+#include "thread_pool.hpp"
+#include "texture_options.hpp"
+#include "texture_format.hpp"
+#include "mip_generator.hpp"
+#include "stb_image.h"
+#include "mapped_file.hpp"
+#include "decode_arena.hpp"
+#include "decoded_cache.hpp"
+#include "ktx_texture.hpp"
+#include "texture_residency.hpp"
+
+const int TEXTURE_ARRAY_LAYERS = 16;
+const int ATLAS_SIZE = 1024;
+const int ATLAS_MAX_IMAGE_SIZE = 128;
+// Atlas entries are extruded by the padding and aligned so their first mips stay apart.
+const int ATLAS_PADDING = 4;
+const int ATLAS_MIP_LEVELS = 3;
+const int ATLAS_ALIGNMENT = 1 << (ATLAS_MIP_LEVELS - 1);
+// Largest side of the mip tail a streamed image shows until its finer levels arrive.
+const int TEXTURE_STREAM_TAIL_SIZE = 32;
+
+// Bottom-left skyline rectangle packer.
+class SkylinePacker
+{
+public:
+    SkylinePacker(int width_value, int height_value) : width(width_value), height(height_value), used_area(0)
+    {
+        skyline.push_back({ 0, 0, width });
+    }
+
+    bool pack(int rect_width, int rect_height, int &x, int &y)
+    {
+        int best = -1, best_y = height, best_waste = width * height;
+        for (size_t i = 0; i < skyline.size(); i++)
+        {
+            int fit_y;
+            if (!fits(i, rect_width, rect_height, fit_y))
+                continue;
+            int waste = waste_below(i, rect_width, fit_y);
+            if (fit_y < best_y || (fit_y == best_y && waste < best_waste))
+            {
+                best = static_cast<int>(i);
+                best_y = fit_y;
+                best_waste = waste;
+            }
+        }
+        if (best < 0)
+            return false;
+
+        x = skyline[best].x;
+        y = best_y;
+        skyline.insert(skyline.begin() + best, { x, y + rect_height, rect_width });
+
+        // Segments now covered by the new one are cut back or removed.
+        for (size_t i = best + 1; i < skyline.size();)
+        {
+            Segment &segment = skyline[i];
+            int covered = x + rect_width - segment.x;
+            if (covered <= 0)
+                break;
+            if (covered < segment.width)
+            {
+                segment.x += covered;
+                segment.width -= covered;
+                break;
+            }
+            skyline.erase(skyline.begin() + i);
+        }
+        for (size_t i = 0; i + 1 < skyline.size();)
+        {
+            if (skyline[i].y == skyline[i + 1].y)
+            {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        used_area += static_cast<size_t>(rect_width) * rect_height;
+        return true;
+    }
+
+    float occupancy() const
+    {
+        return static_cast<float>(used_area) / (static_cast<float>(width) * height);
+    }
+
+private:
+    struct Segment
+    {
+        int x;
+        int y;
+        int width;
+    };
+
+    int width;
+    int height;
+    size_t used_area;
+    std::vector<Segment> skyline;
+
+    bool fits(size_t index, int rect_width, int rect_height, int &fit_y) const
+    {
+        if (skyline[index].x + rect_width > width)
+            return false;
+        fit_y = 0;
+        int remaining = rect_width;
+        for (size_t i = index; remaining > 0; i++)
+        {
+            if (i >= skyline.size())
+                return false;
+            fit_y = std::max(fit_y, skyline[i].y);
+            if (fit_y + rect_height > height)
+                return false;
+            remaining -= skyline[i].width;
+        }
+        return true;
+    }
+
+    int waste_below(size_t index, int rect_width, int fit_y) const
+    {
+        int waste = 0;
+        int left = skyline[index].x, right = left + rect_width;
+        for (size_t i = index; i < skyline.size() && skyline[i].x < right; i++)
+        {
+            int segment_right = std::min(right, skyline[i].x + skyline[i].width);
+            waste += (segment_right - skyline[i].x) * (fit_y - skyline[i].y);
+        }
+        return waste;
+    }
+};
+
+// Where an image lives: a layer of an array texture, and the part of that layer it covers.
+// Sample with texture(array, vec3(uv_rect.xy + texture_coord * uv_rect.zw, layer)).
+struct TextureSlot
+{
+    unsigned int texture = 0;
+    int layer = -1;
+    glm::vec4 uv_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+    bool valid() const
+    {
+        return layer >= 0;
+    }
+};
+
+// Packs images into GL_TEXTURE_2D_ARRAY pages so draws using different images can share one binding.
+// Pages start with a single layer and double their layers as they fill, up to TEXTURE_ARRAY_LAYERS.
+// Images of the same size get a whole layer each and keep repeat wrapping. Images up to
+// ATLAS_MAX_IMAGE_SIZE are skyline packed into atlas layers, clamped to their rect, with ATLAS_MIP_LEVELS mips.
+// Pages hold one format each, chosen by format_policy from the channels the file declares, so grey images and
+// masks share R8 or RG8 pages. load() reserves the slot at once, the decode runs on the pool and update() fills it.
+// With progressive set, full layer images start as a mip tail of at most TEXTURE_STREAM_TAIL_SIZE, decoded at
+// reduced scale, and their finer levels stream in later. request_detail() tells which slots need how much detail,
+// the largest on screen are decoded first. Sampling has to be clamped to min_lod(), slots show a black placeholder
+// in their coarsest level until their image lands.
+// Loads of the same path and options share one slot, and a .ktx that texture_cook wrote next to a full layer
+// image is uploaded from its mapping instead of decoding the image. Nothing is written next to the sources at
+// runtime. Levels go through a pixel unpack buffer.
+class TextureArrayAllocator
+{
+public:
+    size_t upload_budget;
+    TextureFormatPolicy format_policy;
+    bool progressive = true;
+    // Off until opened with a directory. Full chains are stored once decoded and mapped on later runs.
+    DecodedTextureCache disk_cache;
+    // Streaming decodes running at once, mip tails included, so every tail goes out before the finer levels.
+    size_t max_stream_jobs = 2;
+    size_t hits = 0;
+    size_t misses = 0;
+
+    explicit TextureArrayAllocator(ThreadPool &pool_value, size_t upload_budget_value = 8 * 1024 * 1024) : upload_budget(upload_budget_value), pool(pool_value)
+    {
+        format_policy.detect_support();
+        glGenBuffers(1, &PBO);
+    }
+
+    TextureArrayAllocator(const TextureArrayAllocator &) = delete;
+    TextureArrayAllocator &operator=(const TextureArrayAllocator &) = delete;
+
+    // Returns an invalid slot when the image cannot be read. Only wrap_s and wrap_t of the first
+    // image placed in a full-layer page are applied, atlas pages always clamp. Every load of a slot
+    // needs its own release().
+    TextureSlot load(const std::string &path, const TextureOptions &options = TextureOptions())
+    {
+        Key key(canonical_texture_path(path), options);
+        auto found = entries.find(key);
+        if (found != entries.end())
+        {
+            hits++;
+            images[slot_key(found->second)].references++;
+            return found->second;
+        }
+
+        misses++;
+        TextureSlot slot = load_slot(key, path, options);
+        if (slot.valid())
+            entries[key] = slot;
+        return slot;
+    }
+
+    // The slot is drawn this frame covering screen_pixels pixels along the image's larger side, call it for every
+    // slot drawn. Pages none of whose slots were asked for lately may lose their top mips to the residency budget.
+    // For streamed slots the finest level that still has a texel per pixel is streamed in, larger ones first.
+    void request_detail(const TextureSlot &slot, float screen_pixels)
+    {
+        auto found = images.find(slot_key(slot));
+        if (found == images.end())
+            return;
+        if (residency)
+            residency->use(this, slot.texture);
+        if (!found->second.streamed)
+            return;
+        Image &image = found->second;
+        float texels = static_cast<float>(std::max(image.request.width, image.request.height));
+        int level = screen_pixels >= texels ? 0 : std::min(static_cast<int>(std::log2(texels / std::max(screen_pixels, 1.0f))), image.levels - 1);
+        image.needed_level = std::min(image.needed_level, level);
+        image.priority = std::max(image.priority, screen_pixels);
+    }
+
+    // Finest level of the page sampling may use, levels below it are not uploaded yet. The coarsest level,
+    // holding the placeholder, until the first upload lands and for good when it failed.
+    float min_lod(const TextureSlot &slot) const
+    {
+        auto found = images.find(slot_key(slot));
+        if (found == images.end())
+            return 0.0f;
+        const int top = top_level(slot.texture);
+        return static_cast<float>(std::min(std::max(found->second.resident_level, top), found->second.levels - 1) - top);
+    }
+
+    // Call once per frame on the GL thread, at least one image is uploaded per call.
+    void update()
+    {
+        schedule_streaming();
+
+        size_t uploaded = 0;
+        while (true)
+        {
+            Request request;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty())
+                    break;
+                size_t size = decoded.front().size();
+                if (uploaded > 0 && uploaded + size > upload_budget)
+                    break;
+                request = std::move(decoded.front());
+                decoded.pop_front();
+            }
+            in_flight--;
+            // The slot was released while decoding, its layer may already hold another image.
+            if (*request.cancelled)
+            {
+                stream_jobs -= request.streamed ? 1 : 0;
+                continue;
+            }
+            uploaded += request.size();
+            if (request.streamed)
+            {
+                upload_streamed(request);
+            }
+            else
+            {
+                bool uploaded_levels = upload(request);
+                auto found = images.find(slot_key(request.slot));
+                if (found == images.end())
+                    continue;
+                found->second.loading_level = -1;
+                if (uploaded_levels)
+                    found->second.resident_level = top_level(request.slot.texture);
+            }
+        }
+
+        // Finished decodes only hold their future, keep the list to the ones still running.
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](std::future<void> &job) {
+            return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }), jobs.end());
+    }
+
+    // Drops one load of the slot. With the last one its decodes still running are cancelled and a full layer
+    // returns to its page, atlas rects are not reclaimed. Slots that are not loaded are ignored.
+    void release(const TextureSlot &slot)
+    {
+        auto found = images.find(slot_key(slot));
+        if (found == images.end() || --found->second.references > 0)
+            return;
+        Image &image = found->second;
+        *image.request.cancelled = true;
+        entries.erase(image.key);
+        if (!image.atlas)
+        {
+            for (Page &page : pages)
+            {
+                if (page.texture == slot.texture)
+                    page.free_layers.push_back(slot.layer);
+            }
+        }
+        images.erase(found);
+    }
+
+    size_t pending() const
+    {
+        return in_flight;
+    }
+
+    // Tracks the pages with residency, now and as pages are added, so idle ones drop top mips when over budget.
+    // residency has to outlive the allocator.
+    void track_memory(TextureResidency &residency_value)
+    {
+        residency = &residency_value;
+        for (const Page &page : pages)
+            track_page(page);
+    }
+
+    void report() const
+    {
+        TextureMemoryStats memory;
+        for (const Page &page : pages)
+        {
+            std::cout << "TEXTURE_ARRAY: " << page.width << "x" << page.height << " " << (page.atlas ? "atlas" : "layers") << ", format 0x"
+                      << std::hex << page.format.internal_format << std::dec << ", " << page.used_layers << "/" << page.capacity << " layers";
+            if (page.atlas && !page.packers.empty())
+                std::cout << ", last layer " << static_cast<int>(page.packers.back().occupancy() * 100.0f) << "% packed";
+            if (page.top_level > 0)
+                std::cout << ", " << page.top_level << " top levels dropped";
+            std::cout << "\n";
+            memory.add(page.format, std::max(1, page.width >> page.top_level), std::max(1, page.height >> page.top_level), page.levels - page.top_level, page.capacity);
+        }
+        memory.report("TEXTURE_ARRAY");
+        std::cout << "TEXTURE_ARRAY: " << images.size() << " images, " << hits << " hits, " << misses << " misses\n";
+        disk_cache.report();
+        size_t streamed = 0;
+        size_t full_detail = 0;
+        for (const auto &item : images)
+        {
+            streamed += item.second.streamed ? 1 : 0;
+            full_detail += item.second.streamed && item.second.resident_level == 0 ? 1 : 0;
+        }
+        if (streamed > 0)
+            std::cout << "TEXTURE_ARRAY: " << streamed << " streamed images, " << full_detail << " at full detail\n";
+    }
+
+    ~TextureArrayAllocator()
+    {
+        for (std::future<void> &job : jobs)
+            job.wait();
+        for (Page &page : pages)
+            glDeleteTextures(1, &page.texture);
+        glDeleteBuffers(1, &PBO);
+        if (residency)
+            residency->forget(this);
+    }
+
+private:
+    struct LevelData
+    {
+        int width;
+        int height;
+        size_t pitch;
+        const unsigned char *data;
+        size_t size;
+    };
+
+    struct Request
+    {
+        std::string path;
+        TextureOptions options;
+        TextureSlot slot;
+        int width = 0;
+        int height = 0;
+        int x = 0;
+        int y = 0;
+        int padded_width = 0;
+        int padded_height = 0;
+        TextureFormat format;
+        // Streamed requests carry the levels from first_level down.
+        bool streamed = false;
+        int first_level = 0;
+        std::vector<MipLevel> levels;
+        // Set instead of levels when the disk cache had the chain, all of its levels are mapped.
+        std::shared_ptr<DecodedCacheEntry> cached;
+        // Set instead of levels for a cooked .ktx, its levels are stored in format.
+        std::shared_ptr<KtxFile> cooked;
+        // Shared by every request of a slot, set once the slot is released.
+        std::shared_ptr<std::atomic<bool>> cancelled;
+
+        size_t level_count() const
+        {
+            if (cooked)
+                return cooked->level_count() - static_cast<size_t>(first_level);
+            return cached ? cached->levels.size() - static_cast<size_t>(first_level) : levels.size();
+        }
+
+        // Level first_level + i, from the decoded chain or one of the mappings.
+        LevelData level(size_t i) const
+        {
+            if (cooked)
+            {
+                uint32_t index = static_cast<uint32_t>(first_level + i);
+                int level_width = std::max(1, width >> index);
+                int level_height = std::max(1, height >> index);
+                size_t pitch = format.compressed() ? 0 : mip_pitch(level_width, format.bytes_per_texel);
+                size_t size = format.compressed() ? compressed_level_size(format, level_width, level_height) : pitch * level_height;
+                return { level_width, level_height, pitch, cooked->level_data(index), size };
+            }
+            if (cached)
+            {
+                size_t index = static_cast<size_t>(first_level) + i;
+                const DecodedCacheLevel &entry = cached->levels[index];
+                return { static_cast<int>(entry.width), static_cast<int>(entry.height), static_cast<size_t>(entry.pitch), cached->level_data(index), static_cast<size_t>(entry.size) };
+            }
+            return { levels[i].width, levels[i].height, levels[i].pitch, levels[i].data.data(), levels[i].data.size() };
+        }
+
+        size_t size() const
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < level_count(); i++)
+                total += level(i).size;
+            return total;
+        }
+    };
+
+    struct Page
+    {
+        unsigned int texture = 0;
+        int width = 0;
+        int height = 0;
+        bool atlas = false;
+        TextureFormat format;
+        int levels = 0;
+        // Layers allocated, doubled as they fill up to TEXTURE_ARRAY_LAYERS.
+        int capacity = 0;
+        // Levels dropped from the top of the chain for the residency budget, image level L is GL level L - top_level.
+        int top_level = 0;
+        int used_layers = 0;
+        std::vector<int> free_layers;
+        std::vector<SkylinePacker> packers;
+    };
+
+    typedef std::pair<std::string, TextureOptions> Key;
+
+    // A loaded slot. Streamed ones are full layer images whose levels arrive from the mip tail up.
+    struct Image
+    {
+        Request request;
+        Key key;
+        bool atlas = false;
+        // Uploaded from a cooked .ktx, decoded again from there when its page gets its top levels back.
+        bool cooked = false;
+        size_t references = 0;
+        bool streamed = false;
+        int levels = 0;
+        // Finest level in the slot, levels while it only holds the placeholder.
+        int resident_level = 0;
+        // Level being decoded, -1 when idle.
+        int loading_level = -1;
+        // What this frame's request_detail calls asked for, reset by every update.
+        int needed_level = INT_MAX;
+        float priority = 0.0f;
+        bool failed = false;
+    };
+
+    // Atlas rects share a layer, so their slots also differ in where the rect starts.
+    typedef std::tuple<unsigned int, int, float, float> SlotKey;
+
+    ThreadPool &pool;
+    unsigned int PBO = 0;
+    std::map<Key, TextureSlot> entries;
+    std::map<SlotKey, Image> images;
+    std::vector<Page> pages;
+    TextureResidency *residency = nullptr;
+    size_t stream_jobs = 0;
+    std::vector<std::future<void>> jobs;
+    std::deque<Request> decoded;
+    size_t in_flight = 0;
+    std::mutex mutex;
+
+    static SlotKey slot_key(const TextureSlot &slot)
+    {
+        return SlotKey(slot.texture, slot.layer, slot.uv_rect.x, slot.uv_rect.y);
+    }
+
+    // Records a slot that was just reserved and puts the placeholder into its coarsest level.
+    Image &add_image(const Key &key, const Request &request, bool atlas)
+    {
+        Image &image = images[slot_key(request.slot)];
+        image.request = request;
+        image.request.cooked.reset();
+        image.key = key;
+        image.atlas = atlas;
+        image.references = 1;
+        image.levels = atlas ? ATLAS_MIP_LEVELS : mip_level_count(request.width, request.height);
+        image.resident_level = image.levels;
+        clear_level(request, image.levels - 1);
+        return image;
+    }
+
+    // Zeroes the slot's part of one image level, a reused layer or rect would otherwise show its previous image.
+    void clear_level(const Request &request, int level)
+    {
+        const int page_level = level - top_level(request.slot.texture);
+        const bool atlas = request.padded_width > 0;
+        const int width = std::max(1, (atlas ? request.padded_width : request.width) >> level);
+        const int height = std::max(1, (atlas ? request.padded_height : request.height) >> level);
+        const TextureFormat &format = request.format;
+        const size_t size = format.compressed() ? compressed_level_size(format, width, height) : static_cast<size_t>(width) * height * format.bytes_per_texel;
+        std::vector<unsigned char> zeros(size, 0);
+
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, request.slot.texture);
+        if (format.compressed())
+        {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, page_level, 0, 0, request.slot.layer, width, height, 1,
+                                      static_cast<GLenum>(format.internal_format), static_cast<GLsizei>(size), zeros.data());
+        }
+        else
+        {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, page_level, request.x >> level, request.y >> level, request.slot.layer, width, height, 1, format.format, format.type, zeros.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, static_cast<GLuint>(previous_texture));
+    }
+
+    TextureSlot load_slot(const Key &key, const std::string &path, const TextureOptions &options)
+    {
+        Request request;
+        request.path = path;
+        request.options = options;
+        request.cancelled = std::make_shared<std::atomic<bool>>(false);
+        if (load_cooked(request))
+        {
+            request.slot = reserve_layer(request.width, request.height, request.format, options);
+            Image &image = add_image(key, request, false);
+            image.cooked = true;
+            image.loading_level = 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(request);
+            in_flight++;
+            return request.slot;
+        }
+
+        int image_width, image_height, channels;
+        if (!stbi_info(path.c_str(), &image_width, &image_height, &channels))
+        {
+            std::cout << "Failed to load texture " << path << "\n";
+            return TextureSlot();
+        }
+
+        request.width = image_width;
+        request.height = image_height;
+        request.format = choose_texture_format(channels, options.srgb, format_policy);
+        bool atlas = image_width <= ATLAS_MAX_IMAGE_SIZE && image_height <= ATLAS_MAX_IMAGE_SIZE;
+        request.slot = atlas ? reserve_atlas(request) : reserve_layer(image_width, image_height, request.format, options);
+        Image &image = add_image(key, request, atlas);
+        if (!atlas && progressive)
+        {
+            image.streamed = true;
+            int tail_level = 0;
+            while (tail_level + 1 < image.levels && std::max(image_width >> tail_level, image_height >> tail_level) > TEXTURE_STREAM_TAIL_SIZE)
+                tail_level++;
+            image.loading_level = tail_level;
+            stream_jobs++;
+            queue_level(request, tail_level);
+            return request.slot;
+        }
+
+        image.loading_level = 0;
+        queue_decode(request, atlas, false);
+        return request.slot;
+    }
+
+    // Decodes the full chain of an image that is not streamed on the worker, or maps its cooked .ktx again.
+    void queue_decode(const Request &request, bool atlas, bool cooked)
+    {
+        jobs.push_back(pool.submit([this, request, atlas, cooked]() {
+            Request decoded_request = request;
+            if (!*decoded_request.cancelled)
+            {
+                if (cooked)
+                    load_cooked(decoded_request);
+                else
+                    decode_request(decoded_request, atlas);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(decoded_request));
+        }));
+        in_flight++;
+    }
+
+    // Maps a cooked .ktx holding the full chain of a full layer image, see tools/texture_cook.cpp. Atlas entries
+    // need their padding, so small images are always decoded.
+    bool load_cooked(Request &request)
+    {
+        std::shared_ptr<KtxFile> file = std::make_shared<KtxFile>();
+        if (!load_cooked_ktx(*file, request.path, request.options) || file->header.faces != 1 || !file->texture_format(request.format))
+            return false;
+        request.width = static_cast<int>(file->header.pixel_width);
+        request.height = static_cast<int>(file->header.pixel_height);
+        if ((request.width <= ATLAS_MAX_IMAGE_SIZE && request.height <= ATLAS_MAX_IMAGE_SIZE) ||
+            static_cast<int>(file->level_count()) != mip_level_count(request.width, request.height))
+            return false;
+        request.cooked = file;
+        for (size_t i = 0; i < request.level_count(); i++)
+        {
+            if (file->level_size(static_cast<uint32_t>(i)) < request.level(i).size)
+            {
+                request.cooked.reset();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Queues decodes for the slots whose needed level is not resident, by priority, and resets the requests.
+    void schedule_streaming()
+    {
+        std::vector<Image*> wanted;
+        for (auto &item : images)
+        {
+            Image &image = item.second;
+            // Levels a demoted page dropped cannot be uploaded until the residency budget gives them back.
+            image.needed_level = std::max(image.needed_level, top_level(image.request.slot.texture));
+            if (image.streamed && image.loading_level < 0 && !image.failed && image.needed_level < image.resident_level)
+                wanted.push_back(&image);
+        }
+        std::sort(wanted.begin(), wanted.end(), [](const Image *a, const Image *b) { return a->priority > b->priority; });
+        for (Image *image : wanted)
+        {
+            if (stream_jobs >= max_stream_jobs)
+                break;
+            image->loading_level = image->needed_level;
+            stream_jobs++;
+            queue_level(image->request, image->needed_level);
+        }
+        for (auto &item : images)
+        {
+            item.second.needed_level = INT_MAX;
+            item.second.priority = 0.0f;
+        }
+    }
+
+    // Decodes a streamed image from one of its levels down, on the worker.
+    void queue_level(const Request &request, int level)
+    {
+        jobs.push_back(pool.submit([this, request, level]() {
+            Request decoded_request = request;
+            decoded_request.streamed = true;
+            decoded_request.first_level = level;
+            if (!*decoded_request.cancelled)
+                decode_request(decoded_request, false);
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(decoded_request));
+        }));
+        in_flight++;
+    }
+
+    // What the decode of a request stores, the key of its chain in the disk cache besides the source bytes.
+    // Streamed levels come from the full chain, so every level of an image shares one entry.
+    static DecodedCacheLayout cache_layout(const Request &request, bool atlas)
+    {
+        DecodedCacheLayout layout;
+        layout.width = static_cast<uint32_t>(request.width);
+        layout.height = static_cast<uint32_t>(request.height);
+        layout.channels = static_cast<uint32_t>(request.format.channels);
+        layout.internal_format = static_cast<uint32_t>(request.format.internal_format);
+        layout.type = static_cast<uint32_t>(request.format.type);
+        layout.srgb = request.options.srgb ? 1 : 0;
+        layout.flip_vertically = request.options.flip_vertically ? 1 : 0;
+        layout.bytes_per_texel = static_cast<uint32_t>(request.format.bytes_per_texel);
+        if (atlas)
+        {
+            layout.padding = ATLAS_PADDING;
+            layout.padded_width = static_cast<uint32_t>(request.padded_width);
+            layout.padded_height = static_cast<uint32_t>(request.padded_height);
+            layout.level_count = static_cast<uint32_t>(std::min(mip_level_count(request.padded_width, request.padded_height), ATLAS_MIP_LEVELS));
+        }
+        else
+        {
+            layout.level_count = static_cast<uint32_t>(mip_level_count(request.width, request.height));
+        }
+        return layout;
+    }
+
+    // Runs on the worker. Fills the levels of a request from its first_level down, mapped from the disk cache
+    // when it holds the image. Otherwise full chains are decoded straight into level 0, atlas entries inside
+    // their padding, and stored in the cache. Finer levels of streamed images start from a decode at the
+    // level's size through max_dimension, which JPEG serves with a reduced-scale decode; those are not stored.
+    void decode_request(Request &request, bool atlas)
+    {
+        MappedFile source;
+        if (!source.open(request.path) || source.size() > static_cast<size_t>(INT_MAX))
+            return;
+        const DecodedCacheLayout layout = cache_layout(request, atlas);
+        uint64_t key = 0;
+        if (disk_cache.enabled())
+        {
+            key = DecodedTextureCache::make_key(source.data(), source.size(), layout);
+            std::shared_ptr<DecodedCacheEntry> entry = disk_cache.load(key, layout);
+            if (entry && static_cast<size_t>(request.first_level) < entry->levels.size())
+            {
+                entry->prefetch(static_cast<size_t>(request.first_level));
+                request.cached = std::move(entry);
+                return;
+            }
+        }
+        source.advise(ACCESS_SEQUENTIAL);
+
+        const int channels = request.format.channels;
+        const int level = request.first_level;
+        int decoded_width, decoded_height, decoded_channels;
+        std::vector<MipLevel> levels(1);
+        if (level == 0)
+        {
+            MipLevel &base = levels[0];
+            base.width = atlas ? request.padded_width : request.width;
+            base.height = atlas ? request.padded_height : request.height;
+            base.pitch = mip_pitch(base.width, channels);
+            base.data.resize(base.pitch * base.height);
+            int offset = atlas ? ATLAS_PADDING : 0;
+            size_t start = base.pitch * offset + static_cast<size_t>(offset) * channels;
+            if (!decode_image_into(source.data(), source.size(), base.data.data() + start, base.data.size() - start, base.pitch, channels, request.options.flip_vertically, &decoded_width, &decoded_height, &decoded_channels) ||
+                decoded_width != request.width || decoded_height != request.height)
+                return;
+            if (atlas)
+                extrude(base, request.width, request.height, channels);
+        }
+        else
+        {
+            const int width = std::max(1, request.width >> level);
+            const int height = std::max(1, request.height >> level);
+            FlipOnLoadScope flip(request.options.flip_vertically);
+            unsigned char *pixels = decode_image_in_arena(source.data(), source.size(), &decoded_width, &decoded_height, &decoded_channels, channels, std::max(width, height));
+            if (!pixels)
+                return;
+            levels[0] = resample_level(pixels, decoded_width, decoded_height, channels, width, height);
+            stbi_image_free(pixels);
+        }
+        generate_mip_levels(levels, channels, request.options.srgb);
+        if (atlas)
+            levels.resize(std::min<size_t>(levels.size(), ATLAS_MIP_LEVELS));
+        for (MipLevel &mip : levels)
+            pack_level(mip, request.format);
+        if (level == 0)
+            disk_cache.store(key, levels);
+        request.levels = std::move(levels);
+    }
+
+    void upload_streamed(const Request &request)
+    {
+        stream_jobs--;
+        auto found = images.find(slot_key(request.slot));
+        if (found == images.end())
+            return;
+        Image &image = found->second;
+        image.loading_level = -1;
+        if (request.first_level >= image.resident_level && request.level_count() > 0)
+            return;
+        if (!upload(request))
+        {
+            image.failed = true;
+            return;
+        }
+        image.resident_level = std::max(request.first_level, top_level(request.slot.texture));
+    }
+
+    Page &create_page(int page_width, int page_height, bool atlas, const TextureFormat &format, const TextureOptions &options)
+    {
+        Page page;
+        page.width = page_width;
+        page.height = page_height;
+        page.atlas = atlas;
+        page.format = format;
+        int levels = atlas ? ATLAS_MIP_LEVELS : mip_level_count(page_width, page_height);
+        page.levels = levels;
+        page.capacity = 1;
+
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous_texture);
+        glGenTextures(1, &page.texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, page.texture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, atlas ? GL_CLAMP_TO_EDGE : options.wrap_s);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, atlas ? GL_CLAMP_TO_EDGE : options.wrap_t);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        apply_texture_swizzle(GL_TEXTURE_2D_ARRAY, format);
+        allocate_levels(page, page.capacity, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, static_cast<GLuint>(previous_texture));
+
+        pages.push_back(std::move(page));
+        track_page(pages.back());
+        return pages.back();
+    }
+
+    // Specifies the levels of the bound page from image level top_level down with room for capacity layers,
+    // their contents undefined.
+    static void allocate_levels(const Page &page, int capacity, int top_level)
+    {
+        const TextureFormat &format = page.format;
+        for (int level = top_level; level < page.levels; level++)
+        {
+            int level_width = std::max(1, page.width >> level);
+            int level_height = std::max(1, page.height >> level);
+            if (format.compressed())
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level - top_level, static_cast<GLenum>(format.internal_format), level_width, level_height, capacity, 0,
+                                       static_cast<GLsizei>(compressed_level_size(format, level_width, level_height) * capacity), nullptr);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level - top_level, format.internal_format, level_width, level_height, capacity, 0, format.format, format.type, nullptr);
+        }
+    }
+
+    // Bytes of one layer of an image level, rows tightly packed.
+    static size_t layer_level_size(const Page &page, int level)
+    {
+        int level_width = std::max(1, page.width >> level);
+        int level_height = std::max(1, page.height >> level);
+        if (page.format.compressed())
+            return compressed_level_size(page.format, level_width, level_height);
+        return static_cast<size_t>(level_width) * level_height * page.format.bytes_per_texel;
+    }
+
+    // What the page takes with its chain starting at image level top_level.
+    static size_t page_bytes(const Page &page, int top_level)
+    {
+        return texture_vram_bytes(page.format, std::max(1, page.width >> top_level), std::max(1, page.height >> top_level), page.levels - top_level, page.capacity);
+    }
+
+    Page *find_page(unsigned int texture)
+    {
+        for (Page &page : pages)
+        {
+            if (page.texture == texture)
+                return &page;
+        }
+        return nullptr;
+    }
+
+    int top_level(unsigned int texture) const
+    {
+        for (const Page &page : pages)
+        {
+            if (page.texture == texture)
+                return page.top_level;
+        }
+        return 0;
+    }
+
+    // Reallocates the page for capacity layers with its chain starting at image level top_level, under the same
+    // texture name so its slots stay valid. The levels and layers both chains have are read back into a buffer
+    // and uploaded again from there, the copy never leaves the GPU. Levels the old chain did not have are undefined.
+    void rebuild_page(Page &page, int capacity, int top_level)
+    {
+        const int first_kept = std::max(page.top_level, top_level);
+        const int kept_layers = std::min(page.capacity, capacity);
+        std::vector<size_t> offsets(static_cast<size_t>(page.levels), 0);
+        size_t total = 0;
+        for (int level = first_kept; level < page.levels; level++)
+        {
+            offsets[level] = total;
+            total += layer_level_size(page, level) * page.capacity;
+        }
+
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, page.texture);
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(total), nullptr, GL_STREAM_COPY);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int level = first_kept; level < page.levels; level++)
+        {
+            if (page.format.compressed())
+                glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, level - page.top_level, (void*)(offsets[level]));
+            else
+                glGetTexImage(GL_TEXTURE_2D_ARRAY, level - page.top_level, page.format.format, page.format.type, (void*)(offsets[level]));
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // A shorter chain leaves the old last levels behind, they are freed by respecifying them empty.
+        allocate_levels(page, capacity, top_level);
+        for (int level = page.levels - top_level; level < page.levels - page.top_level; level++)
+        {
+            if (page.format.compressed())
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, static_cast<GLenum>(page.format.internal_format), 0, 0, 0, 0, 0, nullptr);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, page.format.internal_format, 0, 0, 0, 0, page.format.format, page.format.type, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, page.levels - top_level - 1);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = first_kept; level < page.levels; level++)
+        {
+            int level_width = std::max(1, page.width >> level);
+            int level_height = std::max(1, page.height >> level);
+            if (page.format.compressed())
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - top_level, 0, 0, 0, level_width, level_height, kept_layers, static_cast<GLenum>(page.format.internal_format),
+                                          static_cast<GLsizei>(layer_level_size(page, level) * kept_layers), (void*)(offsets[level]));
+            else
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - top_level, 0, 0, 0, level_width, level_height, kept_layers, page.format.format, page.format.type, (void*)(offsets[level]));
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, static_cast<GLuint>(previous_texture));
+
+        page.capacity = capacity;
+        page.top_level = top_level;
+    }
+
+    // Hands out the next unused layer of a page that is not full, growing the page when it has no room left.
+    int next_layer(Page &page)
+    {
+        if (page.used_layers == page.capacity)
+        {
+            rebuild_page(page, std::min(page.capacity * 2, TEXTURE_ARRAY_LAYERS), page.top_level);
+            if (residency)
+                residency->resize(this, page.texture, page_bytes(page, page.top_level), page_bytes(page, 0));
+        }
+        return page.used_layers++;
+    }
+
+    void track_page(const Page &page)
+    {
+        if (!residency)
+            return;
+        const unsigned int texture = page.texture;
+        residency->track(this, texture, page_bytes(page, page.top_level), page_bytes(page, 0),
+                         [this, texture]() { return demote_page(texture); }, [this, texture]() { return restore_page(texture); });
+    }
+
+    // Drops the top level of an idle page, as long as two levels and a side of TEXTURE_STREAM_TAIL_SIZE are left.
+    // Its images keep what is left of their chains.
+    size_t demote_page(unsigned int texture)
+    {
+        Page &page = *find_page(texture);
+        const int top = page.top_level + 1;
+        if (page.levels - top < 2 || (std::max(page.width, page.height) >> top) < TEXTURE_STREAM_TAIL_SIZE)
+            return page_bytes(page, page.top_level);
+        rebuild_page(page, page.capacity, top);
+        for (auto &item : images)
+        {
+            if (item.second.request.slot.texture == texture)
+                item.second.resident_level = std::max(item.second.resident_level, top);
+        }
+        return page_bytes(page, top);
+    }
+
+    // Gives a page its full chain back. Streamed images stream the dropped levels in again once request_detail
+    // asks for them, the others are decoded again right away. min_lod() keeps sampling off them until then.
+    size_t restore_page(unsigned int texture)
+    {
+        Page &page = *find_page(texture);
+        if (page.top_level > 0)
+            rebuild_page(page, page.capacity, 0);
+        for (auto &item : images)
+        {
+            Image &image = item.second;
+            if (image.request.slot.texture != texture || image.streamed || image.loading_level >= 0 || image.resident_level == 0 || image.resident_level >= image.levels)
+                continue;
+            image.loading_level = 0;
+            queue_decode(image.request, image.atlas, image.cooked);
+        }
+        return page_bytes(page, 0);
+    }
+
+    TextureSlot reserve_layer(int image_width, int image_height, const TextureFormat &format, const TextureOptions &options)
+    {
+        Page *found = nullptr;
+        for (Page &page : pages)
+        {
+            if (!page.atlas && page.format.internal_format == format.internal_format && page.width == image_width && page.height == image_height && (!page.free_layers.empty() || page.used_layers < TEXTURE_ARRAY_LAYERS))
+            {
+                found = &page;
+                break;
+            }
+        }
+        if (!found)
+            found = &create_page(image_width, image_height, false, format, options);
+
+        TextureSlot slot;
+        slot.texture = found->texture;
+        if (!found->free_layers.empty())
+        {
+            slot.layer = found->free_layers.back();
+            found->free_layers.pop_back();
+        }
+        else
+        {
+            slot.layer = next_layer(*found);
+        }
+        return slot;
+    }
+
+    TextureSlot reserve_atlas(Request &request)
+    {
+        request.padded_width = (request.width + 2 * ATLAS_PADDING + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT * ATLAS_ALIGNMENT;
+        request.padded_height = (request.height + 2 * ATLAS_PADDING + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT * ATLAS_ALIGNMENT;
+
+        TextureSlot slot;
+        for (Page &page : pages)
+        {
+            if (!page.atlas || page.format.internal_format != request.format.internal_format)
+                continue;
+            for (size_t layer = 0; layer < page.packers.size() && !slot.valid(); layer++)
+            {
+                if (page.packers[layer].pack(request.padded_width, request.padded_height, request.x, request.y))
+                {
+                    slot.texture = page.texture;
+                    slot.layer = static_cast<int>(layer);
+                }
+            }
+            if (!slot.valid() && page.used_layers < TEXTURE_ARRAY_LAYERS)
+            {
+                page.packers.emplace_back(ATLAS_SIZE, ATLAS_SIZE);
+                page.packers.back().pack(request.padded_width, request.padded_height, request.x, request.y);
+                slot.texture = page.texture;
+                slot.layer = next_layer(page);
+            }
+            if (slot.valid())
+                break;
+        }
+        if (!slot.valid())
+        {
+            Page &page = create_page(ATLAS_SIZE, ATLAS_SIZE, true, request.format, request.options);
+            page.packers.emplace_back(ATLAS_SIZE, ATLAS_SIZE);
+            page.packers.back().pack(request.padded_width, request.padded_height, request.x, request.y);
+            slot.texture = page.texture;
+            slot.layer = next_layer(page);
+        }
+
+        slot.uv_rect = glm::vec4(static_cast<float>(request.x + ATLAS_PADDING) / ATLAS_SIZE, static_cast<float>(request.y + ATLAS_PADDING) / ATLAS_SIZE,
+                                 static_cast<float>(request.width) / ATLAS_SIZE, static_cast<float>(request.height) / ATLAS_SIZE);
+        return slot;
+    }
+
+    // Repeats the border texels of an image decoded at (ATLAS_PADDING, ATLAS_PADDING) into the padding
+    // around it, so filtering and mips never reach a neighbour.
+    static void extrude(MipLevel &padded, int image_width, int image_height, int channels)
+    {
+        for (int y = ATLAS_PADDING; y < ATLAS_PADDING + image_height; y++)
+        {
+            unsigned char *row = padded.data.data() + padded.pitch * y;
+            for (int x = 0; x < padded.width; x++)
+            {
+                int source_x = std::min(std::max(x, ATLAS_PADDING), ATLAS_PADDING + image_width - 1);
+                if (source_x != x)
+                    std::memcpy(row + x * channels, row + source_x * channels, static_cast<size_t>(channels));
+            }
+        }
+        for (int y = 0; y < padded.height; y++)
+        {
+            int source_y = std::min(std::max(y, ATLAS_PADDING), ATLAS_PADDING + image_height - 1);
+            if (source_y != y)
+                std::memcpy(padded.data.data() + padded.pitch * y, padded.data.data() + padded.pitch * source_y, padded.pitch);
+        }
+    }
+
+    // Copies the levels into the unpack buffer and uploads them from there, false when it cannot be mapped.
+    // Levels a demoted page dropped are skipped.
+    bool upload(const Request &request)
+    {
+        if (request.level_count() == 0)
+        {
+            std::cout << "Failed to load texture " << request.path << "\n";
+            return false;
+        }
+
+        const int top = top_level(request.slot.texture);
+        const size_t first = static_cast<size_t>(std::max(top - request.first_level, 0));
+        size_t size = 0;
+        for (size_t i = first; i < request.level_count(); i++)
+            size += request.level(i).size;
+
+        // Orphan the buffer so the driver never waits for the previous upload to finish reading it.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_DRAW);
+        unsigned char *mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            std::cout << "Failed to map pixel unpack buffer for " << request.path << "\n";
+            return false;
+        }
+        size_t offset = 0;
+        for (size_t i = first; i < request.level_count(); i++)
+        {
+            const LevelData mip = request.level(i);
+            std::memcpy(mapped + offset, mip.data, mip.size);
+            offset += mip.size;
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, request.slot.texture);
+        const TextureFormat &format = request.format;
+        offset = 0;
+        for (size_t i = first; i < request.level_count(); i++)
+        {
+            const LevelData mip = request.level(i);
+            const int level = request.first_level + static_cast<int>(i);
+            if (format.compressed())
+            {
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - top, 0, 0, request.slot.layer, mip.width, mip.height, 1,
+                                          static_cast<GLenum>(format.internal_format), static_cast<GLsizei>(mip.size), (void*)(offset));
+            }
+            else
+            {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(static_cast<size_t>(mip.width) * format.bytes_per_texel, mip.pitch));
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - top, request.x >> level, request.y >> level, request.slot.layer,
+                                mip.width, mip.height, 1, format.format, format.type, (void*)(offset));
+            }
+            offset += mip.size;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, static_cast<GLuint>(previous_texture));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef TEXTURE_FORMAT_HPP
+#define TEXTURE_FORMAT_HPP
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include "gl_extensions.hpp"
+#include "mip_generator.hpp"
+
+// How a texture is stored on the GPU and uploaded from an 8-bit image with `channels` channels
+// (1 grey, 2 grey and alpha, 3 RGB, 4 RGBA). Sub-byte formats are packed on the CPU before the upload.
+struct TextureFormat
+{
+    GLint internal_format = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    int channels = 4;
+    // Bytes per texel of the upload data.
+    int bytes_per_texel = 4;
+    // Bytes per texel in VRAM, drivers pad three byte formats to four.
+    int vram_bytes_per_texel = 4;
+    // Grey formats read back as grey RGB, so shaders sampling .rgb and .a need no changes.
+    GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    // Bytes per 4x4 block of a compressed format, 0 for formats stored by texel.
+    int block_bytes = 0;
+
+    bool packed() const
+    {
+        return type != GL_UNSIGNED_BYTE;
+    }
+
+    bool compressed() const
+    {
+        return block_bytes != 0;
+    }
+};
+
+// Block size of the compressed formats the texture cooker writes, 0 for any other format.
+inline int compressed_block_bytes(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+// Bytes of one level of a compressed format, blocks at the edges are stored whole.
+inline size_t compressed_level_size(const TextureFormat &format, int width, int height)
+{
+    return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * format.block_bytes;
+}
+
+// Which formats load() may pick. The support flags need a current context, see detect_support().
+struct TextureFormatPolicy
+{
+    // Store sRGB color data in sRGB formats, so sampling returns linear values. Only enable this together
+    // with GL_FRAMEBUFFER_SRGB or shaders that encode their output.
+    bool srgb_formats = false;
+    // 16-bit RGB565 and RGBA4 for color images, for low quality presets. Grey images already are smaller.
+    bool low_precision = false;
+    // Images whose pixels are all grey or all opaque drop those channels, checked on the decode thread.
+    bool reduce_channels = true;
+
+    bool rgb565_supported = false;
+    bool srgb_r8_supported = false;
+    bool srgb_rg8_supported = false;
+
+    void detect_support()
+    {
+        rgb565_supported = has_gl_version(4, 1) || has_gl_extension("GL_ARB_ES2_compatibility");
+        srgb_r8_supported = has_gl_extension("GL_EXT_texture_sRGB_R8");
+        srgb_rg8_supported = has_gl_extension("GL_EXT_texture_sRGB_RG8");
+    }
+};
+
+// The tightest format for an image with the given channels. Its channels can be more than asked for,
+// when sRGB grey needs an extension the context lacks and the image is stored as sRGB color instead.
+inline TextureFormat choose_texture_format(int channels, bool srgb, const TextureFormatPolicy &policy)
+{
+    TextureFormat result;
+    srgb = srgb && policy.srgb_formats;
+    if (srgb && ((channels == 1 && !policy.srgb_r8_supported) || (channels == 2 && !policy.srgb_rg8_supported)))
+        channels += 2;
+
+    result.channels = channels;
+    if (channels == 1)
+    {
+        result.internal_format = srgb ? GL_SR8_EXT : GL_R8;
+        result.format = GL_RED;
+        result.bytes_per_texel = result.vram_bytes_per_texel = 1;
+        const GLint grey[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        std::copy(grey, grey + 4, result.swizzle);
+    }
+    else if (channels == 2)
+    {
+        result.internal_format = srgb ? GL_SRG8_EXT : GL_RG8;
+        result.format = GL_RG;
+        result.bytes_per_texel = result.vram_bytes_per_texel = 2;
+        const GLint grey_alpha[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+        std::copy(grey_alpha, grey_alpha + 4, result.swizzle);
+    }
+    else if (channels == 3)
+    {
+        result.format = GL_RGB;
+        if (policy.low_precision)
+        {
+            result.internal_format = policy.rgb565_supported ? GL_RGB565 : GL_RGB5;
+            result.type = GL_UNSIGNED_SHORT_5_6_5;
+            result.bytes_per_texel = result.vram_bytes_per_texel = 2;
+        }
+        else
+        {
+            result.internal_format = srgb ? GL_SRGB8 : GL_RGB8;
+            result.bytes_per_texel = 3;
+        }
+    }
+    else
+    {
+        if (policy.low_precision)
+        {
+            result.internal_format = GL_RGBA4;
+            result.type = GL_UNSIGNED_SHORT_4_4_4_4;
+            result.bytes_per_texel = result.vram_bytes_per_texel = 2;
+        }
+        else
+        {
+            result.internal_format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        }
+    }
+    return result;
+}
+
+// GL_UNPACK_ALIGNMENT under which rows of row_bytes are pitch bytes apart, 0 if none is.
+inline GLint unpack_alignment(size_t row_bytes, size_t pitch)
+{
+    for (GLint alignment = 8; alignment >= 1; alignment /= 2)
+    {
+        if ((row_bytes + alignment - 1) / alignment * alignment == pitch)
+            return alignment;
+    }
+    return 0;
+}
+
+// Channels the image actually needs: alpha that is opaque everywhere and color that is grey everywhere are dropped.
+inline int content_channels(const MipLevel &level, int channels)
+{
+    const bool has_alpha = channels == 2 || channels == 4;
+    bool grey = channels >= 3;
+    bool opaque = has_alpha;
+    for (int y = 0; y < level.height && (grey || opaque); y++)
+    {
+        const unsigned char *row = level.data.data() + level.pitch * y;
+        for (int x = 0; x < level.width; x++)
+        {
+            const unsigned char *texel = row + x * channels;
+            grey = grey && texel[0] == texel[1] && texel[0] == texel[2];
+            opaque = opaque && texel[channels - 1] == 255;
+        }
+    }
+    int color = channels >= 3 && !grey ? 3 : 1;
+    return color + (has_alpha && !opaque ? 1 : 0);
+}
+
+// Repacks a level to fewer channels in place, keeping the first color channel for grey and the alpha.
+inline void reduce_level_channels(MipLevel &level, int channels, int target_channels)
+{
+    if (target_channels == channels)
+        return;
+    const int alpha = channels == 2 || channels == 4 ? channels - 1 : -1;
+    const size_t pitch = mip_pitch(level.width, target_channels);
+    // Every target texel starts at or before its source, so the forward copy never overwrites unread data.
+    for (int y = 0; y < level.height; y++)
+    {
+        const unsigned char *source = level.data.data() + level.pitch * y;
+        unsigned char *target = level.data.data() + pitch * y;
+        for (int x = 0; x < level.width; x++)
+        {
+            const unsigned char *texel = source + x * channels;
+            unsigned char *out = target + x * target_channels;
+            if (target_channels <= 2)
+            {
+                out[0] = texel[0];
+                if (target_channels == 2)
+                    out[1] = texel[alpha];
+            }
+            else
+            {
+                out[0] = texel[0];
+                out[1] = texel[1];
+                out[2] = texel[2];
+            }
+        }
+    }
+    level.pitch = pitch;
+    level.data.resize(pitch * level.height);
+}
+
+// Packs an 8-bit RGB or RGBA level into the 16-bit texels of format, rounding each channel.
+inline void pack_level(MipLevel &level, const TextureFormat &format)
+{
+    if (!format.packed())
+        return;
+    const size_t pitch = (static_cast<size_t>(level.width) * 2 + 3) & ~static_cast<size_t>(3);
+    std::vector<unsigned char> packed(pitch * level.height);
+    for (int y = 0; y < level.height; y++)
+    {
+        const unsigned char *source = level.data.data() + level.pitch * y;
+        uint16_t *target = reinterpret_cast<uint16_t*>(packed.data() + pitch * y);
+        for (int x = 0; x < level.width; x++)
+        {
+            const unsigned char *texel = source + x * format.channels;
+            if (format.type == GL_UNSIGNED_SHORT_5_6_5)
+                target[x] = static_cast<uint16_t>(((texel[0] * 31 + 127) / 255) << 11 | ((texel[1] * 63 + 127) / 255) << 5 | ((texel[2] * 31 + 127) / 255));
+            else
+                target[x] = static_cast<uint16_t>(((texel[0] * 15 + 127) / 255) << 12 | ((texel[1] * 15 + 127) / 255) << 8 |
+                                                  ((texel[2] * 15 + 127) / 255) << 4 | ((texel[3] * 15 + 127) / 255));
+        }
+    }
+    level.pitch = pitch;
+    level.data.swap(packed);
+}
+
+// Texels of a texture and the first levels of its mip chain.
+inline size_t texture_texels(int width, int height, int levels, int layers = 1)
+{
+    size_t texels = 0;
+    for (int level = 0; level < levels; level++)
+        texels += static_cast<size_t>(std::max(1, width >> level)) * std::max(1, height >> level) * layers;
+    return texels;
+}
+
+// Texture memory by format, against what the same textures would take as RGBA8.
+// VRAM a texture of the format takes with its mip chain, per block for compressed formats.
+inline size_t texture_vram_bytes(const TextureFormat &format, int width, int height, int levels, int layers = 1)
+{
+    if (!format.compressed())
+        return texture_texels(width, height, levels, layers) * format.vram_bytes_per_texel;
+    size_t bytes = 0;
+    for (int level = 0; level < levels; level++)
+        bytes += compressed_level_size(format, std::max(1, width >> level), std::max(1, height >> level)) * layers;
+    return bytes;
+}
+
+struct TextureMemoryStats
+{
+    size_t textures = 0;
+    size_t bytes = 0;
+    size_t rgba8_bytes = 0;
+
+    void add(const TextureFormat &format, int width, int height, int levels, int layers = 1)
+    {
+        textures++;
+        bytes += texture_vram_bytes(format, width, height, levels, layers);
+        rgba8_bytes += texture_texels(width, height, levels, layers) * 4;
+    }
+
+    void report(const std::string &name) const
+    {
+        if (textures == 0)
+            return;
+        std::cout << name << ": " << textures << " textures, " << bytes / (1024 * 1024.0) << " MB, "
+                  << (rgba8_bytes - bytes) / (1024 * 1024.0) << " MB saved against RGBA8 ("
+                  << static_cast<int>(100.0 * (rgba8_bytes - bytes) / rgba8_bytes) << "%)\n";
+    }
+};
+
+// Sets the swizzle of the texture bound to target, grey formats read back as grey RGB.
+inline void apply_texture_swizzle(GLenum target, const TextureFormat &format)
+{
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+}
+
+#endif
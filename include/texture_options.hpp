@@ -0,0 +1,40 @@
+#ifndef TEXTURE_OPTIONS_HPP
+#define TEXTURE_OPTIONS_HPP
+
+#include <glad/glad.h>
+
+#include <tuple>
+#include <string>
+#include <filesystem>
+
+struct TextureOptions
+{
+    GLint wrap_s = GL_REPEAT;
+    GLint wrap_t = GL_REPEAT;
+    GLint min_filter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint mag_filter = GL_LINEAR;
+    bool flip_vertically = true;
+    bool generate_mipmaps = true;
+    // Color data is sRGB encoded, its mips are filtered in linear light. Clear for normal maps and masks.
+    bool srgb = true;
+    // Larger images are scaled down to fit at decode time, 0 keeps them as they are. For low quality presets.
+    int max_dimension = 0;
+
+    bool operator<(const TextureOptions &other) const
+    {
+        return std::tie(wrap_s, wrap_t, min_filter, mag_filter, flip_vertically, generate_mipmaps, srgb, max_dimension) <
+               std::tie(other.wrap_s, other.wrap_t, other.min_filter, other.mag_filter, other.flip_vertically, other.generate_mipmaps, other.srgb, other.max_dimension);
+    }
+};
+
+// Paths naming the same file compare equal, for keying loaded textures.
+inline std::string canonical_texture_path(const std::string &path)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::path(path), error);
+    if (error)
+        return std::filesystem::path(path).lexically_normal().generic_string();
+    return canonical.generic_string();
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef TEXTURE_RESIDENCY_HPP
+#define TEXTURE_RESIDENCY_HPP
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+
+const size_t TEXTURE_RESIDENCY_BUDGET = 512 * 1024 * 1024;
+
+// Keeps the textures of a scene within a VRAM budget. Owners track what they can shrink, e.g. a texture array
+// page or a tile cache, with its size now and at full detail and two callbacks: demote frees part of it, e.g.
+// its top mips, and restore reallocates it at full size. Both return the bytes it holds afterwards. The owner
+// streams restored detail back in on its usual path, restore only makes room for it.
+// update() demotes the least recently used resources until the total fits and restores demoted ones that are
+// in use again once their full size fits. Resources count as used when use() is called for them, call it for
+// everything drawn in a frame. Memory that cannot be given back, e.g. render targets, is counted with reserve().
+class TextureResidency
+{
+public:
+    // Returns the bytes the resource holds after demoting or restoring it.
+    using Resize = std::function<size_t()>;
+
+    size_t budget;
+    // The sum of what reserve() was given, set it through there.
+    size_t reserved = 0;
+    // Frames a resource has to go unused before it is demoted, so what is on screen stays sharp.
+    uint64_t idle_frames = 30;
+
+    explicit TextureResidency(size_t budget_value = TEXTURE_RESIDENCY_BUDGET) : budget(budget_value)
+    {
+    }
+
+    TextureResidency(const TextureResidency &) = delete;
+    TextureResidency &operator=(const TextureResidency &) = delete;
+
+    // Starts tracking resource id of owner, counted as used this frame. Tracking it again replaces it.
+    void track(const void *owner, uint64_t id, size_t bytes, size_t full_bytes, Resize demote, Resize restore)
+    {
+        forget(owner, id);
+        Entry entry;
+        entry.bytes = bytes;
+        entry.full_bytes = full_bytes;
+        entry.last_used = frame;
+        entry.demote = std::move(demote);
+        entry.restore = std::move(restore);
+        entries[{ owner, id }] = std::move(entry);
+        resident += bytes;
+    }
+
+    // The resource changed size outside of its callbacks, e.g. a page that got more layers.
+    void resize(const void *owner, uint64_t id, size_t bytes, size_t full_bytes)
+    {
+        auto found = entries.find({ owner, id });
+        if (found == entries.end())
+            return;
+        resident += bytes - found->second.bytes;
+        found->second.bytes = bytes;
+        found->second.full_bytes = full_bytes;
+    }
+
+    void forget(const void *owner, uint64_t id)
+    {
+        auto found = entries.find({ owner, id });
+        if (found == entries.end())
+            return;
+        resident -= found->second.bytes;
+        entries.erase(found);
+    }
+
+    // Drops every resource and the reservation of owner, for its destructor.
+    void forget(const void *owner)
+    {
+        for (auto it = entries.lower_bound({ owner, 0 }); it != entries.end() && it->first.first == owner;)
+        {
+            resident -= it->second.bytes;
+            it = entries.erase(it);
+        }
+        reserve(owner, 0);
+    }
+
+    void use(const void *owner, uint64_t id)
+    {
+        auto found = entries.find({ owner, id });
+        if (found != entries.end())
+            found->second.last_used = frame;
+    }
+
+    // Sets what owner holds of the reserved memory, replacing what it held before. 0 drops the owner.
+    void reserve(const void *owner, size_t bytes)
+    {
+        auto found = reservations.find(owner);
+        if (found != reservations.end())
+        {
+            reserved -= found->second;
+            reservations.erase(found);
+        }
+        if (bytes == 0)
+            return;
+        reservations[owner] = bytes;
+        reserved += bytes;
+    }
+
+    // Call once per frame on the GL thread, after this frame's use() calls. The callbacks run from here.
+    void update()
+    {
+        frame++;
+        if (resident + reserved > budget)
+        {
+            std::vector<std::pair<uint64_t, Key>> idle;
+            for (const auto &item : entries)
+            {
+                if (item.second.last_used + idle_frames <= frame)
+                    idle.push_back({ item.second.last_used, item.first });
+            }
+            std::sort(idle.begin(), idle.end());
+            for (const auto &candidate : idle)
+            {
+                Entry &entry = entries[candidate.second];
+                // Demoted one step at a time until it fits or cannot shrink any further.
+                while (resident + reserved > budget)
+                {
+                    size_t bytes = entry.demote();
+                    if (bytes >= entry.bytes)
+                        break;
+                    resident -= entry.bytes - bytes;
+                    entry.bytes = bytes;
+                    demotions++;
+                }
+                if (resident + reserved <= budget)
+                    break;
+            }
+            return;
+        }
+
+        // The most recently used come back first, idle ones wait until they are drawn again.
+        std::vector<std::pair<uint64_t, Key>> wanted;
+        for (const auto &item : entries)
+        {
+            if (item.second.bytes < item.second.full_bytes && item.second.last_used + idle_frames > frame)
+                wanted.push_back({ item.second.last_used, item.first });
+        }
+        std::sort(wanted.rbegin(), wanted.rend());
+        for (const auto &candidate : wanted)
+        {
+            Entry &entry = entries[candidate.second];
+            if (resident - entry.bytes + entry.full_bytes + reserved > budget)
+                continue;
+            size_t bytes = entry.restore();
+            resident += bytes - entry.bytes;
+            entry.bytes = bytes;
+            restores++;
+        }
+    }
+
+    // Bytes of all tracked resources as they are now, reservations not included.
+    size_t resident_bytes() const
+    {
+        return resident;
+    }
+
+    void report() const
+    {
+        if (entries.empty() && reserved == 0)
+            return;
+        size_t demoted = 0;
+        for (const auto &item : entries)
+            demoted += item.second.bytes < item.second.full_bytes ? 1 : 0;
+        std::cout << "TEXTURE_RESIDENCY: " << entries.size() << " resources, " << resident / (1024 * 1024.0) << " MB resident + "
+                  << reserved / (1024 * 1024.0) << " MB reserved of " << budget / (1024 * 1024.0) << " MB, " << demoted << " demoted, "
+                  << demotions << " demotions, " << restores << " restores\n";
+    }
+
+private:
+    typedef std::pair<const void *, uint64_t> Key;
+
+    struct Entry
+    {
+        size_t bytes = 0;
+        size_t full_bytes = 0;
+        uint64_t last_used = 0;
+        Resize demote;
+        Resize restore;
+    };
+
+    std::map<Key, Entry> entries;
+    std::map<const void *, size_t> reservations;
+    size_t resident = 0;
+    uint64_t frame = 0;
+    size_t demotions = 0;
+    size_t restores = 0;
+};
+
+#endif
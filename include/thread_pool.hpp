@@ -0,0 +1,151 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+
+// Fixed set of worker threads consuming a FIFO of jobs.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int thread_count = 0) : stopping(false)
+    {
+        if (thread_count == 0)
+            thread_count = std::max(1u, std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1u);
+        for (unsigned int i = 0; i < thread_count; i++)
+            workers.emplace_back([this]() { work(); });
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    template <typename Function>
+    std::future<void> submit(Function &&function)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<Function>(function));
+        std::future<void> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    // Runs function(i) for every i in [begin, end) split into chunks across the workers and the calling thread.
+    // Called from inside a pool job, the waiting worker runs queued jobs so helpers cannot starve behind it.
+    template <typename Function>
+    void parallel_for(size_t begin, size_t end, Function function, size_t chunk_size = 1)
+    {
+        if (begin >= end)
+            return;
+        chunk_size = std::max<size_t>(chunk_size, 1);
+        size_t chunk_count = (end - begin + chunk_size - 1) / chunk_size;
+        auto next_chunk = std::make_shared<std::atomic<size_t>>(0);
+        auto run_chunks = [=, &function]() {
+            size_t chunk;
+            while ((chunk = next_chunk->fetch_add(1)) < chunk_count)
+            {
+                size_t chunk_begin = begin + chunk * chunk_size;
+                size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+                for (size_t i = chunk_begin; i < chunk_end; i++)
+                    function(i);
+            }
+        };
+
+        size_t helper_count = std::min<size_t>(workers.size(), chunk_count - 1);
+        std::vector<std::future<void>> helpers;
+        for (size_t i = 0; i < helper_count; i++)
+            helpers.push_back(submit(run_chunks));
+        run_chunks();
+        for (std::future<void> &helper : helpers)
+        {
+            if (current_pool() == this)
+            {
+                while (helper.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                {
+                    if (!run_pending_job())
+                        helper.wait();
+                }
+            }
+            helper.get();
+        }
+    }
+
+    // C callback form of parallel_for, user is the pool. Matches stbi_parallel_for_func.
+    static void parallel_for_callback(void *user, int count, void (*task)(void *task_data, int index), void *task_data)
+    {
+        static_cast<ThreadPool*>(user)->parallel_for(0, static_cast<size_t>(count), [task, task_data](size_t i) { task(task_data, static_cast<int>(i)); });
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+
+    static ThreadPool *&current_pool()
+    {
+        static thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    bool run_pending_job()
+    {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (jobs.empty())
+                return false;
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+        job();
+        return true;
+    }
+
+    void work()
+    {
+        current_pool() = this;
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef VERTEX_FORMAT_HPP
+#define VERTEX_FORMAT_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "half_float.hpp"
+
+enum Position_Format {
+    POSITION_FLOAT,
+    POSITION_HALF,
+    POSITION_SNORM16
+};
+
+enum Texture_Coord_Format {
+    TEXTURE_COORD_NONE,
+    TEXTURE_COORD_FLOAT,
+    TEXTURE_COORD_UNORM16
+};
+
+enum Normal_Format {
+    NORMAL_NONE,
+    NORMAL_FLOAT,
+    NORMAL_INT_2_10_10_10
+};
+
+// Largest position error a compact format may introduce, relative to the largest mesh extent.
+const float POSITION_TOLERANCE = 1.0f / 4096.0f;
+
+inline int16_t float_to_snorm16(float value)
+{
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+inline uint16_t float_to_unorm16(float value)
+{
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    return static_cast<uint16_t>(std::lround(value * 65535.0f));
+}
+
+inline uint32_t pack_snorm_2_10_10_10(const glm::vec3 &value)
+{
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float component = std::min(std::max(value[i], -1.0f), 1.0f);
+        int32_t quantized = static_cast<int32_t>(std::lround(component * 511.0f));
+        packed |= (static_cast<uint32_t>(quantized) & 0x3ffu) << (10 * i);
+    }
+    return packed;
+}
+
+inline unsigned int position_format_size(Position_Format format)
+{
+    return format == POSITION_FLOAT ? 3 * sizeof(float) : 4 * sizeof(uint16_t);
+}
+
+inline unsigned int texture_coord_format_size(Texture_Coord_Format format)
+{
+    if (format == TEXTURE_COORD_NONE)
+        return 0;
+    return format == TEXTURE_COORD_FLOAT ? 2 * sizeof(float) : 2 * sizeof(uint16_t);
+}
+
+inline unsigned int normal_format_size(Normal_Format format)
+{
+    if (format == NORMAL_NONE)
+        return 0;
+    return format == NORMAL_FLOAT ? 3 * sizeof(float) : sizeof(uint32_t);
+}
+
+// Expects the target VAO and GL_ARRAY_BUFFER to be bound. Locations: 0 position, 1 texture coord, 2 normal.
+inline void setup_vertex_attributes(Position_Format position_format, Texture_Coord_Format texture_coord_format, Normal_Format normal_format, unsigned int stride, size_t base_offset = 0)
+{
+    size_t offset = base_offset;
+    if (position_format == POSITION_SNORM16)
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)(offset));
+    else if (position_format == POSITION_HALF)
+        glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset));
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset));
+    glEnableVertexAttribArray(0);
+    offset += position_format_size(position_format);
+
+    if (texture_coord_format != TEXTURE_COORD_NONE)
+    {
+        if (texture_coord_format == TEXTURE_COORD_UNORM16)
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(offset));
+        else
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset));
+        glEnableVertexAttribArray(1);
+        offset += texture_coord_format_size(texture_coord_format);
+    }
+
+    if (normal_format != NORMAL_NONE)
+    {
+        if (normal_format == NORMAL_INT_2_10_10_10)
+            glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(offset));
+        else
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset));
+        glEnableVertexAttribArray(2);
+    }
+}
+
+// Interleaved vertex data re-encoded into the smallest formats the mesh bounds allow.
+// Layout per vertex: position (8 bytes, 4th component is padding), texture coord, normal.
+class QuantizedMesh
+{
+public:
+    Position_Format position_format;
+    Texture_Coord_Format texture_coord_format;
+    Normal_Format normal_format;
+
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    // Maps decoded attribute positions back to object space, fold into the model matrix.
+    // Normal matrices must be built from the original model matrix, not the folded one.
+    glm::mat4 dequantization;
+
+    unsigned int vertex_count;
+    unsigned int stride;
+    unsigned int source_stride;
+    std::vector<unsigned char> data;
+
+    // source_stride, texture_coord_offset and normal_offset are in floats, offsets of -1 mean the attribute is absent
+    QuantizedMesh(const float *vertices, unsigned int vertex_count_value, unsigned int source_stride_value, int texture_coord_offset = -1, int normal_offset = -1, float position_tolerance = POSITION_TOLERANCE) : dequantization(1.0f), vertex_count(vertex_count_value), source_stride(source_stride_value)
+    {
+        bounds_min = glm::vec3(INFINITY);
+        bounds_max = glm::vec3(-INFINITY);
+        bool texture_coords_normalized = true;
+        for (unsigned int i = 0; i < vertex_count; i++)
+        {
+            const float *vertex = vertices + i * source_stride;
+            glm::vec3 position(vertex[0], vertex[1], vertex[2]);
+            bounds_min = glm::min(bounds_min, position);
+            bounds_max = glm::max(bounds_max, position);
+            if (texture_coord_offset >= 0)
+            {
+                for (int j = 0; j < 2; j++)
+                {
+                    float value = vertex[texture_coord_offset + j];
+                    if (value < 0.0f || value > 1.0f)
+                        texture_coords_normalized = false;
+                }
+            }
+        }
+        if (vertex_count == 0)
+        {
+            bounds_min = glm::vec3(0.0f);
+            bounds_max = glm::vec3(0.0f);
+        }
+
+        choose_position_format(position_tolerance);
+
+        if (texture_coord_offset < 0)
+            texture_coord_format = TEXTURE_COORD_NONE;
+        else
+            texture_coord_format = texture_coords_normalized ? TEXTURE_COORD_UNORM16 : TEXTURE_COORD_FLOAT;
+
+        normal_format = normal_offset < 0 ? NORMAL_NONE : NORMAL_INT_2_10_10_10;
+
+        stride = position_size() + texture_coord_size() + normal_size();
+        data.resize(static_cast<size_t>(stride) * vertex_count);
+
+        glm::vec3 center = (bounds_min + bounds_max) * 0.5f;
+        glm::vec3 half_extent = quantization_extent();
+        if (position_format == POSITION_SNORM16)
+            dequantization = glm::scale(glm::translate(glm::mat4(1.0f), center), half_extent);
+
+        for (unsigned int i = 0; i < vertex_count; i++)
+        {
+            const float *vertex = vertices + i * source_stride;
+            unsigned char *output = data.data() + static_cast<size_t>(i) * stride;
+
+            glm::vec3 position(vertex[0], vertex[1], vertex[2]);
+            if (position_format == POSITION_SNORM16)
+            {
+                glm::vec3 normalized = (position - center) / half_extent;
+                int16_t packed[4] = { float_to_snorm16(normalized.x), float_to_snorm16(normalized.y), float_to_snorm16(normalized.z), 0 };
+                std::memcpy(output, packed, sizeof(packed));
+            }
+            else if (position_format == POSITION_HALF)
+            {
+                uint16_t packed[4] = { float_to_half(position.x), float_to_half(position.y), float_to_half(position.z), 0 };
+                std::memcpy(output, packed, sizeof(packed));
+            }
+            else
+            {
+                std::memcpy(output, vertex, 3 * sizeof(float));
+            }
+            output += position_size();
+
+            if (texture_coord_format == TEXTURE_COORD_UNORM16)
+            {
+                uint16_t packed[2] = { float_to_unorm16(vertex[texture_coord_offset]), float_to_unorm16(vertex[texture_coord_offset + 1]) };
+                std::memcpy(output, packed, sizeof(packed));
+            }
+            else if (texture_coord_format == TEXTURE_COORD_FLOAT)
+            {
+                std::memcpy(output, vertex + texture_coord_offset, 2 * sizeof(float));
+            }
+            output += texture_coord_size();
+
+            if (normal_format == NORMAL_INT_2_10_10_10)
+            {
+                uint32_t packed = pack_snorm_2_10_10_10(glm::vec3(vertex[normal_offset], vertex[normal_offset + 1], vertex[normal_offset + 2]));
+                std::memcpy(output, &packed, sizeof(packed));
+            }
+        }
+    }
+
+    unsigned int position_size() const
+    {
+        return position_format_size(position_format);
+    }
+
+    unsigned int texture_coord_size() const
+    {
+        return texture_coord_format_size(texture_coord_format);
+    }
+
+    unsigned int normal_size() const
+    {
+        return normal_format_size(normal_format);
+    }
+
+    size_t size() const
+    {
+        return data.size();
+    }
+
+    size_t source_size() const
+    {
+        return static_cast<size_t>(source_stride) * sizeof(float) * vertex_count;
+    }
+
+    void setup_attributes(size_t base_offset = 0) const
+    {
+        setup_vertex_attributes(position_format, texture_coord_format, normal_format, stride, base_offset);
+    }
+
+    void report(const std::string &name) const
+    {
+        const char *position_names[] = { "float32", "half", "snorm16" };
+        const char *texture_coord_names[] = { "none", "float32", "unorm16" };
+        const char *normal_names[] = { "none", "float32", "int_2_10_10_10" };
+
+        size_t saved = source_size() > size() ? source_size() - size() : 0;
+        std::cout << "MESH::" << name << ": " << vertex_count << " vertices, position " << position_names[position_format]
+                  << ", texture coord " << texture_coord_names[texture_coord_format] << ", normal " << normal_names[normal_format]
+                  << ", stride " << source_stride * sizeof(float) << " -> " << stride << " bytes, "
+                  << source_size() << " -> " << size() << " bytes (" << saved << " saved)\n";
+    }
+
+private:
+    glm::vec3 quantization_extent() const
+    {
+        glm::vec3 half_extent = (bounds_max - bounds_min) * 0.5f;
+        for (int i = 0; i < 3; i++)
+        {
+            if (half_extent[i] <= 0.0f)
+                half_extent[i] = 1.0f;
+        }
+        return half_extent;
+    }
+
+    void choose_position_format(float position_tolerance)
+    {
+        glm::vec3 extent = bounds_max - bounds_min;
+        float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+        float allowed_error = max_extent > 0.0f ? max_extent * position_tolerance : INFINITY;
+
+        // snorm16 spends its 16 bits across the bounds, half spends 11 bits of mantissa relative to the magnitude
+        float max_magnitude = 0.0f;
+        for (int i = 0; i < 3; i++)
+            max_magnitude = std::max(max_magnitude, std::max(std::fabs(bounds_min[i]), std::fabs(bounds_max[i])));
+
+        glm::vec3 half_extent = quantization_extent();
+        float snorm_error = std::max(half_extent.x, std::max(half_extent.y, half_extent.z)) / 32767.0f;
+        float half_error = max_magnitude < 65504.0f ? max_magnitude / 2048.0f : INFINITY;
+
+        if (snorm_error <= allowed_error && snorm_error <= half_error)
+            position_format = POSITION_SNORM16;
+        else if (half_error <= allowed_error)
+            position_format = POSITION_HALF;
+        else
+            position_format = POSITION_FLOAT;
+    }
+};
+
+#endif
@@ -0,0 +1,642 @@
+#ifndef VIRTUAL_TEXTURE_HPP
+#define VIRTUAL_TEXTURE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "mapped_file.hpp"
+#include "mip_generator.hpp"
+#include "thread_pool.hpp"
+#include "shader.hpp"
+#include "texture_residency.hpp"
+
+// Tiled mip chain for virtual texturing: header, one entry per mip, then RGBA8 tiles of
+// (tile_size + 2 * border)^2 texels in mip order, row by row. The border repeats the neighbouring texels,
+// clamped at the image edges, so bilinear filtering never reads into the next page of the cache.
+// The chain stops at the first mip that fits a single tile, which stays resident as the fallback.
+const char VIRTUAL_TEXTURE_IDENTIFIER[8] = { 'V', 'T', 'E', 'X', 'T', 'I', 'L', '1' };
+const int VIRTUAL_TEXTURE_MAX_MIPS = 16;
+// Tiles start page aligned, so reading one in touches as few pages as possible.
+const size_t VIRTUAL_TEXTURE_DATA_ALIGNMENT = 4096;
+
+struct VirtualTextureHeader
+{
+    char identifier[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t border;
+    uint32_t mip_count;
+    uint32_t tile_count;
+    uint64_t data_offset;
+};
+
+struct VirtualTextureMip
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t first_tile;
+};
+
+// Cuts an RGBA8 mip chain, as generate_mip_chain makes it, into a tile file.
+inline bool write_virtual_texture(const std::string &path, const std::vector<MipLevel> &levels, int tile_size, int border)
+{
+    if (levels.empty() || tile_size <= 0 || border < 0 || border > tile_size)
+        return false;
+
+    VirtualTextureHeader header;
+    std::memcpy(header.identifier, VIRTUAL_TEXTURE_IDENTIFIER, sizeof(VIRTUAL_TEXTURE_IDENTIFIER));
+    header.width = static_cast<uint32_t>(levels[0].width);
+    header.height = static_cast<uint32_t>(levels[0].height);
+    header.tile_size = static_cast<uint32_t>(tile_size);
+    header.border = static_cast<uint32_t>(border);
+    header.tile_count = 0;
+
+    std::vector<VirtualTextureMip> mips;
+    for (const MipLevel &level : levels)
+    {
+        VirtualTextureMip mip;
+        mip.width = static_cast<uint32_t>(level.width);
+        mip.height = static_cast<uint32_t>(level.height);
+        mip.tiles_x = (mip.width + header.tile_size - 1) / header.tile_size;
+        mip.tiles_y = (mip.height + header.tile_size - 1) / header.tile_size;
+        mip.first_tile = header.tile_count;
+        header.tile_count += mip.tiles_x * mip.tiles_y;
+        mips.push_back(mip);
+        if (mips.size() == static_cast<size_t>(VIRTUAL_TEXTURE_MAX_MIPS) || (mip.tiles_x == 1 && mip.tiles_y == 1))
+            break;
+    }
+    if (mips.back().tiles_x != 1 || mips.back().tiles_y != 1)
+    {
+        std::cout << "ERROR::VIRTUAL_TEXTURE::TOO_MANY_MIPS " << path << "\n";
+        return false;
+    }
+    header.mip_count = static_cast<uint32_t>(mips.size());
+    size_t table_end = sizeof(header) + sizeof(VirtualTextureMip) * mips.size();
+    header.data_offset = (table_end + VIRTUAL_TEXTURE_DATA_ALIGNMENT - 1) & ~static_cast<uint64_t>(VIRTUAL_TEXTURE_DATA_ALIGNMENT - 1);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << path << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(mips.data()), static_cast<std::streamsize>(sizeof(VirtualTextureMip) * mips.size()));
+    std::vector<char> padding(static_cast<size_t>(header.data_offset) - table_end, 0);
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+    const int slot_size = tile_size + 2 * border;
+    std::vector<unsigned char> tile(static_cast<size_t>(slot_size) * slot_size * 4);
+    for (size_t m = 0; m < mips.size(); m++)
+    {
+        const MipLevel &level = levels[m];
+        for (uint32_t tile_y = 0; tile_y < mips[m].tiles_y; tile_y++)
+        {
+            for (uint32_t tile_x = 0; tile_x < mips[m].tiles_x; tile_x++)
+            {
+                for (int y = 0; y < slot_size; y++)
+                {
+                    int source_y = std::min(std::max(static_cast<int>(tile_y) * tile_size - border + y, 0), level.height - 1);
+                    const unsigned char *row = level.data.data() + level.pitch * source_y;
+                    for (int x = 0; x < slot_size; x++)
+                    {
+                        int source_x = std::min(std::max(static_cast<int>(tile_x) * tile_size - border + x, 0), level.width - 1);
+                        std::memcpy(&tile[(static_cast<size_t>(y) * slot_size + x) * 4], row + source_x * 4, 4);
+                    }
+                }
+                file.write(reinterpret_cast<const char*>(tile.data()), static_cast<std::streamsize>(tile.size()));
+            }
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// Read only view of a tile file. Tile reads only touch the mapping and may run on several threads at once.
+class VirtualTextureFile
+{
+public:
+    VirtualTextureHeader header = {};
+    std::vector<VirtualTextureMip> mips;
+
+    bool open(const std::string &path)
+    {
+        close();
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(VirtualTextureHeader))
+            return fail(path, "TRUNCATED");
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.identifier, VIRTUAL_TEXTURE_IDENTIFIER, sizeof(VIRTUAL_TEXTURE_IDENTIFIER)) != 0)
+            return fail(path, "INVALID_IDENTIFIER");
+        if (header.mip_count == 0 || header.mip_count > static_cast<uint32_t>(VIRTUAL_TEXTURE_MAX_MIPS) || header.tile_size == 0)
+            return fail(path, "INVALID_HEADER");
+        if (sizeof(header) + sizeof(VirtualTextureMip) * header.mip_count > file.size())
+            return fail(path, "TRUNCATED");
+        mips.resize(header.mip_count);
+        std::memcpy(mips.data(), file.data() + sizeof(header), sizeof(VirtualTextureMip) * mips.size());
+        for (const VirtualTextureMip &mip : mips)
+        {
+            if (mip.tiles_x == 0 || mip.tiles_y == 0 || mip.tiles_x > mips[0].tiles_x || mip.tiles_y > mips[0].tiles_y ||
+                static_cast<uint64_t>(mip.first_tile) + mip.tiles_x * mip.tiles_y > header.tile_count)
+                return fail(path, "INVALID_HEADER");
+        }
+        if (mips.back().tiles_x != 1 || mips.back().tiles_y != 1)
+            return fail(path, "INVALID_HEADER");
+        if (header.data_offset > file.size() || (file.size() - header.data_offset) / tile_bytes() < header.tile_count)
+            return fail(path, "TRUNCATED");
+        file.advise(ACCESS_RANDOM);
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        mips.clear();
+    }
+
+    bool is_open() const
+    {
+        return file.is_open();
+    }
+
+    int slot_size() const
+    {
+        return static_cast<int>(header.tile_size + 2 * header.border);
+    }
+
+    size_t tile_bytes() const
+    {
+        return static_cast<size_t>(slot_size()) * slot_size() * 4;
+    }
+
+    uint32_t tile_index(int mip, int x, int y) const
+    {
+        return mips[mip].first_tile + static_cast<uint32_t>(y) * mips[mip].tiles_x + static_cast<uint32_t>(x);
+    }
+
+    const unsigned char *tile(uint32_t index) const
+    {
+        return file.data() + header.data_offset + tile_bytes() * index;
+    }
+
+    void prefetch(uint32_t index) const
+    {
+        file.advise(ACCESS_WILL_NEED, static_cast<size_t>(header.data_offset + tile_bytes() * index), tile_bytes());
+    }
+
+private:
+    MappedFile file;
+
+    bool fail(const std::string &path, const std::string &reason)
+    {
+        std::cout << "ERROR::VIRTUAL_TEXTURE::" << reason << " " << path << "\n";
+        close();
+        return false;
+    }
+};
+
+// Streams the tiles a frame needs into one physical cache texture of fixed size pages.
+// Every frame the tiles in view are requested, from a GPU feedback pass or, as main does, estimated on
+// the CPU from camera distance. update() reads missing tiles on the pool, uploads finished ones over the
+// least recently used pages and rewrites the indirection texture, which maps every tile of every mip to
+// the page holding it or the nearest resident coarser tile. The fragment shader looks up the indirection
+// entry for the mip it wants and samples the page, see sample_virtual_texture in frag_shader.frag.
+// Tracked by a TextureResidency, the cache loses half its rows while unused over budget. Its tiles are
+// streamed in again as they are requested, the same as after a camera cut.
+class VirtualTexture
+{
+public:
+    // Tiles read from the file at once. Reads beyond this wait for a later frame, coarsest mips first.
+    size_t max_loads_in_flight = 32;
+    // Tiles copied into the cache per update, so a camera cut cannot stall one frame with all of its tiles.
+    size_t upload_budget = 16;
+
+    explicit VirtualTexture(ThreadPool &pool) : pool(pool)
+    {
+    }
+
+    VirtualTexture(const VirtualTexture &) = delete;
+    VirtualTexture &operator=(const VirtualTexture &) = delete;
+
+    // Call on the GL thread. The cache holds pages_x * pages_y tiles, 255 at most in either direction.
+    bool open(const std::string &path, int pages_x = 16, int pages_y = 16)
+    {
+        if (!file.open(path))
+            return false;
+        cache_pages_x = std::min(std::max(pages_x, 1), 255);
+        full_pages_y = std::min(std::max(pages_y, 1), 255);
+
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glGenTextures(1, &physical_texture);
+        glBindTexture(GL_TEXTURE_2D, physical_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        // All mips side by side in one integer texture, a mip's tiles start at its column offset.
+        indirection_width = 0;
+        for (const VirtualTextureMip &mip : file.mips)
+        {
+            indirection_offsets.push_back(indirection_width);
+            indirection_width += static_cast<int>(mip.tiles_x);
+        }
+        indirection_height = static_cast<int>(file.mips[0].tiles_y);
+        indirection.assign(static_cast<size_t>(indirection_width) * indirection_height * 4, 0);
+        glGenTextures(1, &indirection_texture);
+        glBindTexture(GL_TEXTURE_2D, indirection_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, indirection_width, indirection_height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+
+        requested_frame.assign(file.header.tile_count, 0);
+        loading.assign(file.header.tile_count, 0);
+        allocate_cache(full_pages_y);
+        track_cache();
+        return true;
+    }
+
+    // Tracks the page cache, with the indirection texture, with residency once open. residency has to outlive
+    // the virtual texture.
+    void track_memory(TextureResidency &residency_value)
+    {
+        residency = &residency_value;
+        track_cache();
+    }
+
+    bool is_open() const
+    {
+        return file.is_open();
+    }
+
+    int width() const
+    {
+        return static_cast<int>(file.header.width);
+    }
+
+    int height() const
+    {
+        return static_cast<int>(file.header.height);
+    }
+
+    int mip_count() const
+    {
+        return static_cast<int>(file.mips.size());
+    }
+
+    // The mip a surface needs when one screen pixel covers texels_per_pixel texels of mip 0.
+    int mip_for_footprint(float texels_per_pixel) const
+    {
+        if (!(texels_per_pixel > 1.0f))
+            return 0;
+        return std::min(static_cast<int>(std::floor(std::log2(texels_per_pixel))), mip_count() - 1);
+    }
+
+    // Marks the tiles of a mip covering a UV rectangle as needed this frame, along with their coarser
+    // ancestors, so detail refines mip by mip while the finer tiles are still loading.
+    void request(int mip, glm::vec2 uv_min, glm::vec2 uv_max)
+    {
+        if (!is_open())
+            return;
+        if (residency)
+            residency->use(this, 0);
+        mip = std::min(std::max(mip, 0), mip_count() - 1);
+        uv_min = glm::clamp(uv_min, glm::vec2(0.0f), glm::vec2(1.0f));
+        uv_max = glm::clamp(uv_max, glm::vec2(0.0f), glm::vec2(1.0f));
+        for (int m = mip; m < mip_count(); m++)
+        {
+            const VirtualTextureMip &level = file.mips[m];
+            int x0 = std::min(static_cast<int>(uv_min.x * level.width) / static_cast<int>(file.header.tile_size), static_cast<int>(level.tiles_x) - 1);
+            int y0 = std::min(static_cast<int>(uv_min.y * level.height) / static_cast<int>(file.header.tile_size), static_cast<int>(level.tiles_y) - 1);
+            int x1 = std::min(static_cast<int>(uv_max.x * level.width) / static_cast<int>(file.header.tile_size), static_cast<int>(level.tiles_x) - 1);
+            int y1 = std::min(static_cast<int>(uv_max.y * level.height) / static_cast<int>(file.header.tile_size), static_cast<int>(level.tiles_y) - 1);
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    uint32_t tile = file.tile_index(m, x, y);
+                    if (requested_frame[tile] == frame + 1)
+                        continue;
+                    requested_frame[tile] = frame + 1;
+                    requested.push_back(tile);
+                }
+            }
+        }
+    }
+
+    // CPU feedback: requests what a surface of world_size units mapped to the UV rectangle needs when seen
+    // from distance units away, with a vertical field of view of fov_y radians on a viewport_height pixel view.
+    void request_for_distance(float world_size, float distance, float fov_y, int viewport_height, glm::vec2 uv_min = glm::vec2(0.0f), glm::vec2 uv_max = glm::vec2(1.0f))
+    {
+        if (!is_open())
+            return;
+        float pixels = world_size * viewport_height / (2.0f * std::tan(fov_y * 0.5f) * std::max(distance, 1e-3f));
+        float texels = std::max((uv_max.x - uv_min.x) * width(), (uv_max.y - uv_min.y) * height());
+        request(mip_for_footprint(texels / std::max(pixels, 1e-3f)), uv_min, uv_max);
+    }
+
+    // Call once per frame on the GL thread, after this frame's requests.
+    void update()
+    {
+        if (!is_open())
+            return;
+        frame++;
+
+        std::vector<uint32_t> missing;
+        for (uint32_t tile : requested)
+        {
+            if (page_of_tile[tile] >= 0)
+                pages[page_of_tile[tile]].last_used = frame;
+            else if (!loading[tile])
+                missing.push_back(tile);
+        }
+        requested.clear();
+
+        // Coarse tiles first: they cover more of the screen and are the fallback for the finer ones.
+        std::stable_sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return a > b; });
+        for (uint32_t tile : missing)
+        {
+            if (loads_in_flight >= max_loads_in_flight)
+                break;
+            loading[tile] = 1;
+            loads_in_flight++;
+            file.prefetch(tile);
+            jobs.push_back(pool.submit([this, tile]() {
+                // Faulting the tile in from the mapping is the slow part, the GL thread only sees finished copies.
+                std::vector<unsigned char> data(file.tile(tile), file.tile(tile) + file.tile_bytes());
+                std::lock_guard<std::mutex> lock(mutex);
+                loaded.push_back({ tile, std::move(data) });
+            }));
+        }
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](std::future<void> &job) {
+            return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }), jobs.end());
+
+        bool changed = false;
+        for (size_t uploaded = 0; uploaded < upload_budget; uploaded++)
+        {
+            LoadedTile tile;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (loaded.empty())
+                    break;
+                tile = std::move(loaded.front());
+                loaded.pop_front();
+            }
+            loading[tile.index] = 0;
+            loads_in_flight--;
+            int page = find_page();
+            if (page < 0)
+            {
+                // Everything cached is in use this frame, the tile is requested again next frame.
+                dropped++;
+                continue;
+            }
+            upload_tile(tile.index, tile.data.data(), page);
+            changed = true;
+        }
+        if (changed)
+            rebuild_indirection();
+    }
+
+    // Binds the cache and indirection textures and sets the uniforms sample_virtual_texture reads.
+    // The active texture unit is left as it was.
+    void bind(Shader &shader, int physical_unit, int indirection_unit) const
+    {
+        GLint previous_unit;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &previous_unit);
+        glActiveTexture(GL_TEXTURE0 + physical_unit);
+        glBindTexture(GL_TEXTURE_2D, physical_texture);
+        glActiveTexture(GL_TEXTURE0 + indirection_unit);
+        glBindTexture(GL_TEXTURE_2D, indirection_texture);
+        glActiveTexture(static_cast<GLenum>(previous_unit));
+
+        shader.use();
+        shader.set_int("vt_physical", physical_unit);
+        shader.set_int("vt_indirection", indirection_unit);
+        shader.set_int("vt_mip_count", mip_count());
+        shader.set_float("vt_tile_size", static_cast<float>(file.header.tile_size));
+        shader.set_float("vt_border", static_cast<float>(file.header.border));
+        std::vector<float> mip_sizes;
+        for (const VirtualTextureMip &mip : file.mips)
+        {
+            mip_sizes.push_back(static_cast<float>(mip.width));
+            mip_sizes.push_back(static_cast<float>(mip.height));
+        }
+        glUniform2fv(glGetUniformLocation(shader.ID, "vt_mip_sizes"), mip_count(), mip_sizes.data());
+        glUniform1iv(glGetUniformLocation(shader.ID, "vt_indirection_offsets"), mip_count(), indirection_offsets.data());
+    }
+
+    void report() const
+    {
+        if (!is_open())
+            return;
+        size_t resident = 0;
+        for (const Page &page : pages)
+            resident += page.tile >= 0 ? 1 : 0;
+        std::cout << "VIRTUAL_TEXTURE: " << width() << "x" << height() << ", " << mip_count() << " mips, " << file.header.tile_count << " tiles, "
+                  << resident << "/" << pages.size() << " pages resident, " << uploads << " uploads, " << evictions << " evictions, "
+                  << dropped << " dropped\n";
+    }
+
+    ~VirtualTexture()
+    {
+        for (std::future<void> &job : jobs)
+            job.wait();
+        glDeleteTextures(1, &physical_texture);
+        glDeleteTextures(1, &indirection_texture);
+        if (residency)
+            residency->forget(this);
+    }
+
+private:
+    struct Page
+    {
+        int tile = -1;
+        uint64_t last_used = 0;
+        bool pinned = false;
+    };
+
+    struct LoadedTile
+    {
+        uint32_t index = 0;
+        std::vector<unsigned char> data;
+    };
+
+    ThreadPool &pool;
+    VirtualTextureFile file;
+    unsigned int physical_texture = 0;
+    unsigned int indirection_texture = 0;
+    int cache_pages_x = 0;
+    int cache_pages_y = 0;
+    // Rows the cache was opened with, fewer while the residency budget has it demoted.
+    int full_pages_y = 0;
+    int indirection_width = 0;
+    int indirection_height = 0;
+    std::vector<int> indirection_offsets;
+    std::vector<unsigned char> indirection;
+    TextureResidency *residency = nullptr;
+
+    std::vector<Page> pages;
+    std::vector<int> page_of_tile;
+    std::vector<uint64_t> requested_frame;
+    std::vector<uint8_t> loading;
+    std::vector<uint32_t> requested;
+    uint64_t frame = 0;
+
+    std::vector<std::future<void>> jobs;
+    std::deque<LoadedTile> loaded;
+    size_t loads_in_flight = 0;
+    std::mutex mutex;
+
+    size_t uploads = 0;
+    size_t evictions = 0;
+    size_t dropped = 0;
+
+    // A free page, or the least recently used one not needed this frame.
+    int find_page()
+    {
+        int best = -1;
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            const Page &page = pages[i];
+            if (page.pinned || (page.tile >= 0 && page.last_used >= frame))
+                continue;
+            if (page.tile < 0)
+                return static_cast<int>(i);
+            if (best < 0 || page.last_used < pages[best].last_used)
+                best = static_cast<int>(i);
+        }
+        return best;
+    }
+
+    void upload_tile(uint32_t tile, const unsigned char *data, int page)
+    {
+        Page &target = pages[page];
+        if (target.tile >= 0)
+        {
+            page_of_tile[target.tile] = -1;
+            evictions++;
+        }
+        target.tile = static_cast<int>(tile);
+        target.last_used = frame;
+        page_of_tile[tile] = page;
+
+        // Tiles arrive mid-frame, keep whatever the active unit has bound.
+        const int slot_size = file.slot_size();
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glBindTexture(GL_TEXTURE_2D, physical_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (page % cache_pages_x) * slot_size, (page / cache_pages_x) * slot_size, slot_size, slot_size, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+        uploads++;
+    }
+
+    // Specifies the physical texture for pages_y rows of pages, which empties the cache. Only the root tile is
+    // uploaded again, the rest come back as they are requested.
+    void allocate_cache(int pages_y)
+    {
+        cache_pages_y = pages_y;
+        const int slot_size = file.slot_size();
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glBindTexture(GL_TEXTURE_2D, physical_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cache_pages_x * slot_size, cache_pages_y * slot_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+
+        pages.assign(static_cast<size_t>(cache_pages_x) * cache_pages_y, Page());
+        page_of_tile.assign(file.header.tile_count, -1);
+
+        // The coarsest mip is a single tile and is never evicted, every lookup falls back to it.
+        const uint32_t root = file.tile_index(static_cast<int>(file.mips.size()) - 1, 0, 0);
+        upload_tile(root, file.tile(root), 0);
+        pages[0].pinned = true;
+        rebuild_indirection();
+    }
+
+    size_t cache_bytes(int pages_y) const
+    {
+        const size_t slot_size = static_cast<size_t>(file.slot_size());
+        return cache_pages_x * slot_size * pages_y * slot_size * 4 + static_cast<size_t>(indirection_width) * indirection_height * 4;
+    }
+
+    void track_cache()
+    {
+        if (!residency || !is_open())
+            return;
+        residency->track(this, 0, cache_bytes(cache_pages_y), cache_bytes(full_pages_y), [this]() {
+            if (cache_pages_y > 1)
+                allocate_cache(cache_pages_y / 2);
+            return cache_bytes(cache_pages_y);
+        }, [this]() {
+            if (cache_pages_y < full_pages_y)
+                allocate_cache(full_pages_y);
+            return cache_bytes(cache_pages_y);
+        });
+    }
+
+    // Entries hold the page column and row, the mip of the tile in that page and 255 once the tile itself is resident.
+    // Mips are filled coarse to fine, so a missing tile copies its parent's already resolved entry.
+    void rebuild_indirection()
+    {
+        const int row_entries = indirection_width;
+        for (int m = mip_count() - 1; m >= 0; m--)
+        {
+            const VirtualTextureMip &level = file.mips[m];
+            for (int y = 0; y < static_cast<int>(level.tiles_y); y++)
+            {
+                for (int x = 0; x < static_cast<int>(level.tiles_x); x++)
+                {
+                    unsigned char *entry = &indirection[(static_cast<size_t>(y) * row_entries + indirection_offsets[m] + x) * 4];
+                    int page = page_of_tile[file.tile_index(m, x, y)];
+                    if (page >= 0)
+                    {
+                        entry[0] = static_cast<unsigned char>(page % cache_pages_x);
+                        entry[1] = static_cast<unsigned char>(page / cache_pages_x);
+                        entry[2] = static_cast<unsigned char>(m);
+                        entry[3] = 255;
+                    }
+                    else
+                    {
+                        // Odd sizes can leave the last tile without a parent of its own, its left neighbour's parent covers it.
+                        const VirtualTextureMip &coarser = file.mips[m + 1];
+                        int parent_x = std::min(x / 2, static_cast<int>(coarser.tiles_x) - 1);
+                        int parent_y = std::min(y / 2, static_cast<int>(coarser.tiles_y) - 1);
+                        const unsigned char *parent = &indirection[(static_cast<size_t>(parent_y) * row_entries + indirection_offsets[m + 1] + parent_x) * 4];
+                        std::memcpy(entry, parent, 3);
+                        entry[3] = 0;
+                    }
+                }
+            }
+        }
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        glBindTexture(GL_TEXTURE_2D, indirection_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, indirection_width, indirection_height, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirection.data());
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+    }
+};
+
+#endif
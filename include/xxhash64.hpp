@@ -0,0 +1,108 @@
+#ifndef XXHASH64_HPP
+#define XXHASH64_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// XXH64 from the xxHash specification, for content keys of cached files. Not a cryptographic hash.
+const uint64_t XXHASH64_PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t XXHASH64_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t XXHASH64_PRIME3 = 0x165667B19E3779F9ULL;
+const uint64_t XXHASH64_PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t XXHASH64_PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t xxhash64_rotate(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Little endian loads, memcpy keeps unaligned input legal.
+inline uint64_t xxhash64_read64(const unsigned char *data)
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint32_t xxhash64_read32(const unsigned char *data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint64_t xxhash64_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * XXHASH64_PRIME2;
+    accumulator = xxhash64_rotate(accumulator, 31);
+    return accumulator * XXHASH64_PRIME1;
+}
+
+inline uint64_t xxhash64_merge(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= xxhash64_round(0, accumulator);
+    return hash * XXHASH64_PRIME1 + XXHASH64_PRIME4;
+}
+
+inline uint64_t xxhash64(const void *input, size_t size, uint64_t seed = 0)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(input);
+    const unsigned char *end = data + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        // Four independent lanes per 32-byte stripe, so the multiplies overlap.
+        uint64_t v1 = seed + XXHASH64_PRIME1 + XXHASH64_PRIME2;
+        uint64_t v2 = seed + XXHASH64_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXHASH64_PRIME1;
+        const unsigned char *limit = end - 32;
+        do
+        {
+            v1 = xxhash64_round(v1, xxhash64_read64(data));
+            v2 = xxhash64_round(v2, xxhash64_read64(data + 8));
+            v3 = xxhash64_round(v3, xxhash64_read64(data + 16));
+            v4 = xxhash64_round(v4, xxhash64_read64(data + 24));
+            data += 32;
+        } while (data <= limit);
+
+        hash = xxhash64_rotate(v1, 1) + xxhash64_rotate(v2, 7) + xxhash64_rotate(v3, 12) + xxhash64_rotate(v4, 18);
+        hash = xxhash64_merge(hash, v1);
+        hash = xxhash64_merge(hash, v2);
+        hash = xxhash64_merge(hash, v3);
+        hash = xxhash64_merge(hash, v4);
+    }
+    else
+    {
+        hash = seed + XXHASH64_PRIME5;
+    }
+
+    hash += static_cast<uint64_t>(size);
+    for (; data + 8 <= end; data += 8)
+    {
+        hash ^= xxhash64_round(0, xxhash64_read64(data));
+        hash = xxhash64_rotate(hash, 27) * XXHASH64_PRIME1 + XXHASH64_PRIME4;
+    }
+    if (data + 4 <= end)
+    {
+        hash ^= static_cast<uint64_t>(xxhash64_read32(data)) * XXHASH64_PRIME1;
+        hash = xxhash64_rotate(hash, 23) * XXHASH64_PRIME2 + XXHASH64_PRIME3;
+        data += 4;
+    }
+    for (; data < end; data++)
+    {
+        hash ^= static_cast<uint64_t>(*data) * XXHASH64_PRIME5;
+        hash = xxhash64_rotate(hash, 11) * XXHASH64_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXHASH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXHASH64_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#version 330 core
+
+in vec2 texture_coord;
+out vec4 frag_color;
+
+uniform sampler2DArray texture1;
+uniform sampler2DArray texture2;
+uniform vec2 layers;
+uniform vec4 uv_rect1;
+uniform vec4 uv_rect2;
+uniform vec2 min_lods;
+uniform float multiplier;
+
+// The live blend of frag_shader.frag over the whole face, from the finest resident levels.
+void main()
+{
+    vec4 color1 = textureLod(texture1, vec3(uv_rect1.xy + texture_coord * uv_rect1.zw, layers.x), min_lods.x);
+    vec4 color2 = textureLod(texture2, vec3(uv_rect2.xy + texture_coord * uv_rect2.zw, layers.y), min_lods.y);
+    frag_color = mix(color1, color2, multiplier);
+}
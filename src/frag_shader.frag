@@ -1,14 +1,77 @@
 #version 330 core
 
 in vec2 texture_coord;
+in vec2 texture_coord1;
+in vec2 texture_coord2;
+flat in vec2 layers;
+flat in vec2 min_lods;
 out vec4 frag_color;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+uniform sampler2DArray texture1;
+uniform sampler2DArray texture2;
 
 uniform float multiplier;
 
+// Both textures already blended with multiplier, see BlendBaker.
+uniform bool use_composite;
+uniform sampler2D composite;
+
+// Virtual texture in place of texture1, see VirtualTexture::bind.
+uniform bool use_virtual_texture;
+uniform sampler2D vt_physical;
+uniform usampler2D vt_indirection;
+uniform int vt_mip_count;
+uniform float vt_tile_size;
+uniform float vt_border;
+uniform vec2 vt_mip_sizes[16];
+uniform int vt_indirection_offsets[16];
+
+// Streamed every frame and multiplied over the result when use_procedural is set, see StreamingTexture.
+uniform bool use_procedural;
+uniform sampler2D procedural;
+
+vec4 sample_virtual_texture(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    vec2 texel = uv * vt_mip_sizes[0];
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+    int mip = min(int(lod + 0.5), vt_mip_count - 1);
+
+    // The entry names the page and mip of the tile itself or of its nearest resident ancestor.
+    ivec2 tile = min(ivec2(uv * vt_mip_sizes[mip] / vt_tile_size), ivec2(ceil(vt_mip_sizes[mip] / vt_tile_size)) - 1);
+    uvec4 entry = texelFetch(vt_indirection, ivec2(vt_indirection_offsets[mip] + tile.x, tile.y), 0);
+    int resident_mip = int(entry.z);
+
+    vec2 resident_texel = uv * vt_mip_sizes[resident_mip];
+    vec2 resident_tile = min(floor(resident_texel / vt_tile_size), ceil(vt_mip_sizes[resident_mip] / vt_tile_size) - 1.0);
+    vec2 page_origin = vec2(entry.xy) * (vt_tile_size + 2.0 * vt_border) + vt_border;
+    // The cache shrinks while over the texture budget, so its size is read rather than passed in.
+    return textureLod(vt_physical, (page_origin + resident_texel - resident_tile * vt_tile_size) / vec2(textureSize(vt_physical, 0)), 0.0);
+}
+
+// Streamed images only have their levels from min_lod down, the bias keeps sampling there.
+vec4 sample_streamed(sampler2DArray sampler, vec2 uv, float layer, float min_lod)
+{
+    vec2 texel = uv * vec2(textureSize(sampler, 0).xy);
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    return texture(sampler, vec3(uv, layer), max(min_lod - lod, 0.0));
+}
+
 void main()
 {
-    frag_color = mix(texture(texture1, texture_coord), texture(texture2, texture_coord), multiplier);
+    if (use_composite)
+    {
+        frag_color = texture(composite, texture_coord);
+    }
+    else
+    {
+        vec4 color1 = use_virtual_texture ? sample_virtual_texture(texture_coord1) : sample_streamed(texture1, texture_coord1, layers.x, min_lods.x);
+        frag_color = mix(color1, sample_streamed(texture2, texture_coord2, layers.y, min_lods.y), multiplier);
+    }
+    if (use_procedural)
+        frag_color *= texture(procedural, texture_coord);
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <cstddef>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <cstdlib>
+#include <cerrno>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -7,11 +17,28 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.hpp"
 #include "camera.hpp"
+#include "vertex_format.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_import.hpp"
+#include "mesh_simplifier.hpp"
+#include "lod_selector.hpp"
+#include "thread_pool.hpp"
+#include "occlusion_culler.hpp"
+#include "occlusion_queries.hpp"
+#include "texture_array.hpp"
+#include "virtual_texture.hpp"
+#include "blend_baker.hpp"
+#include "streaming_texture.hpp"
 #include "stb_image.h"
 
 const int width = 800;
 const int height = 600;
 const std::string name = "OpenGL";
+const size_t max_occluders = 8;
+const float occlusion_group_size = 4.0f;
+const float near_plane = 0.1f;
+const float far_plane = 100.0f;
+const int procedural_size = 256;
 
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float last_x = width / 2.0f;
@@ -22,6 +49,29 @@ float multiplier = 0.5f;
 float delta_time = 0.0f;
 float last_frame = 0.0f;
 
+// Size of the framebuffer in pixels, which differs from the window size on high-DPI displays.
+int framebuffer_width = width;
+int framebuffer_height = height;
+
+// Per-instance attributes 3 to 6, the layers and rects select each instance's images in the texture arrays.
+struct CubeInstance
+{
+    glm::vec3 position;
+    glm::vec2 layers;
+    glm::vec4 uv_rect1;
+    glm::vec4 uv_rect2;
+    glm::vec2 min_lods;
+};
+
+void setup_instance_attributes(size_t offset)
+{
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, position)));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, layers)));
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, uv_rect1)));
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, uv_rect2)));
+    glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(offset + offsetof(CubeInstance, min_lods)));
+}
+
 void input_process(GLFWwindow* window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_TRUE)
@@ -61,6 +111,12 @@ void input_process(GLFWwindow* window)
 void framesize_buffer_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    // A minimized window reports 0, keep the last size so the projection stays valid.
+    if (width > 0 && height > 0)
+    {
+        framebuffer_width = width;
+        framebuffer_height = height;
+    }
 }
 
 void mouse_callback(GLFWwindow* window, double x_pos_in, double y_pos_in)
@@ -89,41 +145,33 @@ void scroll_callback(GLFWwindow* window, double x_offset, double y_offset)
     camera.process_mouse_scroll(static_cast<float>(y_offset));
 }
 
-int main()
+// Every GL object lives in this scope, so all of them are released while the context still exists.
+// Fills frames of a grey wave pattern for the --procedural overlay, one per 60 Hz tick so it does not run ahead.
+StreamingTexture::Producer shimmer_producer()
 {
-    if (!glfwInit())
-    {
-        std::cout << "Failed to initialize GLFW\n";
-        glfwTerminate();
-        return -1;
-    }
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    GLFWwindow* window = glfwCreateWindow(width, height, name.c_str(), nullptr, nullptr);
-    if (window == nullptr)
-    {
-        std::cout << "Failed to create a window\n";
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framesize_buffer_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-    glEnable(GL_DEPTH_TEST);
-
+    return [due = std::chrono::steady_clock::now()](unsigned char *pixels, size_t pitch, uint64_t frame) mutable {
+        due += std::chrono::microseconds(16667);
+        std::this_thread::sleep_until(due);
+        float time = static_cast<float>(frame) / 60.0f;
+        for (int y = 0; y < procedural_size; y++)
+        {
+            unsigned char *row = pixels + pitch * static_cast<size_t>(y);
+            for (int x = 0; x < procedural_size; x++)
+            {
+                float wave = 0.5f + 0.5f * std::sin(x * 0.05f + time) * std::sin(y * 0.05f + time * 0.7f);
+                unsigned char value = static_cast<unsigned char>(200.0f + 55.0f * wave);
+                row[x * 4 + 0] = value;
+                row[x * 4 + 1] = value;
+                row[x * 4 + 2] = value;
+                row[x * 4 + 3] = 255;
+            }
+        }
+        return true;
+    };
+}
 
+void run_scene(GLFWwindow* window, bool procedural_overlay, size_t texture_budget)
+{
     float vertices[] = 
     {
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
@@ -169,12 +217,6 @@ int main()
         -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
     };
 
-    unsigned int positions[] = 
-    {
-        0, 2, 1, 
-        0, 3, 2
-    };
-
     std::vector<glm::vec3>cube_positions =
     {
         glm::vec3( 0.0f,  0.0f,  0.0f), 
@@ -201,73 +243,155 @@ int main()
 
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(0));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindVertexArray(0);
-
-    unsigned int texture_id1, texture_id2;
 
-    glGenTextures(1, &texture_id1);
-    glBindTexture(GL_TEXTURE_2D, texture_id1);
+    GLenum cube_index_type;
+    glm::mat4 cube_dequantization;
+    std::vector<MeshLod> cube_lods;
+    glm::vec3 cube_bounds_min;
+    glm::vec3 cube_bounds_max;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_set_flip_vertically_on_load(true);
-    int texture_width, texture_height, nr_channels;
-    unsigned char *data = stbi_load("../../textures/container.jpg", &texture_width, &texture_height, &nr_channels, 0);
-    if (data)
+    MeshCache cube_cache;
+    if (cube_cache.load("../../meshes/cube.mesh"))
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        cube_cache.upload();
+        cube_index_type = cube_cache.header.index_type;
+        cube_dequantization = cube_cache.dequantization();
+        cube_lods = cube_cache.lods();
+        cube_bounds_min = glm::vec3(cube_cache.header.bounds_min[0], cube_cache.header.bounds_min[1], cube_cache.header.bounds_min[2]);
+        cube_bounds_max = glm::vec3(cube_cache.header.bounds_max[0], cube_cache.header.bounds_max[1], cube_cache.header.bounds_max[2]);
+        cube_cache.close();
     }
     else
     {
-        std::cout << "Failed to load texture\n";
+        ImportedMesh cube_source = weld_vertices(vertices, 36, 5, 3);
+        QuantizedMesh cube_mesh(cube_source.vertices.data(), cube_source.vertex_count(), cube_source.stride, cube_source.texture_coord_offset);
+        cube_mesh.report("cube");
+
+        MeshSimplifier simplifier(cube_source.vertices.data(), cube_source.vertex_count(), cube_source.stride);
+        cube_lods = simplifier.build_lod_chain(cube_source.indices, { 0.01f, 0.05f, 0.1f });
+
+        glBufferData(GL_ARRAY_BUFFER, cube_mesh.size(), cube_mesh.data.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, cube_source.indices.size() * sizeof(uint32_t), cube_source.indices.data(), GL_STATIC_DRAW);
+        cube_mesh.setup_attributes();
+
+        cube_index_type = GL_UNSIGNED_INT;
+        cube_dequantization = cube_mesh.dequantization;
+        cube_bounds_min = cube_mesh.bounds_min;
+        cube_bounds_max = cube_mesh.bounds_max;
     }
-    stbi_image_free(data);
 
+    unsigned int instance_VBO;
+    glGenBuffers(1, &instance_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, cube_positions.size() * sizeof(CubeInstance), nullptr, GL_STREAM_DRAW);
+    for (unsigned int location = 3; location <= 7; location++)
+    {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    setup_instance_attributes(0);
 
-    glGenTextures(1, &texture_id2);
-    glBindTexture(GL_TEXTURE_2D, texture_id2);
+    glBindVertexArray(0);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    size_t cube_index_size = cube_index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    glm::vec3 cube_center = (cube_bounds_min + cube_bounds_max) * 0.5f;
+    float cube_radius = glm::length(cube_bounds_max - cube_bounds_min) * 0.5f;
+    LodSelector lod_selector;
 
-    data = stbi_load("../../textures/awesomeface.png", &texture_width, &texture_height, &nr_channels, 0);
-    if (data)
+    ThreadPool thread_pool;
+    stbi_set_parallel_for(ThreadPool::parallel_for_callback, &thread_pool);
+    OcclusionCuller occlusion_culler(thread_pool);
+    std::vector<glm::vec3> instance_bounds_min, instance_bounds_max;
+    for (const glm::vec3 &position : cube_positions)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        instance_bounds_min.push_back(position + cube_bounds_min);
+        instance_bounds_max.push_back(position + cube_bounds_max);
     }
-    else
+    std::vector<size_t> occluders(cube_positions.size());
+    std::vector<uint8_t> cube_visible;
+
+    // Cubes are grouped by grid cell for hardware occlusion queries.
+    OcclusionQueries occlusion_queries("../../src/proxy_shader.vert", "../../src/proxy_shader.frag");
+    std::vector<std::vector<size_t>> cube_groups;
+    std::map<std::tuple<int, int, int>, size_t> group_cells;
+    std::vector<glm::vec3> group_bounds_min, group_bounds_max;
+    for (size_t i = 0; i < cube_positions.size(); i++)
+    {
+        glm::vec3 cell = cube_positions[i] / occlusion_group_size;
+        auto key = std::make_tuple(static_cast<int>(std::floor(cell.x)), static_cast<int>(std::floor(cell.y)), static_cast<int>(std::floor(cell.z)));
+        auto found = group_cells.emplace(key, cube_groups.size());
+        if (found.second)
+        {
+            cube_groups.emplace_back();
+            group_bounds_min.push_back(instance_bounds_min[i]);
+            group_bounds_max.push_back(instance_bounds_max[i]);
+        }
+        size_t group = found.first->second;
+        cube_groups[group].push_back(i);
+        group_bounds_min[group] = glm::min(group_bounds_min[group], instance_bounds_min[i]);
+        group_bounds_max[group] = glm::max(group_bounds_max[group], instance_bounds_max[i]);
+    }
+    for (size_t i = 0; i < cube_groups.size(); i++)
+        occlusion_queries.add_group(group_bounds_min[i], group_bounds_max[i]);
+
+    // Everything the scene keeps in VRAM is counted against one budget, declared first so it outlives its users.
+    TextureResidency residency(texture_budget);
+    TextureArrayAllocator texture_arrays(thread_pool);
+    texture_arrays.track_memory(residency);
+    texture_arrays.disk_cache.open("../../cache/textures");
+    TextureSlot texture1 = texture_arrays.load("../../textures/container.jpg");
+    TextureSlot texture2 = texture_arrays.load("../../textures/awesomeface.png");
+
+    // A tiled build of the container texture streams in place of its array slot, see tools/vt_build.cpp.
+    VirtualTexture virtual_texture(thread_pool);
+    virtual_texture.track_memory(residency);
+    bool use_virtual_texture = virtual_texture.open("../../textures/container.vtex");
+    float cube_size = cube_bounds_max.x - cube_bounds_min.x;
+
+    std::vector<CubeInstance> cube_instances(cube_positions.size());
+    for (size_t i = 0; i < cube_positions.size(); i++)
     {
-        std::cout << "Failed to load texture\n";
+        cube_instances[i].position = cube_positions[i];
+        cube_instances[i].layers = glm::vec2(static_cast<float>(texture1.layer), static_cast<float>(texture2.layer));
+        cube_instances[i].uv_rect1 = use_virtual_texture ? glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) : texture1.uv_rect;
+        cube_instances[i].uv_rect2 = texture2.uv_rect;
     }
-    stbi_image_free(data);
+    std::vector<std::vector<CubeInstance>> lod_batches(cube_lods.size());
 
+    // While the multiplier rests the blend of both images is drawn from one baked texture.
+    BlendBaker blend_baker("../../src/bake_shader.vert", "../../src/bake_shader.frag");
+    blend_baker.track_memory(residency);
 
     shader.use();
     shader.set_int("texture1", 0);
     shader.set_int("texture2", 1);
+    shader.set_bool("use_virtual_texture", use_virtual_texture);
+    // Samplers of different types must not share a unit, even when the virtual texture is not used.
+    shader.set_int("vt_physical", 2);
+    shader.set_int("vt_indirection", 3);
+    if (use_virtual_texture)
+        virtual_texture.bind(shader, 2, 3);
+    shader.set_int("composite", 4);
+    shader.set_int("procedural", 5);
+
+    // With --procedural a shimmer generated on its own thread is streamed in every frame and multiplied over the cubes.
+    std::unique_ptr<StreamingTexture> procedural;
+    shader.set_bool("use_procedural", procedural_overlay);
+    if (procedural_overlay)
+    {
+        procedural = std::make_unique<StreamingTexture>(procedural_size, procedural_size);
+        procedural->track_memory(residency);
+        procedural->start(shimmer_producer());
+    }
 
-    
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_id1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture1.texture);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture_id2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture2.texture);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, blend_baker.texture());
+    glActiveTexture(GL_TEXTURE0);
 
     while (!glfwWindowShouldClose(window))
     {
@@ -276,46 +400,191 @@ int main()
         last_frame = current_frame;
 
         input_process(window);
+        texture_arrays.update();
         shader.set_float("multiplier", multiplier);
 
         glClearColor(0.3f, 0.6f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glm::mat4 view = camera.get_view_matrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)width / (float)height, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)framebuffer_width / (float)framebuffer_height, near_plane, far_plane);
         shader.set_mat4("view", view);
         shader.set_mat4("projection", projection);
 
         glBindVertexArray(VAO);
 
-
-        for (int i = 0; i < cube_positions.size(); i++)
+        // The nearest instances cover the most screen area and make the best occluders.
+        for (size_t i = 0; i < occluders.size(); i++)
+            occluders[i] = i;
+        size_t occluder_count = std::min(max_occluders, occluders.size());
+        std::partial_sort(occluders.begin(), occluders.begin() + occluder_count, occluders.end(), [&](size_t a, size_t b) {
+            return glm::length(cube_positions[a] + cube_center - camera.position) < glm::length(cube_positions[b] + cube_center - camera.position);
+        });
+        occlusion_culler.begin_frame(projection * view);
+        for (size_t i = 0; i < occluder_count; i++)
+            occlusion_culler.add_box_occluder(instance_bounds_min[occluders[i]], instance_bounds_max[occluders[i]]);
+        occlusion_culler.rasterize();
+        occlusion_culler.test_boxes(instance_bounds_min, instance_bounds_max, cube_visible);
+
+        // Every face shows the whole texture, so each visible cube needs all tiles of the mip its nearest face wants,
+        // and streamed images the detail for the cube's projected size.
+        for (size_t i = 0; i < cube_positions.size(); i++)
         {
-            glm::mat4 model = glm::translate(glm::mat4(1.0f), cube_positions[i]);
-
-            shader.set_mat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            if (!cube_visible[i])
+                continue;
+            float distance = glm::length(cube_positions[i] + cube_center - camera.position) - cube_radius;
+            if (use_virtual_texture)
+                virtual_texture.request_for_distance(cube_size, distance, glm::radians(camera.zoom), framebuffer_height);
+            float screen_pixels = cube_size * framebuffer_height / (2.0f * std::tan(glm::radians(camera.zoom) * 0.5f) * std::max(distance, near_plane));
+            texture_arrays.request_detail(texture1, screen_pixels);
+            texture_arrays.request_detail(texture2, screen_pixels);
         }
-        
-
+        virtual_texture.update();
+        if (procedural)
+        {
+            procedural->update();
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, procedural->id());
+            glActiveTexture(GL_TEXTURE0);
+        }
+        // Whatever was not drawn lately gives up detail while the scene is over its texture budget.
+        residency.update();
+        glm::vec2 min_lods(texture_arrays.min_lod(texture1), texture_arrays.min_lod(texture2));
+        for (CubeInstance &instance : cube_instances)
+            instance.min_lods = min_lods;
+
+        // The virtual texture changes with its resident tiles, and arrays with their pending uploads, so those blend live.
+        BlendInputs blend_inputs;
+        blend_inputs.texture1 = texture1.texture;
+        blend_inputs.texture2 = texture2.texture;
+        blend_inputs.layers = glm::vec2(static_cast<float>(texture1.layer), static_cast<float>(texture2.layer));
+        blend_inputs.uv_rect1 = texture1.uv_rect;
+        blend_inputs.uv_rect2 = texture2.uv_rect;
+        blend_inputs.min_lods = min_lods;
+        blend_inputs.multiplier = multiplier;
+        shader.set_bool("use_composite", !use_virtual_texture && texture_arrays.pending() == 0 && blend_baker.update(blend_inputs));
+
+        // Instances are written to a fresh buffer each frame, one instanced draw per group and LOD.
+        // Every group is drawn once per frame, so the buffer never holds more than all instances.
+        shader.set_mat4("model", cube_dequantization);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+        glBufferData(GL_ARRAY_BUFFER, cube_instances.size() * sizeof(CubeInstance), nullptr, GL_STREAM_DRAW);
+        size_t instance_offset = 0;
+
+        lod_selector.update(camera, framebuffer_height);
+        occlusion_queries.render(projection * view, camera.position, near_plane, [&](size_t group) {
+            for (std::vector<CubeInstance> &batch : lod_batches)
+                batch.clear();
+            for (size_t i : cube_groups[group])
+            {
+                if (!cube_visible[i])
+                    continue;
+
+                int lod = lod_selector.select(cube_lods, cube_positions[i] + cube_center, cube_radius);
+                if (lod >= 0)
+                    lod_batches[lod].push_back(cube_instances[i]);
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+            for (size_t lod = 0; lod < lod_batches.size(); lod++)
+            {
+                const std::vector<CubeInstance> &batch = lod_batches[lod];
+                if (batch.empty())
+                    continue;
+                size_t size = batch.size() * sizeof(CubeInstance);
+                glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(instance_offset), static_cast<GLsizeiptr>(size), batch.data());
+                setup_instance_attributes(instance_offset);
+                glDrawElementsInstanced(GL_TRIANGLES, cube_lods[lod].index_count, cube_index_type, (void*)(cube_lods[lod].index_offset * cube_index_size), static_cast<GLsizei>(batch.size()));
+                instance_offset += size;
+            }
+        });
         glBindVertexArray(0);
 
-
         glfwPollEvents();
         glfwSwapBuffers(window);
     }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
+    // Textures are deleted by their owners going out of scope, deleting unbinds them from every unit.
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
-    glDeleteTextures(1, &texture_id1);
-    glDeleteTextures(1, &texture_id2);
+    glDeleteBuffers(1, &instance_VBO);
+    texture_arrays.report();
+    virtual_texture.report();
+    blend_baker.report();
+    if (procedural)
+        procedural->report();
+    residency.report();
+
+    stbi_set_parallel_for(nullptr, nullptr);
+}
 
+int main(int argc, char **argv)
+{
+    const std::string usage = std::string("Usage: ") + argv[0] + " [--procedural] [--texture-budget megabytes]";
+    bool procedural_overlay = false;
+    size_t texture_budget = TEXTURE_RESIDENCY_BUDGET;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--procedural")
+        {
+            procedural_overlay = true;
+        }
+        else if (argument == "--texture-budget" && i + 1 < argc)
+        {
+            const char *value = argv[++i];
+            char *end;
+            errno = 0;
+            long megabytes = std::strtol(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0' || megabytes <= 0 || megabytes > 1024 * 1024)
+            {
+                std::cout << "ERROR::MAIN::INVALID_ARGUMENT " << argument << " " << value << "\n" << usage << "\n";
+                return -1;
+            }
+            texture_budget = static_cast<size_t>(megabytes) * 1024 * 1024;
+        }
+        else
+        {
+            std::cout << "ERROR::MAIN::UNKNOWN_ARGUMENT " << argument << "\n" << usage << "\n";
+            return -1;
+        }
+    }
 
+    if (!glfwInit())
+    {
+        std::cout << "Failed to initialize GLFW\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    GLFWwindow* window = glfwCreateWindow(width, height, name.c_str(), nullptr, nullptr);
+    if (window == nullptr)
+    {
+        std::cout << "Failed to create a window\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framesize_buffer_callback);
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD\n";
+        glfwTerminate();
+        return -1;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    run_scene(window, procedural_overlay, texture_budget);
     glfwTerminate();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+layout (location = 0) in vec3 input_position;
+
+uniform mat4 view_projection;
+uniform vec3 bounds_min;
+uniform vec3 bounds_max;
+
+void main()
+{
+    gl_Position = view_projection * vec4(mix(bounds_min, bounds_max, input_position), 1.0f);
+}
\ No newline at end of file
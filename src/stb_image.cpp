@@ -1,2 +1,7 @@
+// Scratch memory of decodes inside a DecodeArenaScope comes from the thread's arena, see decode_arena.hpp.
+#include "decode_arena.hpp"
+#define STBI_MALLOC(size) decode_arena_malloc(size)
+#define STBI_REALLOC_SIZED(pointer, old_size, new_size) decode_arena_realloc(pointer, old_size, new_size)
+#define STBI_FREE(pointer) decode_arena_free(pointer)
 #define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
\ No newline at end of file
+#include "stb_image.h"
@@ -2,8 +2,17 @@
 
 layout (location = 0) in vec3 input_position;
 layout (location = 1) in vec2 input_texture_coord;
+layout (location = 3) in vec3 instance_position;
+layout (location = 4) in vec2 instance_layers;
+layout (location = 5) in vec4 instance_uv_rect1;
+layout (location = 6) in vec4 instance_uv_rect2;
+layout (location = 7) in vec2 instance_min_lods;
 
 out vec2 texture_coord;
+out vec2 texture_coord1;
+out vec2 texture_coord2;
+flat out vec2 layers;
+flat out vec2 min_lods;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -11,6 +20,12 @@ uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(input_position, 1.0f);
+    vec4 world_position = model * vec4(input_position, 1.0f);
+    world_position.xyz += instance_position;
+    gl_Position = projection * view * world_position;
     texture_coord = input_texture_coord;
+    texture_coord1 = instance_uv_rect1.xy + input_texture_coord * instance_uv_rect1.zw;
+    texture_coord2 = instance_uv_rect2.xy + input_texture_coord * instance_uv_rect2.zw;
+    layers = instance_layers;
+    min_lods = instance_min_lods;
 }
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cctype>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "stb_image.h"
+#include "decode_arena.hpp"
+#include "thread_pool.hpp"
+#include "image_encoders.hpp"
+
+// Measures stb_image decode throughput per format, on one thread and on a pool decoding many images at once.
+// The corpus is every image in the given files and directories plus synthetic JPEG, PNG, TGA and HDR images
+// at each size. The synthetic JPEGs are also written with restart markers and measured as format jpeg-rst,
+// one interval per MCU row unless --restart sets the MCUs per interval; --restart 0 leaves them out.
+// Prints MB/s of encoded input, megapixels/s and the peak resident set of every run, and writes the same
+// as JSON so runs of different commits can be compared with --compare.
+// Without files it reads ../../textures. --arena decodes through DecodeArena, --bands lets stb_image
+// split JPEG restart intervals and color conversion across the pool.
+static const char *const usage =
+    "Usage: decode_bench [files or directories...] [--sizes 256,1024,2048] [--iterations N] [--threads N]\n"
+    "                    [--restart MCUS] [--arena] [--bands] [--label NAME] [--json results.json] [--compare baseline.json]\n";
+
+struct DecodeSample
+{
+    std::string name;
+    std::string format;
+    std::vector<unsigned char> data;
+    bool hdr = false;
+    int width = 0;
+    int height = 0;
+};
+
+struct DecodeResult
+{
+    std::string format;
+    std::string mode;
+    size_t images = 0;
+    size_t decodes = 0;
+    double input_bytes = 0.0;
+    double megapixels = 0.0;
+    double seconds = 0.0;
+    size_t peak_rss = 0;
+    size_t peak_rss_increase = 0;
+    int failures = 0;
+
+    double megabytes_per_second() const
+    {
+        return seconds > 0.0 ? input_bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    double megapixels_per_second() const
+    {
+        return seconds > 0.0 ? megapixels / seconds : 0.0;
+    }
+};
+
+static bool read_file(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static std::string format_of(const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".jpg" || extension == ".jpeg")
+        return "jpeg";
+    if (extension == ".ppm" || extension == ".pgm" || extension == ".pnm")
+        return "pnm";
+    return extension.empty() ? "unknown" : extension.substr(1);
+}
+
+// Resident set size in bytes. Linux can reset the peak, elsewhere it is the peak of the whole process.
+static size_t read_rss(bool peak)
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    const std::string key = peak ? "VmHWM:" : "VmRSS:";
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, key.size(), key) == 0)
+            return static_cast<size_t>(std::strtoull(line.c_str() + key.size(), nullptr, 10)) * 1024;
+    }
+    return 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    if (!peak)
+        return 0;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    (void)peak;
+    return 0;
+#endif
+}
+
+// Returns freed heap to the system first, so each run's peak is not hidden by the previous run's.
+static void reset_peak_rss()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+#if defined(__linux__)
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+#endif
+}
+
+static bool decode(const DecodeSample &sample, bool arena)
+{
+    int width, height, channels;
+    if (sample.hdr)
+    {
+        float *pixels = stbi_loadf_from_memory(sample.data.data(), static_cast<int>(sample.data.size()), &width, &height, &channels, 0);
+        stbi_image_free(pixels);
+        return pixels != nullptr;
+    }
+    unsigned char *pixels = arena ? decode_image_in_arena(sample.data.data(), sample.data.size(), &width, &height, &channels, 0)
+                                  : stbi_load_from_memory(sample.data.data(), static_cast<int>(sample.data.size()), &width, &height, &channels, 0);
+    stbi_image_free(pixels);
+    return pixels != nullptr;
+}
+
+// Best of the iterations. The multi mode decodes every image once per pool thread in each pass,
+// so all threads stay busy even when a format has only a few images.
+static DecodeResult run(const std::string &format, const std::vector<const DecodeSample*> &samples, ThreadPool *pool, int iterations, bool arena)
+{
+    DecodeResult result;
+    result.format = format;
+    result.mode = pool ? "multi" : "single";
+    result.images = samples.size();
+    size_t copies = pool ? std::max<size_t>(1, pool->size()) : 1;
+    result.decodes = samples.size() * copies;
+    for (const DecodeSample *sample : samples)
+    {
+        result.input_bytes += static_cast<double>(sample->data.size()) * copies;
+        result.megapixels += static_cast<double>(sample->width) * sample->height * copies / 1e6;
+    }
+
+    reset_peak_rss();
+    size_t baseline = read_rss(false);
+    double best = 1e30;
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        std::atomic<int> failures(0);
+        auto start = std::chrono::steady_clock::now();
+        if (pool)
+            pool->parallel_for(0, result.decodes, [&](size_t i) {
+                if (!decode(*samples[i % samples.size()], arena))
+                    failures++;
+            });
+        else
+            for (const DecodeSample *sample : samples)
+                if (!decode(*sample, arena))
+                    failures++;
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+        result.failures = failures;
+    }
+    result.seconds = best;
+    result.peak_rss = read_rss(true);
+    result.peak_rss_increase = result.peak_rss > baseline ? result.peak_rss - baseline : 0;
+    return result;
+}
+
+static bool write_json(const std::string &path, const std::string &label, int iterations, size_t threads, bool arena, bool bands, const std::vector<DecodeResult> &results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::DECODE_BENCH::FILE_NOT_SUCCESFULLY_WRITTEN " << path << "\n";
+        return false;
+    }
+    file << std::fixed << std::setprecision(6);
+    file << "{\n  \"label\": \"" << label << "\",\n  \"iterations\": " << iterations << ",\n  \"threads\": " << threads
+         << ",\n  \"arena\": " << (arena ? "true" : "false") << ",\n  \"bands\": " << (bands ? "true" : "false") << ",\n  \"results\": [\n";
+    // One result per line, --compare reads them back line by line.
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const DecodeResult &result = results[i];
+        file << "    { \"format\": \"" << result.format << "\", \"mode\": \"" << result.mode << "\", \"images\": " << result.images
+             << ", \"decodes\": " << result.decodes << ", \"seconds\": " << result.seconds << ", \"input_bytes\": " << static_cast<uint64_t>(result.input_bytes)
+             << ", \"megapixels\": " << result.megapixels << ", \"megabytes_per_s\": " << result.megabytes_per_second()
+             << ", \"megapixels_per_s\": " << result.megapixels_per_second() << ", \"peak_rss_bytes\": " << result.peak_rss
+             << ", \"peak_rss_increase_bytes\": " << result.peak_rss_increase << ", \"failures\": " << result.failures << " }"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+// Megapixels per second of each format and mode in a file written by write_json.
+static std::map<std::string, double> read_baseline(const std::string &path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::DECODE_BENCH::FILE_NOT_SUCCESFULLY_READ " << path << "\n";
+        return baseline;
+    }
+    const std::regex pattern("\"format\": \"([^\"]*)\", \"mode\": \"([^\"]*)\".*\"megapixels_per_s\": ([0-9.]+)");
+    std::string line;
+    std::smatch match;
+    while (std::getline(file, line))
+    {
+        if (std::regex_search(line, match, pattern))
+            baseline[match[1].str() + " " + match[2].str()] = std::atof(match[3].str().c_str());
+    }
+    return baseline;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 5;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool arena = false, bands = false;
+    // 0 until set writes one restart interval per MCU row, below 0 leaves the jpeg-rst samples out.
+    int restart_interval = 0;
+    std::vector<int> sizes = { 256, 1024, 2048 };
+    std::string label, json_path, compare_path;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--iterations" && i + 1 < argc)
+            iterations = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--threads" && i + 1 < argc)
+            threads = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        else if (argument == "--sizes" && i + 1 < argc)
+        {
+            sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string size;
+            while (std::getline(list, size, ','))
+                if (std::atoi(size.c_str()) > 0)
+                    sizes.push_back(std::atoi(size.c_str()));
+        }
+        else if (argument == "--arena")
+            arena = true;
+        else if (argument == "--bands")
+            bands = true;
+        else if (argument == "--label" && i + 1 < argc)
+            label = argv[++i];
+        else if (argument == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (argument == "--compare" && i + 1 < argc)
+            compare_path = argv[++i];
+        else if (argument == "--restart" && i + 1 < argc)
+        {
+            restart_interval = std::atoi(argv[++i]);
+            if (restart_interval == 0)
+                restart_interval = -1;
+        }
+        else if (argument == "--help" || argument == "-h")
+        {
+            std::cout << usage;
+            return 0;
+        }
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            std::cout << "ERROR::DECODE_BENCH::UNKNOWN_OPTION " << argument << "\n" << usage;
+            return -1;
+        }
+        else
+            paths.push_back(argument);
+    }
+    if (paths.empty())
+    {
+        std::error_code error;
+        if (std::filesystem::is_directory("../../textures", error))
+            paths.push_back("../../textures");
+        else
+            std::cout << "ERROR::DECODE_BENCH::CORPUS_NOT_FOUND ../../textures, only synthetic images are measured\n";
+    }
+
+    std::vector<DecodeSample> samples;
+    for (const std::string &path : paths)
+    {
+        std::vector<std::string> files;
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error))
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(path, error))
+                if (entry.is_regular_file())
+                    files.push_back(entry.path().string());
+            std::sort(files.begin(), files.end());
+        }
+        else if (std::filesystem::exists(path, error))
+            files.push_back(path);
+        else
+            std::cout << "ERROR::DECODE_BENCH::FILE_NOT_FOUND " << path << "\n";
+
+        for (const std::string &file : files)
+        {
+            DecodeSample sample;
+            sample.name = file;
+            sample.format = format_of(file);
+            int channels;
+            if (!read_file(file, sample.data) || sample.data.size() > static_cast<size_t>(INT_MAX) ||
+                !stbi_info_from_memory(sample.data.data(), static_cast<int>(sample.data.size()), &sample.width, &sample.height, &channels))
+                continue;
+            sample.hdr = stbi_is_hdr_from_memory(sample.data.data(), static_cast<int>(sample.data.size())) != 0;
+            samples.push_back(std::move(sample));
+        }
+    }
+    for (int size : sizes)
+    {
+        std::vector<unsigned char> pixels = synthetic_pixels(size, size, 4);
+        std::vector<unsigned char> rgb(static_cast<size_t>(size) * size * 3);
+        for (size_t i = 0; i < rgb.size() / 3; i++)
+            std::memcpy(&rgb[i * 3], &pixels[i * 4], 3);
+        const std::string suffix = " " + std::to_string(size) + "x" + std::to_string(size);
+
+        DecodeSample sample;
+        sample.width = sample.height = size;
+        sample.name = "synthetic jpeg" + suffix;
+        sample.format = "jpeg";
+        sample.data = encode_jpeg(rgb, size, size, 3, 90);
+        samples.push_back(sample);
+        if (restart_interval >= 0)
+        {
+            sample.name = "synthetic jpeg-rst" + suffix;
+            sample.format = "jpeg-rst";
+            sample.data = encode_jpeg(rgb, size, size, 3, 90, restart_interval > 0 ? restart_interval : (size + 15) / 16);
+            samples.push_back(sample);
+        }
+        sample.name = "synthetic png" + suffix;
+        sample.format = "png";
+        sample.data = encode_png(pixels, size, size, 4);
+        samples.push_back(sample);
+        sample.name = "synthetic tga" + suffix;
+        sample.format = "tga";
+        sample.data = encode_tga(pixels, size, size, 4);
+        samples.push_back(sample);
+        sample.name = "synthetic hdr" + suffix;
+        sample.format = "hdr";
+        sample.data = encode_hdr(synthetic_hdr_pixels(size, size), size, size);
+        sample.hdr = true;
+        samples.push_back(sample);
+    }
+
+    std::map<std::string, std::vector<const DecodeSample*>> formats;
+    for (const DecodeSample &sample : samples)
+        formats[sample.format].push_back(&sample);
+
+    ThreadPool pool(static_cast<unsigned int>(threads));
+    if (bands)
+        stbi_set_parallel_for(ThreadPool::parallel_for_callback, &pool);
+    std::map<std::string, double> baseline;
+    if (!compare_path.empty())
+        baseline = read_baseline(compare_path);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << samples.size() << " images, " << iterations << " iterations, " << pool.size() << " threads" << (arena ? ", arena" : "") << (bands ? ", bands" : "") << "\n";
+    std::vector<DecodeResult> results;
+    int failures = 0;
+    for (const auto &format : formats)
+    {
+        for (ThreadPool *mode : { static_cast<ThreadPool*>(nullptr), &pool })
+        {
+            DecodeResult result = run(format.first, format.second, mode, iterations, arena);
+            std::cout << std::left << std::setw(8) << result.format << " " << std::setw(6) << result.mode << std::right << " " << std::setw(3) << result.images << " images: "
+                      << std::setw(8) << result.megabytes_per_second() << " MB/s " << std::setw(8) << result.megapixels_per_second() << " MP/s, peak RSS "
+                      << result.peak_rss / (1024.0 * 1024.0) << " MB (+" << result.peak_rss_increase / (1024.0 * 1024.0) << ")";
+            auto previous = baseline.find(result.format + " " + result.mode);
+            if (previous != baseline.end() && previous->second > 0.0)
+                std::cout << ", " << std::setprecision(2) << result.megapixels_per_second() / previous->second << "x baseline" << std::setprecision(1);
+            if (result.failures)
+                std::cout << ", " << result.failures << " failed";
+            std::cout << "\n";
+            failures += result.failures;
+            results.push_back(result);
+        }
+    }
+    stbi_set_parallel_for(nullptr, nullptr);
+
+    if (!json_path.empty() && !write_json(json_path, label, iterations, pool.size(), arena, bands, results))
+        return -1;
+    return failures == 0 ? 0 : 1;
+}
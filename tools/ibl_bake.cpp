@@ -0,0 +1,144 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cerrno>
+#include "stb_image.h"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "xxhash64.hpp"
+#include "ibl_bake.hpp"
+#include "ibl_environment.hpp"
+
+const char *usage = "Usage: ibl_bake <input.hdr> <output.ibl> [--size <face size>] [--mips <count>] [--samples <count>] [--force]\n";
+
+// Whole decimal numbers that fit an int, anything else is rejected instead of read partially.
+static bool parse_int(const char *text, int &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX)
+        return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// Bakes image based lighting from an equirectangular HDR image for IblEnvironment: a GGX prefiltered
+// specular cubemap and irradiance spherical harmonics. Outputs whose key matches the source bytes and
+// settings are left alone, so running it again over unchanged sources costs a hash of each.
+// Usage: ibl_bake <input.hdr> <output.ibl> [--size <face size>] [--mips <count>] [--samples <count>] [--force]
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cout << usage;
+        return -1;
+    }
+
+    int face_size = 0;
+    int mip_count = IBL_SPECULAR_MIPS;
+    int sample_count = IBL_SAMPLE_COUNT;
+    bool force = false;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        int *option = argument == "--size" ? &face_size : argument == "--mips" ? &mip_count : argument == "--samples" ? &sample_count : nullptr;
+        if (option && i + 1 < argc)
+        {
+            if (!parse_int(argv[++i], *option))
+            {
+                std::cout << "ERROR::IBL_BAKE::INVALID_ARGUMENT " << argument << " " << argv[i] << "\n" << usage;
+                return -1;
+            }
+        }
+        else if (argument == "--force")
+            force = true;
+        else
+        {
+            std::cout << "ERROR::IBL_BAKE::UNKNOWN_ARGUMENT " << argument << "\n" << usage;
+            return -1;
+        }
+    }
+
+    MappedFile source;
+    if (!source.open(argv[1]) || source.size() > static_cast<size_t>(INT_MAX))
+    {
+        std::cout << "Failed to load texture " << argv[1] << "\n";
+        return -1;
+    }
+    int width, height, channels;
+    if (!stbi_info_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &channels))
+    {
+        std::cout << "Failed to load texture " << argv[1] << "\n";
+        return -1;
+    }
+    // A face covers a quarter of the image's width, rounded down to a power of two for the mip chain.
+    if (face_size == 0)
+    {
+        face_size = 1;
+        while (face_size * 2 <= std::min(width / 4, 512))
+            face_size *= 2;
+    }
+    int max_mips = 1;
+    while ((face_size >> max_mips) > 0)
+        max_mips++;
+    if (face_size < 1 || (face_size & (face_size - 1)) != 0 || mip_count < 1 || mip_count > std::min(max_mips, 16) || sample_count < 1)
+    {
+        std::cout << "ERROR::IBL_BAKE::INVALID_SETTINGS size " << face_size << " mips " << mip_count << " samples " << sample_count << "\n";
+        return -1;
+    }
+
+    const uint32_t settings[4] = { static_cast<uint32_t>(face_size), static_cast<uint32_t>(mip_count), static_cast<uint32_t>(sample_count), 1 };
+    uint64_t key = xxhash64(settings, sizeof(settings), xxhash64(source.data(), source.size()));
+    IblEnvironmentHeader existing;
+    if (!force && read_ibl_environment_header(argv[2], existing) && existing.source_key == key)
+    {
+        std::cout << argv[2] << " is up to date\n";
+        return 0;
+    }
+
+    ThreadPool pool;
+    auto start = std::chrono::steady_clock::now();
+    auto lap = [&start]() {
+        auto now = std::chrono::steady_clock::now();
+        double milliseconds = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+        return milliseconds;
+    };
+
+    source.advise(ACCESS_SEQUENTIAL);
+    float *pixels = stbi_loadf_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &channels, 3);
+    if (!pixels)
+    {
+        std::cout << "Failed to load texture " << argv[1] << "\n";
+        return -1;
+    }
+    double decode_ms = lap();
+    CubemapLevel cubemap = equirect_to_cubemap(pixels, width, height, face_size, pool);
+    stbi_image_free(pixels);
+    double cubemap_ms = lap();
+
+    glm::vec3 irradiance[IBL_SH_COEFFICIENTS];
+    irradiance_sh9(cubemap, pool, irradiance);
+    double irradiance_ms = lap();
+
+    std::vector<CubemapLevel> chain = build_cubemap_chain(cubemap, pool);
+    std::vector<CubemapLevel> specular = prefilter_ggx(chain, mip_count, sample_count, pool);
+    double specular_ms = lap();
+
+    std::vector<std::vector<float>> levels;
+    for (CubemapLevel &level : specular)
+        levels.push_back(std::move(level.data));
+    if (!write_ibl_environment(argv[2], key, face_size, sample_count, levels, irradiance))
+        return -1;
+
+    std::cout << argv[1] << ": " << width << "x" << height << " to " << face_size << "^2 faces, " << mip_count << " specular mips, "
+              << sample_count << " samples on " << pool.size() + 1 << " threads\n"
+              << "  decode " << decode_ms << " ms, cubemap " << cubemap_ms << " ms, irradiance " << irradiance_ms << " ms, specular "
+              << specular_ms << " ms\n"
+              << "  irradiance sh0 " << irradiance[0].x << " " << irradiance[0].y << " " << irradiance[0].z << "\n";
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "mapped_image.hpp"
+
+// Packs images into one archive that ImageArchive maps and decodes from.
+// Usage: image_pack <output.pak> <files or directories...>
+// Files inside a directory are named by their path relative to it with forward slashes,
+// files given directly by their file name. Files stb_image cannot read are skipped in directories.
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: image_pack <output.pak> <files or directories...>\n";
+        return -1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> inputs;
+    for (int i = 2; i < argc; i++)
+    {
+        std::filesystem::path path(argv[i]);
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error))
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(path, error))
+            {
+                int width, height, channels;
+                if (entry.is_regular_file() && stbi_info(entry.path().string().c_str(), &width, &height, &channels))
+                    inputs.push_back({ entry.path().lexically_relative(path).generic_string(), entry.path().string() });
+            }
+        }
+        else
+            inputs.push_back({ path.filename().generic_string(), path.string() });
+    }
+    std::sort(inputs.begin(), inputs.end());
+
+    std::vector<std::string> names, files;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (i > 0 && inputs[i].first == inputs[i - 1].first)
+        {
+            std::cout << "ERROR::IMAGE_PACK::DUPLICATE_NAME " << inputs[i].first << "\n";
+            return -1;
+        }
+        names.push_back(inputs[i].first);
+        files.push_back(inputs[i].second);
+    }
+    if (!write_image_archive(argv[1], files, names))
+        return -1;
+    std::cout << "Packed " << files.size() << " images into " << argv[1] << "\n";
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <iostream>
+#include <string>
+#include "mesh_import.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_simplifier.hpp"
+#include "vertex_format.hpp"
+
+// Converts OBJ and glTF 2.0 meshes into binary mesh caches.
+// Usage: mesh_import <input.obj|input.gltf|input.glb> <output.mesh>
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::cout << "Usage: mesh_import <input.obj|input.gltf|input.glb> <output.mesh>\n";
+        return -1;
+    }
+
+    ImportedMesh mesh;
+    if (!load_mesh(argv[1], mesh))
+    {
+        std::cout << "Failed to import mesh " << argv[1] << "\n";
+        return -1;
+    }
+
+    // LOD error bounds relative to the largest mesh extent
+    const float lod_error_bounds[] = { 0.002f, 0.005f, 0.01f, 0.02f, 0.05f };
+
+    QuantizedMesh quantized(mesh.vertices.data(), mesh.vertex_count(), mesh.stride, mesh.texture_coord_offset, mesh.normal_offset);
+    quantized.report(argv[1]);
+
+    glm::vec3 extent = quantized.bounds_max - quantized.bounds_min;
+    float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+    std::vector<float> error_bounds;
+    for (float bound : lod_error_bounds)
+        error_bounds.push_back(bound * max_extent);
+
+    MeshSimplifier simplifier(mesh.vertices.data(), mesh.vertex_count(), mesh.stride);
+    std::vector<MeshLod> lods = simplifier.build_lod_chain(mesh.indices, error_bounds);
+    for (size_t i = 0; i < lods.size(); i++)
+        std::cout << "LOD " << i << ": " << lods[i].index_count / 3 << " triangles, error " << lods[i].error << "\n";
+
+    if (!write_mesh_cache(argv[2], quantized, mesh.indices, lods))
+    {
+        std::cout << "Failed to write mesh cache " << argv[2] << "\n";
+        return -1;
+    }
+    std::cout << "Wrote " << argv[2] << ": " << mesh.indices.size() << " indices in " << lods.size() << " levels\n";
+    return 0;
+}
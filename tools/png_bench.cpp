@@ -0,0 +1,134 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include "stb_image.h"
+#include "image_encoders.hpp"
+
+// Decodes PNGs with stb_image's scalar path and with the SSE2 unfilters and inflate fast path,
+// checks that both give the same pixels and prints the time of each.
+// Usage: png_bench [files or directories...] [--iterations N]
+// Without arguments it runs on textures/awesomeface.png. Synthetic images using every filter
+// type are always added, so both paths are measured on larger images as well.
+
+struct PngSample
+{
+    std::string name;
+    std::vector<unsigned char> data;
+};
+
+static bool read_file(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Best of the iterations, in milliseconds. Output of the last decode is kept for comparison.
+static double time_decode(const PngSample &sample, int iterations, bool fast_path, std::vector<unsigned char> &output, int &width, int &height)
+{
+    stbi_set_png_fast_path(fast_path ? 1 : 0);
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        int channels;
+        auto start = std::chrono::steady_clock::now();
+        unsigned char *pixels = stbi_load_from_memory(sample.data.data(), static_cast<int>(sample.data.size()), &width, &height, &channels, 0);
+        auto end = std::chrono::steady_clock::now();
+        if (!pixels)
+            return -1.0;
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        if (i == iterations - 1)
+            output.assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+        stbi_image_free(pixels);
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 10;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--iterations" && i + 1 < argc)
+            iterations = std::max(1, std::atoi(argv[++i]));
+        else
+            paths.push_back(argument);
+    }
+    if (paths.empty())
+        paths.push_back("../../textures/awesomeface.png");
+
+    std::vector<PngSample> samples;
+    for (const std::string &path : paths)
+    {
+        std::vector<std::string> files;
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error))
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(path, error))
+                if (entry.is_regular_file() && entry.path().extension() == ".png")
+                    files.push_back(entry.path().string());
+            std::sort(files.begin(), files.end());
+        }
+        else
+            files.push_back(path);
+
+        for (const std::string &file : files)
+        {
+            PngSample sample;
+            sample.name = file;
+            if (!read_file(file, sample.data))
+                std::cout << "Failed to read " << file << "\n";
+            else
+                samples.push_back(sample);
+        }
+    }
+    const int synthetic_sizes[][3] = { { 1024, 1024, 4 }, { 2048, 2048, 4 }, { 2048, 1024, 3 } };
+    for (const auto &size : synthetic_sizes)
+    {
+        PngSample sample;
+        sample.name = "synthetic " + std::to_string(size[0]) + "x" + std::to_string(size[1]) + (size[2] == 4 ? " rgba" : " rgb");
+        sample.data = encode_png(synthetic_pixels(size[0], size[1], size[2]), size[0], size[1], size[2]);
+        samples.push_back(sample);
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    double total_scalar = 0.0, total_fast = 0.0, total_megabytes = 0.0;
+    int mismatches = 0;
+    for (const PngSample &sample : samples)
+    {
+        std::vector<unsigned char> scalar_pixels, fast_pixels;
+        int width = 0, height = 0;
+        double scalar = time_decode(sample, iterations, false, scalar_pixels, width, height);
+        double fast = time_decode(sample, iterations, true, fast_pixels, width, height);
+        if (scalar < 0.0 || fast < 0.0)
+        {
+            std::cout << "Failed to load texture " << sample.name << ": " << stbi_failure_reason() << "\n";
+            continue;
+        }
+        bool identical = scalar_pixels == fast_pixels;
+        if (!identical)
+            mismatches++;
+        double megabytes = fast_pixels.size() / (1024.0 * 1024.0);
+        total_scalar += scalar;
+        total_fast += fast;
+        total_megabytes += megabytes;
+        std::cout << sample.name << " " << width << "x" << height << ": scalar " << scalar << " ms (" << megabytes / scalar * 1000.0 << " MB/s), fast "
+                  << fast << " ms (" << megabytes / fast * 1000.0 << " MB/s), " << scalar / fast << "x" << (identical ? "" : " OUTPUT DIFFERS") << "\n";
+    }
+    if (total_fast > 0.0)
+        std::cout << "total " << samples.size() << " images: scalar " << total_scalar << " ms (" << total_megabytes / total_scalar * 1000.0 << " MB/s), fast "
+                  << total_fast << " ms (" << total_megabytes / total_fast * 1000.0 << " MB/s), " << total_scalar / total_fast << "x\n";
+    return mismatches == 0 ? 0 : 1;
+}
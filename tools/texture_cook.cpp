@@ -0,0 +1,99 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "stb_image.h"
+#include "mapped_image.hpp"
+#include "block_compression.hpp"
+#include "gl_extensions.hpp"
+#include "ktx_texture.hpp"
+#include "thread_pool.hpp"
+#include "mip_generator.hpp"
+
+// Compresses an image and its full mip chain into a KTX file.
+// Usage: texture_cook <input> <output.ktx> [bc1|bc3|bc7] [--srgb] [--linear]
+// Without a format, opaque images become BC1 and images with alpha BC3.
+// Mips are filtered in linear light unless --linear marks the image as non-color data.
+// Images are flipped vertically like the runtime loader does.
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: texture_cook <input> <output.ktx> [bc1|bc3|bc7] [--srgb] [--linear]\n";
+        return -1;
+    }
+
+    std::string format_name;
+    bool srgb = false;
+    bool linear = false;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--srgb")
+            srgb = true;
+        else if (argument == "--linear")
+            linear = true;
+        else
+            format_name = argument;
+    }
+
+    ThreadPool pool;
+    stbi_set_parallel_for(ThreadPool::parallel_for_callback, &pool);
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, channels;
+    unsigned char *pixels = load_mapped_image(argv[1], &width, &height, &channels, 4);
+    if (!pixels)
+    {
+        std::cout << "Failed to load texture " << argv[1] << "\n";
+        return -1;
+    }
+    Block_Format format;
+    if (format_name == "bc1")
+        format = BLOCK_BC1;
+    else if (format_name == "bc3")
+        format = BLOCK_BC3;
+    else if (format_name == "bc7")
+        format = BLOCK_BC7;
+    else if (format_name.empty())
+        format = channels == 2 || channels == 4 ? BLOCK_BC3 : BLOCK_BC1;
+    else
+    {
+        std::cout << "ERROR::TEXTURE_COOK::UNKNOWN_FORMAT " << format_name << "\n";
+        return -1;
+    }
+
+    KtxImage image;
+    image.width = static_cast<uint32_t>(width);
+    image.height = static_cast<uint32_t>(height);
+    if (format == BLOCK_BC1)
+    {
+        image.gl_internal_format = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        image.gl_base_internal_format = GL_RGB;
+    }
+    else if (format == BLOCK_BC3)
+        image.gl_internal_format = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else
+        image.gl_internal_format = srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+    image.key_values[KTX_ORIENTATION_KEY] = KTX_ORIENTATION_UP;
+
+    std::vector<MipLevel> levels = generate_mip_chain(pixels, width, height, 4, !linear, true, &pool);
+    stbi_image_free(pixels);
+
+    size_t source_size = 0;
+    for (const MipLevel &level : levels)
+    {
+        source_size += level.data.size();
+        image.images.push_back(compress_image(level.data.data(), level.width, level.height, format, pool));
+    }
+
+    if (!write_ktx(argv[2], image))
+        return -1;
+
+    size_t compressed_size = 0;
+    for (const std::vector<unsigned char> &data : image.images)
+        compressed_size += data.size();
+    std::cout << argv[1] << ": " << width << "x" << height << ", " << image.images.size() << " levels, "
+              << source_size << " -> " << compressed_size << " bytes\n";
+    return 0;
+}
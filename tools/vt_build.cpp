@@ -0,0 +1,68 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "stb_image.h"
+#include "mapped_image.hpp"
+#include "thread_pool.hpp"
+#include "mip_generator.hpp"
+#include "virtual_texture.hpp"
+
+// Cuts an image and its mip chain into fixed size tiles for VirtualTexture.
+// Usage: vt_build <input> <output.vtex> [--tile <size>] [--border <texels>] [--linear]
+// Mips are filtered in linear light unless --linear marks the image as non-color data.
+// Images are flipped vertically like the runtime loader does.
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: vt_build <input> <output.vtex> [--tile <size>] [--border <texels>] [--linear]\n";
+        return -1;
+    }
+
+    int tile_size = 128;
+    int border = 4;
+    bool linear = false;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--tile" && i + 1 < argc)
+            tile_size = std::stoi(argv[++i]);
+        else if (argument == "--border" && i + 1 < argc)
+            border = std::stoi(argv[++i]);
+        else if (argument == "--linear")
+            linear = true;
+        else
+        {
+            std::cout << "ERROR::VT_BUILD::UNKNOWN_ARGUMENT " << argument << "\n";
+            return -1;
+        }
+    }
+    if (tile_size < 16 || border < 0 || border > tile_size / 2)
+    {
+        std::cout << "ERROR::VT_BUILD::INVALID_TILE_SIZE " << tile_size << " border " << border << "\n";
+        return -1;
+    }
+
+    ThreadPool pool;
+    stbi_set_parallel_for(ThreadPool::parallel_for_callback, &pool);
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, channels;
+    unsigned char *pixels = load_mapped_image(argv[1], &width, &height, &channels, 4);
+    if (!pixels)
+    {
+        std::cout << "Failed to load texture " << argv[1] << "\n";
+        return -1;
+    }
+    std::vector<MipLevel> levels = generate_mip_chain(pixels, width, height, 4, !linear, true, &pool);
+    stbi_image_free(pixels);
+
+    if (!write_virtual_texture(argv[2], levels, tile_size, border))
+        return -1;
+
+    VirtualTextureFile file;
+    if (!file.open(argv[2]))
+        return -1;
+    std::cout << argv[1] << ": " << width << "x" << height << ", " << file.mips.size() << " mips, " << file.header.tile_count << " tiles of "
+              << tile_size << "+" << border << "x2 texels\n";
+    return 0;
+}